@@ -145,6 +145,7 @@ HEADERS += \
 	src/gl/marker/furniture.h \
 	src/gl/bsshape.h \
 	src/gl/controllers.h \
+	src/gl/glbuffer.h \
 	src/gl/glcontroller.h \
 	src/gl/glmarker.h \
 	src/gl/glmesh.h \
@@ -152,12 +153,18 @@ HEADERS += \
 	src/gl/glparticles.h \
 	src/gl/glproperty.h \
 	src/gl/glscene.h \
+	src/gl/glskin.h \
 	src/gl/gltex.h \
 	src/gl/gltexloaders.h \
+	src/gl/gltexpaths.h \
+	src/gl/gltexpixels.h \
 	src/gl/gltools.h \
 	src/gl/icontrollable.h \
 	src/gl/renderer.h \
 	src/io/material.h \
+	src/io/nifdiff.h \
+	src/io/nifindex.h \
+	src/io/nifroundtrip.h \
 	src/io/nifstream.h \
 	src/lib/importex/3ds.h \
 	src/lib/nvtristripwrapper.h \
@@ -209,6 +216,7 @@ SOURCES += \
 	src/data/nifvalue.cpp \
 	src/gl/bsshape.cpp \
 	src/gl/controllers.cpp \
+	src/gl/glbuffer.cpp \
 	src/gl/glcontroller.cpp \
 	src/gl/glmarker.cpp \
 	src/gl/glmesh.cpp \
@@ -216,11 +224,17 @@ SOURCES += \
 	src/gl/glparticles.cpp \
 	src/gl/glproperty.cpp \
 	src/gl/glscene.cpp \
+	src/gl/glskin.cpp \
 	src/gl/gltex.cpp \
 	src/gl/gltexloaders.cpp \
+	src/gl/gltexpaths.cpp \
+	src/gl/gltexpixels.cpp \
 	src/gl/gltools.cpp \
 	src/gl/renderer.cpp \
 	src/io/material.cpp \
+	src/io/nifdiff.cpp \
+	src/io/nifindex.cpp \
+	src/io/nifroundtrip.cpp \
 	src/io/nifstream.cpp \
 	src/lib/importex/3ds.cpp \
 	src/lib/importex/importex.cpp \
@@ -309,10 +323,16 @@ fsengine {
 	INCLUDEPATH += lib/fsengine
 	HEADERS += \
 		lib/fsengine/bsa.h \
+		lib/fsengine/bsawriter.h \
+		lib/fsengine/decompressor.h \
+		lib/fsengine/entrycache.h \
 		lib/fsengine/fsengine.h \
 		lib/fsengine/fsmanager.h
 	SOURCES += \
 		lib/fsengine/bsa.cpp \
+		lib/fsengine/bsawriter.cpp \
+		lib/fsengine/decompressor.cpp \
+		lib/fsengine/entrycache.cpp \
 		lib/fsengine/fsengine.cpp \
 		lib/fsengine/fsmanager.cpp
 }
@@ -32,16 +32,36 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "bsa.h"
 #include "dds.h"
-#include "zlib/zlib.h"
-#include "lz4frame.h"
+#include "decompressor.h"
 
 #include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
 #include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QRegExp>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QSemaphore>
+#include <QStandardPaths>
 #include <QStringBuilder>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <functional>
+
+
+//! Magic of an archive directory cache file, the literal string "BSAC"
+#define BSA_CACHE_MAGIC 0x43415342
+//! Version of the archive directory cache format; bump when BSAFile changes
+#define BSA_CACHE_VERSION 1
+
+//! Textures smaller than this are inflated on the calling thread
+#define BA2_PARALLEL_MIN_SIZE (512 * 1024)
 
 
 // see bsa.h
@@ -77,55 +97,52 @@ static bool BSAReadSizedString( QFile & bsa, QString & s )
 	return false;
 }
 
-QByteArray gUncompress( const QByteArray & data, const int size )
+//! Shared state of a parallelFor; outlives the call if helpers start late
+struct ParallelJob
 {
-	if ( data.size() <= 4 ) {
-		qWarning( "gUncompress: Input data is truncated" );
-		return QByteArray();
-	}
+	std::function<void( int )> fn;
+	int count = 0;
+	QAtomicInt next;
+	QSemaphore done;
 
-	QByteArray result;
-
-	int ret;
-	z_stream strm;
-	static const int CHUNK_SIZE = 1024;
-	char out[CHUNK_SIZE];
-
-	/* allocate inflate state */
-	strm.zalloc = Z_NULL;
-	strm.zfree = Z_NULL;
-	strm.opaque = Z_NULL;
-	strm.avail_in = size;
-	strm.next_in = (Bytef*)(data.data());
-
-	ret = inflateInit2( &strm, 15 + 32 ); // gzip decoding
-	Q_ASSERT( ret == Z_OK );
-	if ( ret != Z_OK )
-		return QByteArray();
-
-	// run inflate()
-	do {
-		strm.avail_out = CHUNK_SIZE;
-		strm.next_out = (Bytef*)(out);
-
-		ret = inflate( &strm, Z_NO_FLUSH );
-		Q_ASSERT( ret != Z_STREAM_ERROR );  // state not clobbered
-
-		switch ( ret ) {
-		case Z_NEED_DICT:
-			ret = Z_DATA_ERROR;     // and fall through
-		case Z_DATA_ERROR:
-		case Z_MEM_ERROR:
-			(void)inflateEnd( &strm );
-			return QByteArray();
+	void run()
+	{
+		int i;
+		while ( (i = next.fetchAndAddRelaxed( 1 )) < count ) {
+			fn( i );
+			done.release();
 		}
+	}
+};
 
-		result.append( out, CHUNK_SIZE - strm.avail_out );
-	} while ( strm.avail_out == 0 );
+class ParallelRunnable final : public QRunnable
+{
+public:
+	ParallelRunnable( std::shared_ptr<ParallelJob> job ) : job( job ) {}
+
+	void run() override { job->run(); }
 
-	// clean up and return
-	inflateEnd( &strm );
-	return result;
+private:
+	std::shared_ptr<ParallelJob> job;
+};
+
+/*! Calls fn( 0 ) ... fn( count - 1 ) on the global thread pool and the calling thread.
+ *
+ * The calling thread takes indices too, so this finishes even if the pool is busy.
+ */
+static void parallelFor( int count, const std::function<void( int )> & fn )
+{
+	auto job = std::make_shared<ParallelJob>();
+	job->fn = fn;
+	job->count = count;
+
+	QThreadPool * pool = QThreadPool::globalInstance();
+	int helpers = qMin( count, pool->maxThreadCount() ) - 1;
+	for ( int i = 0; i < helpers; i++ )
+		pool->start( new ParallelRunnable( job ) );
+
+	job->run();
+	job->done.acquire( count );
 }
 
 // see bsa.h
@@ -179,6 +196,8 @@ bool BSA::canOpen( const QString & fn )
 bool BSA::open()
 {
 	QMutexLocker lock( & bsaMutex );
+
+	bool fromCache = false;
 	
 	try
 	{
@@ -189,7 +208,10 @@ bool BSA::open()
 		
 		bsa.read( (char*) &magic, sizeof( magic ) );
 
-		if ( magic == F4_BSAHEADER_FILEID ) {
+		if ( useCache && readCache() ) {
+			// Unchanged archives are restored from the directory cache instead of being parsed
+			fromCache = true;
+		} else if ( magic == F4_BSAHEADER_FILEID ) {
 			bsa.read( (char*)&version, sizeof( version ) );
 
 			if ( version != F4_BSAHEADER_VERSION )
@@ -206,8 +228,8 @@ bool BSA::open()
 			QVector<QString> filepaths;
 			if ( bsa.seek( offset ) ) {
 				for ( quint32 i = 0; i < numFiles; i++ ) {
-					quint8 length;
-					bsa.read( (char*)&length, 2 );
+					quint16 length;
+					bsa.read( (char*)&length, sizeof( length ) );
 
 					QByteArray strdata( length, char( 0 ) );
 					bsa.read( strdata.data(), length );
@@ -423,17 +445,144 @@ bool BSA::open()
 		status = e;
 		return false;
 	}
+
+	if ( useCache && !fromCache )
+		writeCache();
 	
+	// Entries are served as views into the mapping; reads fall back to seeking under the mutex if mapping fails
+	mapped = bsa.map( 0, bsa.size() );
+	mappedSize = mapped ? bsa.size() : 0;
+
 	status = "loaded successful";
 	
 	return true;
 }
 
+//! Returns the directory cache file for an archive
+static QString cacheFile( const QString & bsaPath )
+{
+	QString hash = QString::fromLatin1( QCryptographicHash::hash( bsaPath.toLower().toUtf8(), QCryptographicHash::Md5 ).toHex() );
+
+	return QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) + "/archives/" + hash + ".dir";
+}
+
+// see bsa.h
+bool BSA::readCache()
+{
+	QFile f( cacheFile( bsaPath ) );
+	if ( !f.open( QIODevice::ReadOnly ) )
+		return false;
+
+	// Read the whole cache at once and parse it from memory
+	QByteArray data = f.readAll();
+	QDataStream in( data );
+	in.setVersion( QDataStream::Qt_5_7 );
+	in.setByteOrder( QDataStream::LittleEndian );
+
+	quint32 magic = 0, cacheVersion = 0;
+	QString storedPath;
+	qint64 size = 0, modified = 0;
+	in >> magic >> cacheVersion >> storedPath >> size >> modified;
+
+	if ( magic != BSA_CACHE_MAGIC || cacheVersion != BSA_CACHE_VERSION || storedPath != bsaPath
+		 || size != bsaInfo.size() || modified != bsaInfo.lastModified().toMSecsSinceEpoch() )
+		return false;
+
+	quint32 folderCount = 0;
+	in >> version >> compressToggle >> namePrefix >> numFiles >> folderCount;
+
+	for ( quint32 i = 0; i < folderCount && in.status() == QDataStream::Ok; i++ ) {
+		QString folderName;
+		quint32 fileCount = 0;
+		in >> folderName >> fileCount;
+
+		BSAFolder * folder = insertFolder( folderName );
+
+		for ( quint32 j = 0; j < fileCount && in.status() == QDataStream::Ok; j++ ) {
+			QString name;
+			BSAFile * file = new BSAFile;
+			quint8 numChunks = 0;
+
+			in >> name >> file->sizeFlags >> file->packedLength >> file->unpackedLength >> file->offset >> numChunks;
+
+			if ( numChunks ) {
+				in.readRawData( (char *)&file->tex.header, sizeof( F4TexInfo ) );
+				file->tex.chunks.resize( numChunks );
+				in.readRawData( (char *)file->tex.chunks.data(), numChunks * sizeof( F4TexChunk ) );
+			}
+
+			folder->files.insert( name, file );
+			files.insert( QString( folder->name % "/" % name ).toLower(), file );
+		}
+	}
+
+	if ( in.status() != QDataStream::Ok ) {
+		// Start over from the archive itself
+		qDeleteAll( root->children );
+		qDeleteAll( root->files );
+		root->children.clear();
+		root->files.clear();
+		folders.clear();
+		files.clear();
+		return false;
+	}
+
+	return true;
+}
+
+// see bsa.h
+void BSA::writeCache() const
+{
+	QString path = cacheFile( bsaPath );
+	QDir().mkpath( QFileInfo( path ).absolutePath() );
+
+	QByteArray data;
+	QDataStream out( &data, QIODevice::WriteOnly );
+	out.setVersion( QDataStream::Qt_5_7 );
+	out.setByteOrder( QDataStream::LittleEndian );
+
+	out << quint32( BSA_CACHE_MAGIC ) << quint32( BSA_CACHE_VERSION ) << bsaPath
+		<< qint64( bsaInfo.size() ) << qint64( bsaInfo.lastModified().toMSecsSinceEpoch() );
+
+	QList<const BSAFolder *> all;
+	all << root;
+	for ( const BSAFolder * folder : folders )
+		all << folder;
+
+	out << version << compressToggle << namePrefix << numFiles << quint32( all.count() );
+
+	for ( const BSAFolder * folder : all ) {
+		out << folder->name << quint32( folder->files.count() );
+
+		for ( auto it = folder->files.cbegin(); it != folder->files.cend(); ++it ) {
+			const BSAFile * file = it.value();
+			quint8 numChunks = quint8( file->tex.chunks.count() );
+
+			out << it.key() << file->sizeFlags << file->packedLength << file->unpackedLength << file->offset << numChunks;
+
+			if ( numChunks ) {
+				out.writeRawData( (const char *)&file->tex.header, sizeof( F4TexInfo ) );
+				out.writeRawData( (const char *)file->tex.chunks.constData(), numChunks * sizeof( F4TexChunk ) );
+			}
+		}
+	}
+
+	QSaveFile f( path );
+	if ( f.open( QIODevice::WriteOnly ) && f.write( data ) == data.size() )
+		f.commit();
+}
+
 // see bsa.h
 void BSA::close()
 {
 	QMutexLocker lock( & bsaMutex );
 	
+	if ( mapped ) {
+		bsa.unmap( mapped );
+		mapped = nullptr;
+		mappedSize = 0;
+	}
+
 	bsa.close();
 	qDeleteAll( root->children );
 	qDeleteAll( root->files );
@@ -455,202 +604,253 @@ qint64 BSA::fileSize( const QString & fn ) const
 	return 0;
 }
 
+// see bsa.h
+QByteArray BSA::readData( quint64 offset, qint64 size )
+{
+	if ( mapped ) {
+		if ( offset + size > quint64( mappedSize ) )
+			return QByteArray();
+
+		// No lock and no copy; the view stays valid until the archive is closed
+		return QByteArray::fromRawData( reinterpret_cast<const char *>(mapped) + offset, int( size ) );
+	}
+
+	QMutexLocker lock( &bsaMutex );
+
+	QByteArray data;
+	if ( bsa.seek( offset ) ) {
+		data.resize( size );
+		if ( bsa.read( data.data(), size ) != size )
+			data.clear();
+	}
+
+	return data;
+}
+
 // see bsa.h
 bool BSA::fileContents( const QString & fn, QByteArray & content )
 {
-	//qDebug() << "entering fileContents for" << fn;
-	if ( const BSAFile * file = getFile( fn ) )
-	{
-		QMutexLocker lock( & bsaMutex );
-		if ( bsa.seek( file->offset ) )
-		{
-			qint64 filesz = file->size();
-			bool ok = true;
-			if (namePrefix) {
-				char len;
-				ok = bsa.read(&len, 1);
-				filesz -= len + 1;
-				if (ok) ok = bsa.seek( file->offset + 1 + len );
+	const BSAFile * file = getFile( fn );
+	if ( !file )
+		return false;
+
+	if ( file->tex.chunks.count() ) {
+		// Fill DDS Header
+		DDS_HEADER ddsHeader = {};
+		DDS_HEADER_DXT10 dx10Header = {};
+
+		bool dx10 = false;
+
+		ddsHeader.dwSize = sizeof( ddsHeader );
+		ddsHeader.dwHeaderFlags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_LINEARSIZE | DDS_HEADER_FLAGS_MIPMAP;
+		ddsHeader.dwHeight = file->tex.header.height;
+		ddsHeader.dwWidth = file->tex.header.width;
+		ddsHeader.dwMipMapCount = file->tex.header.numMips;
+		ddsHeader.ddspf.dwSize = sizeof( DDS_PIXELFORMAT );
+		ddsHeader.dwSurfaceFlags = DDS_SURFACE_FLAGS_TEXTURE | DDS_SURFACE_FLAGS_MIPMAP;
+
+		if ( file->tex.header.unk16 == 2049 )
+			ddsHeader.dwCubemapFlags = DDS_CUBEMAP_ALLFACES;
+
+		bool supported = true;
+
+		switch ( file->tex.header.format ) {
+		case DXGI_FORMAT_BC1_UNORM:
+			ddsHeader.ddspf.dwFlags = DDS_FOURCC;
+			ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', 'T', '1' );
+			ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height / 2;	// 4bpp
+			break;
+
+		case DXGI_FORMAT_BC2_UNORM:
+			ddsHeader.ddspf.dwFlags = DDS_FOURCC;
+			ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', 'T', '3' );
+			ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
+			break;
+
+		case DXGI_FORMAT_BC3_UNORM:
+			ddsHeader.ddspf.dwFlags = DDS_FOURCC;
+			ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', 'T', '5' );
+			ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
+			break;
+
+		case DXGI_FORMAT_BC5_UNORM:
+			ddsHeader.ddspf.dwFlags = DDS_FOURCC;
+			ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'A', 'T', 'I', '2' );
+			ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
+			break;
+
+		case DXGI_FORMAT_B8G8R8A8_UNORM:
+			ddsHeader.ddspf.dwFlags = DDS_RGBA;
+			ddsHeader.ddspf.dwRGBBitCount = 32;
+			ddsHeader.ddspf.dwRBitMask = 0x00FF0000;
+			ddsHeader.ddspf.dwGBitMask = 0x0000FF00;
+			ddsHeader.ddspf.dwBBitMask = 0x000000FF;
+			ddsHeader.ddspf.dwABitMask = 0xFF000000;
+			ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height * 4;	// 32bpp
+			break;
+
+		case DXGI_FORMAT_R8_UNORM:
+			ddsHeader.ddspf.dwFlags = DDS_RGB;
+			ddsHeader.ddspf.dwRGBBitCount = 8;
+			ddsHeader.ddspf.dwRBitMask = 0xFF;
+			ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
+			break;
+
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC2_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			ddsHeader.ddspf.dwFlags = DDS_FOURCC;
+			ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', '1', '0' );
+			ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;
+
+			dx10 = true;
+			dx10Header.dxgiFormat = DXGI_FORMAT( file->tex.header.format );
+			break;
+
+		default:
+			supported = false;
+			break;
+		}
+
+		if ( !supported )
+			return false;
+
+		if ( dx10 ) {
+			dx10Header.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+			dx10Header.miscFlag = 0;
+			dx10Header.arraySize = 1;
+			dx10Header.miscFlags2 = 0;
+		}
+
+		int hdrSize = 4 + sizeof( ddsHeader ) + (dx10 ? sizeof( dx10Header ) : 0);
+
+		// Lay out every chunk's slice of the output up front
+		int numChunks = file->tex.chunks.count();
+		QVector<qint64> chunkOffsets( numChunks );
+
+		qint64 texSize = 0;
+		for ( int i = 0; i < numChunks; i++ ) {
+			chunkOffsets[i] = hdrSize + texSize;
+			texSize += file->tex.chunks.at( i ).unpackedSize;
+		}
+
+		content.resize( hdrSize + texSize );
+
+		// Write the headers in place
+		char * out = content.data();
+		memcpy( out, "DDS ", 4 );
+		memcpy( out + 4, &ddsHeader, sizeof( ddsHeader ) );
+		if ( dx10 )
+			memcpy( out + 4 + sizeof( ddsHeader ), &dx10Header, sizeof( dx10Header ) );
+
+		// Each chunk is inflated straight into its own slice, so chunks are independent
+		QAtomicInt failed;
+		auto inflateChunk = [this, file, out, &chunkOffsets, &failed]( int i ) {
+			const F4TexChunk & chunk = file->tex.chunks.at( i );
+			char * dst = out + chunkOffsets.at( i );
+
+			qint64 readSize = (chunk.packedSize > 0) ? chunk.packedSize : chunk.unpackedSize;
+			QByteArray chunkData = readData( chunk.offset, readSize );
+			if ( chunkData.size() != readSize ) {
+				qCritical() << "Read error at " << chunk.offset;
+				failed.storeRelease( 1 );
+				return;
 			}
 
-			quint32 filesize = filesz;
-			if ( version == SSE_BSAHEADER_VERSION && file->sizeFlags > 0 && (file->compressed() ^ compressToggle) ) {
-				ok = bsa.read( (char*)&filesize, 4 );
-				filesz -= 4;
+			if ( chunk.packedSize == 0 ) {
+				memcpy( dst, chunkData.constData(), chunk.unpackedSize );
+			} else if ( Decompressor::zlib( chunkData.constData(), chunk.packedSize, dst, chunk.unpackedSize ) != chunk.unpackedSize ) {
+				qCritical() << "Size does not match at " << chunk.offset;
+				failed.storeRelease( 1 );
 			}
+		};
 
-			content.resize( filesz );
-			if ( ok && bsa.read( content.data(), filesz ) == filesz ) {
-				if ( file->sizeFlags > 0 && (file->compressed() ^ compressToggle) ) {
-					// BSA
-					if ( version != SSE_BSAHEADER_VERSION ) {
-						content.remove( 0, 4 );
-						QByteArray tmp3( content );
-
-						content = gUncompress( tmp3, filesz - 4 );
-					} else {
-						QByteArray tmp;
-						tmp.resize( filesize );
-
-						LZ4F_decompressionContext_t dCtx = nullptr;
-						LZ4F_createDecompressionContext( &dCtx, LZ4F_VERSION );
-						size_t dstSize = filesize;
-						size_t srcSize = content.size();
-
-						LZ4F_decompressOptions_t options = {};
-
-						LZ4F_decompress( dCtx, tmp.data(), &dstSize, content.data(), &srcSize, &options );
-						LZ4F_errorCode_t error = LZ4F_freeDecompressionContext( dCtx );
-						if ( error ) {
-							// TODO: Message logger
-							qDebug() << fn << "Error Code: " << error;
-						}
+		if ( numChunks > 1 && texSize >= BA2_PARALLEL_MIN_SIZE )
+			parallelFor( numChunks, inflateChunk );
+		else
+			for ( int i = 0; i < numChunks; i++ )
+				inflateChunk( i );
 
-						content = tmp;
-					}
-				} else if ( file->packedLength > 0 && !file->tex.chunks.count() ) {
-					// General BA2
-					QByteArray tmp( content );
-					content.resize( file->unpackedLength );
-					content = gUncompress( tmp, file->packedLength );
-				} else if ( file->tex.chunks.count() ) {
-					// Fill DDS Header
-					DDS_HEADER ddsHeader = {};
-					DDS_HEADER_DXT10 dx10Header = {};
-
-					bool dx10 = false;
-
-					ddsHeader.dwSize = sizeof( ddsHeader );
-					ddsHeader.dwHeaderFlags = DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_LINEARSIZE | DDS_HEADER_FLAGS_MIPMAP;
-					ddsHeader.dwHeight = file->tex.header.height;
-					ddsHeader.dwWidth = file->tex.header.width;
-					ddsHeader.dwMipMapCount = file->tex.header.numMips;
-					ddsHeader.ddspf.dwSize = sizeof( DDS_PIXELFORMAT );
-					ddsHeader.dwSurfaceFlags = DDS_SURFACE_FLAGS_TEXTURE | DDS_SURFACE_FLAGS_MIPMAP;
-
-					if ( file->tex.header.unk16 == 2049 )
-						ddsHeader.dwCubemapFlags = DDS_CUBEMAP_ALLFACES;
-
-					bool supported = true;
-
-					switch ( file->tex.header.format ) {
-					case DXGI_FORMAT_BC1_UNORM:
-						ddsHeader.ddspf.dwFlags = DDS_FOURCC;
-						ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', 'T', '1' );
-						ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height / 2;	// 4bpp
-						break;
-
-					case DXGI_FORMAT_BC2_UNORM:
-						ddsHeader.ddspf.dwFlags = DDS_FOURCC;
-						ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', 'T', '3' );
-						ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
-						break;
-
-					case DXGI_FORMAT_BC3_UNORM:
-						ddsHeader.ddspf.dwFlags = DDS_FOURCC;
-						ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', 'T', '5' );
-						ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
-						break;
-
-					case DXGI_FORMAT_BC5_UNORM:
-						ddsHeader.ddspf.dwFlags = DDS_FOURCC;
-						ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'A', 'T', 'I', '2' );
-						ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
-						break;
-
-					case DXGI_FORMAT_B8G8R8A8_UNORM:
-						ddsHeader.ddspf.dwFlags = DDS_RGBA;
-						ddsHeader.ddspf.dwRGBBitCount = 32;
-						ddsHeader.ddspf.dwRBitMask = 0x00FF0000;
-						ddsHeader.ddspf.dwGBitMask = 0x0000FF00;
-						ddsHeader.ddspf.dwBBitMask = 0x000000FF;
-						ddsHeader.ddspf.dwABitMask = 0xFF000000;
-						ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height * 4;	// 32bpp
-						break;
-
-					case DXGI_FORMAT_R8_UNORM:
-						ddsHeader.ddspf.dwFlags = DDS_RGB;
-						ddsHeader.ddspf.dwRGBBitCount = 8;
-						ddsHeader.ddspf.dwRBitMask = 0xFF;
-						ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;	// 8bpp
-						break;
-
-					case DXGI_FORMAT_BC7_UNORM:
-					case DXGI_FORMAT_BC1_UNORM_SRGB:
-					case DXGI_FORMAT_BC2_UNORM_SRGB:
-					case DXGI_FORMAT_BC3_UNORM_SRGB:
-					case DXGI_FORMAT_BC7_UNORM_SRGB:
-						ddsHeader.ddspf.dwFlags = DDS_FOURCC;
-						ddsHeader.ddspf.dwFourCC = MAKEFOURCC( 'D', 'X', '1', '0' );
-						ddsHeader.dwPitchOrLinearSize = file->tex.header.width * file->tex.header.height;
-
-						dx10 = true;
-						dx10Header.dxgiFormat = DXGI_FORMAT( file->tex.header.format );
-						break;
-
-					default:
-						supported = false;
-						break;
-					}
+		// Never hand out a texture with slices that were not filled
+		if ( failed.loadAcquire() ) {
+			content.clear();
+			return false;
+		}
 
-					if ( !supported )
-						return false;
+		return true;
+	}
 
-					char dds[sizeof( ddsHeader )];
-					memcpy( dds, &ddsHeader, sizeof( ddsHeader ) );
+	quint64 offset = file->offset;
+	qint64 filesz = file->size();
 
-					int texSize = 0; // = file->unpackedLength;
-					int hdrSize = sizeof( ddsHeader ) + 4;
+	if ( namePrefix ) {
+		QByteArray len = readData( offset, 1 );
+		if ( len.size() != 1 )
+			return false;
 
-					content.clear();
-					content.append( QByteArray::fromStdString( "DDS " ) );
-					content.append( QByteArray::fromRawData( dds, sizeof( ddsHeader ) ) );
-					Q_ASSERT( content.size() == hdrSize );
+		offset += 1 + quint8( len.at( 0 ) );
+		filesz -= 1 + quint8( len.at( 0 ) );
+	}
 
-					if ( dx10 ) {
-						dx10Header.resourceDimension = DDS_DIMENSION_TEXTURE2D;
-						dx10Header.miscFlag = 0;
-						dx10Header.arraySize = 1;
-						dx10Header.miscFlags2 = 0;
+	bool compressed = file->sizeFlags > 0 && (file->compressed() ^ compressToggle);
 
-						char dds2[sizeof( dx10Header )];
-						memcpy( dds2, &dx10Header, sizeof( dx10Header ) );
-						content.append( QByteArray::fromRawData( dds2, sizeof( dx10Header ) ) );
-					}
+	quint32 filesize = filesz;
+	if ( version == SSE_BSAHEADER_VERSION && compressed ) {
+		QByteArray orig = readData( offset, 4 );
+		if ( orig.size() != 4 )
+			return false;
 
-					// Start at 1st chunk now
-					for ( int i = 0; i < file->tex.chunks.count(); i++ ) {
-						F4TexChunk chunk = file->tex.chunks[i];
-						if ( bsa.seek( chunk.offset ) ) {
-							QByteArray chunkData;
-
-							if ( chunk.packedSize > 0 ) {
-								chunkData.resize( chunk.packedSize );
-								if ( bsa.read( chunkData.data(), chunk.packedSize ) == chunk.packedSize ) {
-									chunkData = gUncompress( chunkData, chunk.packedSize );
-
-									if ( chunkData.size() != chunk.unpackedSize )
-										qCritical() << "Size does not match at " << chunk.offset;
-								}
-							} else if ( !(bsa.read( chunkData.data(), chunk.unpackedSize ) == chunk.unpackedSize) ) {
-								qCritical() << "Size does not match at " << chunk.offset;
-							}
-							texSize += chunk.unpackedSize;
-
-							content.append( chunkData );
-							//Q_ASSERT( content.size() - hdrSize == texSize );
-						} else {
-							qCritical() << "Seek error";
-						}
-					}
+		memcpy( &filesize, orig.constData(), 4 );
+		offset += 4;
+		filesz -= 4;
+	}
 
-				}
+	QByteArray data = readData( offset, filesz );
+	if ( data.size() != filesz )
+		return false;
+
+	// Decompression reads straight from the view, outside of any lock
+	if ( compressed ) {
+		// BSA
+		if ( version != SSE_BSAHEADER_VERSION ) {
+			if ( filesz < 4 )
+				return false;
+
+			// The uncompressed size precedes the zlib stream
+			memcpy( &filesize, data.constData(), 4 );
+			content.resize( filesize );
 
-				return true;
+			if ( Decompressor::zlib( data.constData() + 4, filesz - 4, content.data(), filesize ) != filesize ) {
+				content.clear();
+				return false;
+			}
+		} else {
+			content.resize( filesize );
+
+			if ( Decompressor::lz4( data.constData(), filesz, content.data(), filesize ) != filesize ) {
+				// TODO: Message logger
+				qDebug() << fn << "LZ4 decompression failed";
+				content.clear();
+				return false;
 			}
 		}
+	} else if ( file->packedLength > 0 ) {
+		// General BA2
+		content.resize( file->unpackedLength );
+
+		if ( Decompressor::zlib( data.constData(), file->packedLength, content.data(), file->unpackedLength ) != file->unpackedLength ) {
+			content.clear();
+			return false;
+		}
+	} else {
+		// Uncompressed; take a private copy of the mapped bytes
+		content = data;
+		content.detach();
 	}
-	return false;
+
+	return true;
 }
 
 // see bsa.h
@@ -759,146 +959,418 @@ QDateTime BSA::fileTime( const QString & ) const
 	return bsaInfo.created( );
 }
 
-bool BSA::scan( const BSA::BSAFolder * folder, QStandardItem * item, QString path )
+//! Formats a file size for the archive browser
+static QString sizeString( quint32 bytes )
 {
-	if ( !folder || folder->children.count() == 0 )
-		return false;
+	return (bytes > 1024) ? QString::number( bytes / 1024 ) + "KB" : QString::number( bytes ) + "B";
+}
 
-	auto& children = folder->children;
-	QHash<QString, BSAFolder *>::const_iterator i;
-	for ( i = children.begin(); i != children.end(); ++i ) {
-		auto f = i.value()->files;
-		auto c = i.value()->children;
-		if ( !f.count() && !c.count() )
-			continue;
 
-		auto folderItem = new QStandardItem( i.key() );
-		auto pathDummy = new QStandardItem( "" );
-		auto sizeDummy = new QStandardItem( "" );
+//! A folder or file row of a BSAModel
+struct BSAModel::Node
+{
+	Node * parent = nullptr;
+	int row = 0;
 
-		item->appendRow( { folderItem, pathDummy, sizeDummy } );
+	const BSA::BSAFolder * folder = nullptr;
+	const BSA::BSAFile * file = nullptr;
 
-		// Recurse through folders
-		if ( c.count() ) {
-			QString fullpath = ((path.isEmpty()) ? path : path % "/") % i.key();
-			scan( i.value(), folderItem, fullpath );
-		}
+	QString name;
+	//! Path inside the archive, e.g. "meshes/clutter/bucket.nif"
+	QString path;
 
-		// List files
-		if ( f.count() ) {
-			QHash<QString, BSAFile *>::const_iterator it;
-			for ( it = f.begin(); it != f.end(); ++it ) {
-				QString fullpath = path % "/" % i.key() % "/" % it.key();
+	bool populated = false;
+	std::vector<std::unique_ptr<Node>> children;
+};
 
-				int bytes = it.value()->size();
-				QString filesize = (bytes > 1024) ? QString::number( bytes / 1024 ) + "KB" : QString::number( bytes ) + "B";
 
-				auto fileItem = new QStandardItem( it.key() );
-				auto pathItem = new QStandardItem( fullpath );
-				auto sizeItem = new QStandardItem( filesize );
+//! Matches the filter against the path index
+class BSAModel::FilterThread final : public QThread
+{
+public:
+	FilterThread( QObject * parent ) : QThread( parent ) {}
+
+	// Input
+	std::shared_ptr<FSArchiveHandler> archive;
+	const BSA::BSAFolder * root = nullptr;
+	std::shared_ptr<const QVector<BSAPathEntry>> pathIndex;
+	QStringList filetypes;
+	QString text;
+	bool nameOnly = false;
+	int generation = 0;
+
+	// Output
+	QSet<const void *> visible;
+
+protected:
+	void run() override
+	{
+		if ( !pathIndex ) {
+			auto entries = std::make_shared<QVector<BSAPathEntry>>();
+			index( root, root->name.toLower(), *entries );
+			pathIndex = entries;
+		}
 
-				folderItem->appendRow( { fileItem, pathItem, sizeItem } );
+		QRegExp rx( text, Qt::CaseInsensitive, QRegExp::Wildcard );
+
+		for ( const BSAPathEntry & e : *pathIndex ) {
+			if ( isInterruptionRequested() )
+				return;
+
+			bool typeMatch = filetypes.isEmpty();
+			for ( const QString & t : filetypes ) {
+				if ( e.path.endsWith( t ) ) {
+					typeMatch = true;
+					break;
+				}
 			}
+
+			if ( !typeMatch || (!text.isEmpty() && rx.indexIn( nameOnly ? e.name : e.path ) < 0) )
+				continue;
+
+			visible.insert( e.file );
+
+			// Folders containing a match are shown too
+			for ( const BSA::BSAFolder * f = e.folder; f && !visible.contains( f ); f = f->parent )
+				visible.insert( f );
 		}
 	}
 
-	return true;
+	static void index( const BSA::BSAFolder * folder, const QString & path, QVector<BSAPathEntry> & entries )
+	{
+		for ( auto it = folder->files.cbegin(); it != folder->files.cend(); ++it ) {
+			QString name = it.key().toLower();
+			entries.append( { path + "/" + name, name, it.value(), folder } );
+		}
+
+		for ( auto it = folder->children.cbegin(); it != folder->children.cend(); ++it )
+			index( it.value(), path + "/" + it.key().toLower(), entries );
+	}
+};
+
+
+BSAModel::BSAModel( QObject * parent )
+	: QAbstractItemModel( parent )
+{
 }
 
-bool BSA::fillModel( BSAModel * bsaModel, const QString & folder )
+BSAModel::~BSAModel()
 {
-	return scan( getFolder( folder ), bsaModel->invisibleRootItem(), folder );
+	// Filter threads read the archive and must stop before it is released
+	for ( auto thread : findChildren<QThread *>() ) {
+		thread->requestInterruption();
+		thread->wait();
+	}
 }
 
+void BSAModel::setArchive( std::shared_ptr<FSArchiveHandler> handler, const QString & folder )
+{
+	beginResetModel();
 
-BSAModel::BSAModel( QObject * parent )
-	: QStandardItemModel( parent )
+	archive = handler;
+	pathIndex.reset();
+	visible.clear();
+	patternFiltered = false;
+	typeFolders.clear();
+
+	root.reset( new Node );
+	root->folder = archive->getArchive<BSA *>()->getFolder( folder.toLower() );
+	root->path = folder;
+
+	endResetModel();
+
+	startFilter();
+}
+
+void BSAModel::clear()
 {
+	beginResetModel();
+
+	generation++;
+	root.reset();
+	pathIndex.reset();
+	visible.clear();
+	patternFiltered = false;
+	typeFolders.clear();
+	archive.reset();
 
+	endResetModel();
 }
 
-void BSAModel::init()
+void BSAModel::setFiletypes( const QStringList & types )
 {
-	setColumnCount( 3 );
-	setHorizontalHeaderLabels( { "File", "Path", "Size" } );
+	filetypes = types;
+	typeFolders.clear();
 }
 
-Qt::ItemFlags BSAModel::flags( const QModelIndex & index ) const
+void BSAModel::setFilter( const QString & text )
 {
-	return QStandardItemModel::flags( index ) ^ Qt::ItemIsEditable;
+	filterText = text;
+	startFilter();
 }
 
+void BSAModel::setFilterByNameOnly( bool nameOnly )
+{
+	filterByNameOnly = nameOnly;
+	startFilter();
+}
 
-BSAProxyModel::BSAProxyModel( QObject * parent )
-	: QSortFilterProxyModel( parent )
+void BSAModel::startFilter()
 {
+	if ( !root || !root->folder )
+		return;
+
+	// Superseded threads are abandoned rather than waited on
+	for ( auto old : findChildren<QThread *>() )
+		old->requestInterruption();
+
+	// Without a pattern nothing needs indexing; rows check the file types as they are created
+	if ( filterText.isEmpty() ) {
+		++generation;
+
+		beginResetModel();
+
+		visible.clear();
+		patternFiltered = false;
+		typeFolders.clear();
+		root->children.clear();
+		root->populated = false;
 
+		endResetModel();
+
+		emit filterApplied( false );
+		return;
+	}
+
+	auto thread = new FilterThread( this );
+	thread->archive = archive;
+	thread->root = root->folder;
+	thread->pathIndex = pathIndex;
+	thread->filetypes = filetypes;
+	thread->text = filterText;
+	thread->nameOnly = filterByNameOnly;
+	thread->generation = ++generation;
+
+	connect( thread, &QThread::finished, this, [this, thread]() {
+		applyFilter( thread );
+		thread->deleteLater();
+	} );
+
+	thread->start();
 }
 
-void BSAProxyModel::setFiletypes( QStringList types )
+void BSAModel::applyFilter( FilterThread * thread )
 {
-	filetypes = types;
+	if ( !pathIndex && thread->pathIndex && thread->archive == archive )
+		pathIndex = thread->pathIndex;
+
+	if ( thread->generation != generation || thread->isInterruptionRequested() )
+		return;
+
+	beginResetModel();
+
+	visible.swap( thread->visible );
+	patternFiltered = true;
+	root->children.clear();
+	root->populated = false;
+
+	endResetModel();
+
+	emit filterApplied( !filterText.isEmpty() );
 }
 
-void BSAProxyModel::setFilterByNameOnly( bool nameOnly )
+bool BSAModel::isVisible( const BSA::BSAFolder * folder ) const
 {
-	filterByNameOnly = nameOnly;
+	if ( patternFiltered )
+		return visible.contains( folder );
+
+	if ( filetypes.isEmpty() )
+		return true;
+
+	auto it = typeFolders.constFind( folder );
+	if ( it != typeFolders.constEnd() )
+		return it.value();
 
-	setFilterRegExp( filterRegExp() );
+	// Stops at the first file of the types, so only folders without any are walked fully
+	bool found = false;
+	for ( auto f = folder->files.cbegin(); f != folder->files.cend() && !found; ++f )
+		found = isVisible( f.key(), f.value() );
+
+	for ( auto c = folder->children.cbegin(); c != folder->children.cend() && !found; ++c )
+		found = isVisible( c.value() );
+
+	typeFolders.insert( folder, found );
+	return found;
 }
 
-void BSAProxyModel::resetFilter()
+bool BSAModel::isVisible( const QString & name, const BSA::BSAFile * file ) const
 {
-	setFilterRegExp( QRegExp( "*", Qt::CaseInsensitive, QRegExp::Wildcard ) );
+	if ( patternFiltered )
+		return visible.contains( file );
+
+	for ( const QString & t : filetypes ) {
+		if ( name.endsWith( t, Qt::CaseInsensitive ) )
+			return true;
+	}
+
+	return filetypes.isEmpty();
 }
 
-bool BSAProxyModel::filterAcceptsRow( int sourceRow, const QModelIndex & sourceParent ) const
+BSAModel::Node * BSAModel::node( const QModelIndex & index ) const
 {
-	if ( !filterRegExp().isEmpty() ) {
-		
-		QModelIndex sourceIndex0 = sourceModel()->index( sourceRow, 0, sourceParent );
-		QModelIndex sourceIndex1 = sourceModel()->index( sourceRow, 1, sourceParent );
-		if ( sourceIndex0.isValid() ) {
-			// If children match, parent matches
-			int c = sourceModel()->rowCount( sourceIndex0 );
-			for ( int i = 0; i < c; ++i ) {
-				if ( filterAcceptsRow( i, sourceIndex0 ) )
-					return true;
-			}
+	if ( index.isValid() )
+		return static_cast<Node *>(index.internalPointer());
 
-			QString key0 = sourceModel()->data( sourceIndex0, filterRole() ).toString();
-			QString key1 = sourceModel()->data( sourceIndex1, filterRole() ).toString();
-			
-			bool typeMatch = true;
-			if ( filetypes.count() ) {
-				typeMatch = false;
-				for ( auto f : filetypes ) {
-					typeMatch |= key1.endsWith( f );
-				}
-			}
+	return root.get();
+}
 
-			bool stringMatch = (filterByNameOnly) ? key0.contains( filterRegExp() ) : key1.contains( filterRegExp() );
+void BSAModel::populate( Node * parent ) const
+{
+	if ( parent->populated || !parent->folder )
+		return;
 
-			return typeMatch && stringMatch;
-		}
+	parent->populated = true;
+
+	auto lessThan = []( const std::unique_ptr<Node> & a, const std::unique_ptr<Node> & b ) {
+		return a->name.compare( b->name, Qt::CaseInsensitive ) < 0;
+	};
+
+	auto childPath = [parent]( const QString & name ) {
+		return parent->path.isEmpty() ? name : parent->path + "/" + name;
+	};
+
+	// Folders first, then files, each sorted by name
+	std::vector<std::unique_ptr<Node>> folders, files;
+
+	for ( auto it = parent->folder->children.cbegin(); it != parent->folder->children.cend(); ++it ) {
+		if ( !isVisible( it.value() ) )
+			continue;
+
+		std::unique_ptr<Node> n( new Node );
+		n->folder = it.value();
+		n->name = it.key();
+		n->path = childPath( it.key() );
+		folders.push_back( std::move( n ) );
+	}
+
+	for ( auto it = parent->folder->files.cbegin(); it != parent->folder->files.cend(); ++it ) {
+		if ( !isVisible( it.key(), it.value() ) )
+			continue;
+
+		std::unique_ptr<Node> n( new Node );
+		n->file = it.value();
+		n->name = it.key();
+		n->path = childPath( it.key() );
+		files.push_back( std::move( n ) );
 	}
 
-	return QSortFilterProxyModel::filterAcceptsRow( sourceRow, sourceParent );
+	std::sort( folders.begin(), folders.end(), lessThan );
+	std::sort( files.begin(), files.end(), lessThan );
+
+	parent->children = std::move( folders );
+	for ( auto & n : files )
+		parent->children.push_back( std::move( n ) );
+
+	for ( size_t i = 0; i < parent->children.size(); i++ ) {
+		parent->children[i]->parent = parent;
+		parent->children[i]->row = int( i );
+	}
+}
+
+QModelIndex BSAModel::index( int row, int column, const QModelIndex & parent ) const
+{
+	Node * p = node( parent );
+	if ( !p || column < 0 || column >= 3 )
+		return QModelIndex();
+
+	populate( p );
+
+	if ( row < 0 || row >= int( p->children.size() ) )
+		return QModelIndex();
+
+	return createIndex( row, column, p->children[row].get() );
+}
+
+QModelIndex BSAModel::parent( const QModelIndex & index ) const
+{
+	if ( !index.isValid() )
+		return QModelIndex();
+
+	Node * p = static_cast<Node *>(index.internalPointer())->parent;
+	if ( !p || p == root.get() )
+		return QModelIndex();
+
+	return createIndex( p->row, 0, p );
 }
 
-bool BSAProxyModel::lessThan( const QModelIndex & left, const QModelIndex & right ) const
+int BSAModel::rowCount( const QModelIndex & parent ) const
 {
-	QString leftString = sourceModel()->data( left ).toString();
-	QString rightString = sourceModel()->data( right ).toString();
+	if ( parent.column() > 0 )
+		return 0;
 
-	QModelIndex leftChild = left.child( 0, 0 );
-	QModelIndex rightChild = right.child( 0, 0 );
+	Node * p = node( parent );
+	if ( !p )
+		return 0;
 
-	if ( !leftChild.isValid() && rightChild.isValid() )
+	populate( p );
+	return int( p->children.size() );
+}
+
+int BSAModel::columnCount( const QModelIndex & ) const
+{
+	return 3;
+}
+
+bool BSAModel::hasChildren( const QModelIndex & parent ) const
+{
+	if ( parent.column() > 0 )
 		return false;
 
-	if ( leftChild.isValid() && !rightChild.isValid() )
-		return true;
+	// Answer without populating so that collapsed folders stay cheap
+	Node * p = node( parent );
+	return p && p->folder && (p == root.get() || isVisible( p->folder ));
+}
+
+QVariant BSAModel::data( const QModelIndex & index, int role ) const
+{
+	if ( !index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole) )
+		return QVariant();
+
+	Node * n = node( index );
+
+	switch ( index.column() ) {
+	case 0:
+		return n->name;
+	case 1:
+		return n->file ? n->path : QString();
+	case 2:
+		return n->file ? sizeString( n->file->size() ) : QString();
+	}
+
+	return QVariant();
+}
+
+QVariant BSAModel::headerData( int section, Qt::Orientation orientation, int role ) const
+{
+	if ( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+		return QVariant();
+
+	switch ( section ) {
+	case 0:
+		return tr( "File" );
+	case 1:
+		return tr( "Path" );
+	case 2:
+		return tr( "Size" );
+	}
+
+	return QVariant();
+}
+
+Qt::ItemFlags BSAModel::flags( const QModelIndex & index ) const
+{
+	if ( !index.isValid() )
+		return Qt::NoItemFlags;
 
-	return leftString < rightString;
+	return Qt::ItemIsSelectable | Qt::ItemIsEnabled;
 }
@@ -35,8 +35,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "fsengine.h"
 
-#include <QStandardItemModel>
-#include <QSortFilterProxyModel>
+#include <QAbstractItemModel>
 
 #include <QDebug>
 #include <QDir>
@@ -44,8 +43,11 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QFileInfo>
 #include <QHash>
 #include <QMutex>
+#include <QSet>
+#include <QVector>
 
 #include <memory>
+#include <vector>
 
 using namespace std;
 
@@ -85,6 +87,7 @@ using namespace std;
 
 /* Record flags */
 #define OB_BSAFILE_FLAG_COMPRESS 0xC0000000 //!< Bit mask with OBBSAFileInfo::sizeFlags to get the compression status
+#define OB_BSAFILE_FLAG_TOGGLE   0x40000000 //!< Set in OBBSAFileInfo::sizeFlags if the file is not compressed as the archive flags say
 
 //! \file bsa.cpp OBBSAHeader / \link OBBSAFileInfo FileInfo\endlink / \link OBBSAFolderInfo FolderInfo\endlink; MWBSAHeader, MWBSAFileSizeOffset
 
@@ -220,9 +223,6 @@ struct F4Tex
 };
 
 
-class BSAModel;
-class BSAProxyModel;
-
 //! \file bsa.h BSA file, BSAIterator
 
 //! A Bethesda Software Archive file
@@ -245,6 +245,9 @@ public:
 	bool open() override final;
 	//! Closes the %BSA file
 	void close() override final;
+
+	//! Whether open() restores and saves the directory cache; on by default
+	void setDirectoryCache( bool enable ) { useCache = enable; }
 	
 	//! Returns BSA::bsaPath.
 	QString path() const override final { return bsaPath; }
@@ -329,12 +332,21 @@ public:
 	const BSAFolder * getFolder( QString fn ) const;
 	//! Gets the specified file, or null if not found
 	const BSAFile * getFile( QString fn ) const;
-
-	bool scan( const BSA::BSAFolder *, QStandardItem *, QString );
-	bool fillModel( BSAModel *, const QString & );
+	//! Returns the lowercase paths of all files in the %BSA
+	QStringList fileList() const override final { return files.keys(); }
 
 protected:
+	//! Restores the folder and file tables from the directory cache if the %BSA is unchanged
+	bool readCache();
+	//! Saves the folder and file tables to the directory cache
+	void writeCache() const;
+
+	//! Returns size bytes from the given offset, as a view into the mapped %BSA if possible
+	QByteArray readData( quint64 offset, qint64 size );
 	
+	//! Whether the directory cache is used
+	bool useCache = true;
+
 	//! The %BSA file
 	QFile bsa;
 	//! File info for the %BSA
@@ -342,8 +354,13 @@ protected:
 
 	quint32 version = 0;
 
-	//! Mutual exclusion handler
+	//! Mutual exclusion handler; guards the QFile when the %BSA could not be mapped
 	QMutex bsaMutex;
+
+	//! The %BSA file mapped into memory, or null if mapping failed
+	uchar * mapped = nullptr;
+	//! The size of the mapping
+	qint64 mappedSize = 0;
 	
 	//! The absolute name of the file, e.g. "d:/temp/test.bsa"
 	QString bsaPath;
@@ -373,40 +390,88 @@ protected:
 };
 
 
-class BSAModel : public QStandardItemModel
+//! Lowercase path of a file below the root folder of a BSAModel
+struct BSAPathEntry
 {
-	Q_OBJECT
-
-public:
-	BSAModel( QObject * parent = nullptr );
-
-	void init();
-
-	Qt::ItemFlags flags( const QModelIndex & index ) const override;
+	QString path;
+	QString name;
+	const BSA::BSAFile * file;
+	const BSA::BSAFolder * folder;
 };
 
-
-class BSAProxyModel : public QSortFilterProxyModel
+//! Browses a folder of a %BSA without copying its tree.
+/*!
+ * Rows are created from the %BSA folder tree only when a folder is expanded. Without a
+ * pattern the file types are checked per folder as its rows are created. A pattern is
+ * matched against a lowercase path index, built on first use, on a background thread
+ * which resets the model with the set of visible folders and files when done.
+ */
+class BSAModel : public QAbstractItemModel
 {
 	Q_OBJECT
 
 public:
-	BSAProxyModel( QObject * parent = nullptr );
-
-	void setFiletypes( QStringList types );
-
-	void resetFilter();
+	BSAModel( QObject * parent = nullptr );
+	~BSAModel();
+
+	//! Shows a folder of an archive; the model keeps the archive open
+	void setArchive( std::shared_ptr<FSArchiveHandler> archive, const QString & folder );
+	//! Releases the archive
+	void clear();
+
+	//! Only show files ending in one of these lowercase suffixes
+	void setFiletypes( const QStringList & types );
+
+	QModelIndex index( int row, int column, const QModelIndex & parent = QModelIndex() ) const override;
+	QModelIndex parent( const QModelIndex & index ) const override;
+	int rowCount( const QModelIndex & parent = QModelIndex() ) const override;
+	int columnCount( const QModelIndex & parent = QModelIndex() ) const override;
+	bool hasChildren( const QModelIndex & parent = QModelIndex() ) const override;
+	QVariant data( const QModelIndex & index, int role = Qt::DisplayRole ) const override;
+	QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const override;
+	Qt::ItemFlags flags( const QModelIndex & index ) const override;
 
 public slots:
+	//! Filters by a case insensitive wildcard pattern
+	void setFilter( const QString & text );
 	void setFilterByNameOnly( bool nameOnly );
 
+signals:
+	//! Emitted after a filter result is shown; filtered is false if there is no pattern
+	void filterApplied( bool filtered );
+
 protected:
-	bool filterAcceptsRow( int sourceRow, const QModelIndex & sourceParent ) const;
-	bool lessThan( const QModelIndex & left, const QModelIndex & right ) const;
+	struct Node;
+	class FilterThread;
+
+	Node * node( const QModelIndex & index ) const;
+	//! Creates the rows of a folder on first access
+	void populate( Node * node ) const;
+	//! Starts matching the current filter on a background thread
+	void startFilter();
+	//! Shows the result of a finished filter thread
+	void applyFilter( FilterThread * thread );
+	//! Whether a folder or file row is shown
+	bool isVisible( const BSA::BSAFolder * folder ) const;
+	bool isVisible( const QString & name, const BSA::BSAFile * file ) const;
+
+	std::shared_ptr<FSArchiveHandler> archive;
+	std::unique_ptr<Node> root;
+
+	//! Built by the first filter thread and shared by later ones
+	std::shared_ptr<const QVector<BSAPathEntry>> pathIndex;
+	//! Folders and files which pass the filter pattern
+	QSet<const void *> visible;
+	//! Whether visible holds the result of a pattern; otherwise only the file types apply
+	bool patternFiltered = false;
+	//! Folders known to contain files of the file types, filled as rows are created
+	mutable QHash<const BSA::BSAFolder *, bool> typeFolders;
 
-private:
 	QStringList filetypes;
+	QString filterText;
 	bool filterByNameOnly = false;
+	//! Incremented for every filter so that stale results are dropped
+	int generation = 0;
 };
 
 #endif
@@ -0,0 +1,360 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#include "bsa.h"
+#include "bsawriter.h"
+#include "dds.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+
+//! \file bsatest.cpp Multithreaded extraction benchmark and pack round trip for BSA and BA2 archives
+
+//! Extracts files from a shared archive until none are left
+class Extractor final : public QThread
+{
+public:
+	Extractor( BSA * bsa, const QStringList & files, QAtomicInt & next )
+		: bsa( bsa ), files( files ), next( next )
+	{
+	}
+
+	qint64 bytes = 0;
+	int failed = 0;
+
+protected:
+	void run() override
+	{
+		QByteArray data;
+
+		int i;
+		while ( (i = next.fetchAndAddRelaxed( 1 )) < files.count() ) {
+			if ( bsa->fileContents( files.at( i ), data ) )
+				bytes += data.size();
+			else
+				failed++;
+		}
+	}
+
+	BSA * bsa;
+	const QStringList & files;
+	QAtomicInt & next;
+};
+
+//! Fills dir with a small tree of compressible, incompressible and empty files
+static bool makeSources( const QString & dir )
+{
+	quint32 seed = 12345;
+
+	for ( int i = 0; i < 24; i++ ) {
+		QString folder = QString( "%1/meshes/set%2/sub%3" ).arg( dir ).arg( i % 3 ).arg( i % 2 );
+		if ( !QDir().mkpath( folder ) )
+			return false;
+
+		QByteArray data;
+		int size = (i % 8 == 0) ? 0 : (i * 7919) % 300000;
+		data.reserve( size );
+
+		for ( int b = 0; b < size; b++ ) {
+			seed = seed * 1664525 + 1013904223;
+			// Odd files are noise, even files repeat a short pattern
+			data.append( char( (i & 1) ? (seed >> 24) : (b % 61) ) );
+		}
+
+		QFile f( QString( "%1/File_%2.nif" ).arg( folder ).arg( i ) );
+		if ( !f.open( QIODevice::WriteOnly ) || f.write( data ) != data.size() )
+			return false;
+	}
+
+	return true;
+}
+
+//! A DDS texture written by makeTextures()
+struct TestTexture
+{
+	const char * name;
+	quint32 width, height, mips;
+	//! Bytes per 4x4 block, or per pixel if not block compressed
+	quint32 blockBytes;
+	bool blocks;
+	//! The DXGI format, for textures with the DX10 header
+	quint32 dxgiFormat;
+	quint32 pfFlags, fourCC, bits, r, g, b, a;
+	bool cubemap;
+};
+
+//! Fills dir with DDS textures in every format a BA2 DX10 archive is packed from
+static bool makeTextures( const QString & dir )
+{
+	const quint32 dxt1 = quint32( MAKEFOURCC( 'D', 'X', 'T', '1' ) );
+	const quint32 dxt3 = quint32( MAKEFOURCC( 'D', 'X', 'T', '3' ) );
+	const quint32 dxt5 = quint32( MAKEFOURCC( 'D', 'X', 'T', '5' ) );
+	const quint32 ati2 = quint32( MAKEFOURCC( 'A', 'T', 'I', '2' ) );
+	const quint32 dx10 = quint32( MAKEFOURCC( 'D', 'X', '1', '0' ) );
+
+	// The large mips are split into chunks of their own, the small ones share the last chunk
+	const TestTexture textures[] = {
+		{ "dxt1", 512, 512, 10, 8, true, 0, DDS_FOURCC, dxt1, 0, 0, 0, 0, 0, false },
+		{ "dxt3", 128, 256, 9, 16, true, 0, DDS_FOURCC, dxt3, 0, 0, 0, 0, 0, false },
+		{ "dxt5", 256, 256, 1, 16, true, 0, DDS_FOURCC, dxt5, 0, 0, 0, 0, 0, false },
+		{ "ati2", 256, 128, 9, 16, true, 0, DDS_FOURCC, ati2, 0, 0, 0, 0, 0, false },
+		{ "bgra", 100, 60, 7, 4, false, 0, DDS_RGBA, 0, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000, false },
+		{ "r8", 64, 64, 7, 1, false, 0, DDS_LUMINANCE, 0, 8, 0xFF, 0, 0, 0, false },
+		{ "cube", 64, 64, 7, 8, true, 0, DDS_FOURCC, dxt1, 0, 0, 0, 0, 0, true },
+		{ "bc7", 256, 128, 9, 16, true, DXGI_FORMAT_BC7_UNORM, DDS_FOURCC, dx10, 0, 0, 0, 0, 0, false },
+		{ "bc1srgb", 64, 64, 7, 8, true, DXGI_FORMAT_BC1_UNORM_SRGB, DDS_FOURCC, dx10, 0, 0, 0, 0, 0, false },
+		{ "bc3srgb", 128, 128, 8, 16, true, DXGI_FORMAT_BC3_UNORM_SRGB, DDS_FOURCC, dx10, 0, 0, 0, 0, 0, false },
+	};
+
+	QString folder = dir + "/textures/test";
+	if ( !QDir().mkpath( folder ) )
+		return false;
+
+	quint32 seed = 54321;
+
+	for ( const TestTexture & t : textures ) {
+		bool hasDX10 = ( t.fourCC == dx10 );
+
+		QByteArray data( hasDX10 ? 148 : 128, 0 );
+		auto field = [&data]( int offset, quint32 v ) {
+			memcpy( data.data() + offset, &v, 4 );
+		};
+
+		field( 0, DDS_MAGIC );
+		field( 4, 124 );
+		field( 8, DDS_HEADER_FLAGS_TEXTURE | DDS_HEADER_FLAGS_MIPMAP );
+		field( 12, t.height );
+		field( 16, t.width );
+		field( 28, t.mips );
+		field( 76, 32 );
+		field( 80, t.pfFlags );
+		field( 84, t.fourCC );
+		field( 88, t.bits );
+		field( 92, t.r );
+		field( 96, t.g );
+		field( 100, t.b );
+		field( 104, t.a );
+		field( 108, DDS_SURFACE_FLAGS_TEXTURE | DDS_SURFACE_FLAGS_MIPMAP );
+		field( 112, t.cubemap ? DDS_CUBEMAP_ALLFACES : 0 );
+
+		if ( hasDX10 ) {
+			field( 128, t.dxgiFormat );
+			field( 132, DDS_DIMENSION_TEXTURE2D );
+			field( 140, 1 );
+		}
+
+		for ( int face = 0; face < (t.cubemap ? 6 : 1); face++ ) {
+			for ( quint32 m = 0; m < t.mips; m++ ) {
+				quint32 w = qMax( 1u, t.width >> m ), h = qMax( 1u, t.height >> m );
+				int size = t.blocks ? qMax( 1u, (w + 3) / 4 ) * qMax( 1u, (h + 3) / 4 ) * t.blockBytes : w * h * t.blockBytes;
+
+				// Noise in the large mips, flat colour in the small ones
+				for ( int b = 0; b < size; b++ ) {
+					seed = seed * 1664525 + 1013904223;
+					data.append( char( (m < 2) ? (seed >> 24) : (b % 7) ) );
+				}
+			}
+		}
+
+		QFile f( QString( "%1/%2.dds" ).arg( folder ).arg( t.name ) );
+		if ( !f.open( QIODevice::WriteOnly ) || f.write( data ) != data.size() )
+			return false;
+	}
+
+	return true;
+}
+
+//! Packs a folder in every loose file format and reads each archive back
+static int roundTrip( QTextStream & out, const QString & source )
+{
+	QTemporaryDir temp;
+	if ( !temp.isValid() ) {
+		out << "Could not create a temporary folder" << endl;
+		return 1;
+	}
+
+	QString dir = source;
+	if ( dir.isEmpty() ) {
+		dir = temp.path() + "/data";
+		if ( !makeSources( dir ) ) {
+			out << "Could not write the test files" << endl;
+			return 1;
+		}
+	}
+
+	// DX10 archives only take DDS files, so they get generated textures of their own
+	QString textureDir = temp.path() + "/dds";
+	if ( !makeTextures( textureDir ) ) {
+		out << "Could not write the test textures" << endl;
+		return 1;
+	}
+
+	struct Run
+	{
+		BSAWriter::Format format;
+		const char * name;
+		const char * suffix;
+		const QString & dir;
+	};
+
+	const Run runs[] = {
+		{ BSAWriter::BSA104, "BSA 104", ".bsa", dir },
+		{ BSAWriter::BSA105, "BSA 105", ".bsa", dir },
+		{ BSAWriter::BA2General, "BA2 GNRL", ".ba2", dir },
+		{ BSAWriter::BA2Textures, "BA2 DX10", ".ba2", textureDir },
+	};
+
+	int failed = 0;
+
+	for ( const Run & run : runs ) {
+		for ( bool compressed : { true, false } ) {
+			QString archive = QString( "%1/test_%2%3" ).arg( temp.path() ).arg( compressed ? "packed" : "stored" ).arg( run.suffix );
+
+			BSAWriter writer( run.format );
+			writer.setCompressed( compressed );
+
+			QElapsedTimer timer;
+			timer.start();
+
+			bool ok = writer.addDirectory( run.dir ) && writer.write( archive );
+			qint64 packMs = timer.restart();
+
+			ok = ok && writer.verify( archive );
+			qint64 verifyMs = timer.elapsed();
+
+			out << QString( "%1 %2: %3, pack %4 ms, verify %5 ms" )
+				.arg( run.name, -8 )
+				.arg( compressed ? "compressed" : "stored    " )
+				.arg( ok ? "ok" : "FAILED: " + writer.errorString() )
+				.arg( packMs )
+				.arg( verifyMs ) << endl;
+
+			if ( !ok )
+				failed++;
+
+			QFile::remove( archive );
+		}
+	}
+
+	return failed ? 1 : 0;
+}
+
+int main( int argc, char * argv[] )
+{
+	QCoreApplication app( argc, argv );
+	QTextStream out( stdout );
+
+	QStringList args = app.arguments();
+	if ( args.count() > 1 && args.at( 1 ) == "--roundtrip" )
+		return roundTrip( out, (args.count() > 2) ? args.at( 2 ) : QString() );
+
+	if ( args.count() < 2 ) {
+		out << "Usage: bsatest <archive> [max threads] [passes]" << endl;
+		out << "       bsatest --roundtrip [folder]" << endl;
+		return 1;
+	}
+
+	int maxThreads = (args.count() > 2) ? args.at( 2 ).toInt() : QThread::idealThreadCount();
+	int passes = (args.count() > 3) ? args.at( 3 ).toInt() : 3;
+
+	BSA bsa( args.at( 1 ) );
+	if ( !bsa.open() ) {
+		out << "Could not open " << args.at( 1 ) << ": " << bsa.statusText() << endl;
+		return 1;
+	}
+
+	QStringList files = bsa.fileList();
+	out << bsa.name() << ": " << files.count() << " files" << endl;
+
+	// Double the thread count each round so scaling is visible, ending with max threads
+	maxThreads = std::max( maxThreads, 1 );
+
+	QVector<int> counts;
+	for ( int threads = 1; threads < maxThreads; threads *= 2 )
+		counts << threads;
+	counts << maxThreads;
+
+	for ( int threads : counts ) {
+		double best = 0;
+		qint64 bytes = 0;
+		int failed = 0;
+
+		for ( int p = 0; p < passes; p++ ) {
+			QAtomicInt next( 0 );
+
+			std::vector<std::unique_ptr<Extractor>> workers;
+			for ( int t = 0; t < threads; t++ )
+				workers.emplace_back( new Extractor( &bsa, files, next ) );
+
+			QElapsedTimer timer;
+			timer.start();
+
+			for ( auto & w : workers )
+				w->start();
+			for ( auto & w : workers )
+				w->wait();
+
+			qint64 ms = std::max<qint64>( timer.elapsed(), 1 );
+
+			bytes = 0;
+			failed = 0;
+			for ( auto & w : workers ) {
+				bytes += w->bytes;
+				failed += w->failed;
+			}
+
+			best = std::max( best, (bytes / 1048576.0) / (ms / 1000.0) );
+		}
+
+		out << QString( "%1 thread(s): %2 MB extracted, %3 failed, %4 MB/s" )
+			.arg( threads, 3 )
+			.arg( bytes / 1048576.0, 0, 'f', 1 )
+			.arg( failed )
+			.arg( best, 0, 'f', 1 ) << endl;
+	}
+
+	return 0;
+}
@@ -2,14 +2,29 @@ TEMPLATE = app
 LANGUAGE = C++
 TARGET   = bsatest
 
-DEFINES += BSA_TEST
+# Multithreaded extraction benchmark:
+#   bsatest <archive> [max threads] [passes]
+# Reports the extraction rate in MB/s for 1, 2, 4 ... max threads.
+#
+# Pack round trip:
+#   bsatest --roundtrip [folder]
+# Packs the folder, or generated test files, in every loose file format with and
+# without compression, and generated DDS textures in the BA2 DX10 format. Reads
+# each archive back and compares it with the sources.
+# Exits with 1 if any archive does not match.
 
-CONFIG += qt release thread warn_on console
-LIBS += -lmingw32 -lqtmain
+DEFINES += BSA_TEST LZ4_STATIC XXH_PRIVATE_API
+
+CONFIG += qt release thread warn_on console c++11
+CONFIG -= app_bundle
+QT += widgets
 
 DESTDIR = ./
 
-HEADERS += *.h
-SOURCES += *.cpp
+INCLUDEPATH += ..
+
+HEADERS += bsa.h bsawriter.h decompressor.h entrycache.h fsengine.h
+SOURCES += bsa.cpp bsawriter.cpp decompressor.cpp entrycache.cpp fsengine.cpp bsatest.cpp ../lz4frame.c
+SOURCES += $$files(../zlib/*.c, false)
 
 # vim: set filetype=config : 
@@ -0,0 +1,974 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+
+#include "bsawriter.h"
+#include "dds.h"
+#include "zlib/zlib.h"
+#include "lz4frame.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QMutex>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+
+//! Entries packed ahead of the one being written, per worker thread
+#define PACK_WINDOW_PER_THREAD 4
+
+//! Mips at least this large get a BA2 chunk of their own; smaller mips share the last chunk
+#define BA2_MIP_CHUNK_SIZE (64 * 1024)
+//! Marker at the end of BA2 records
+#define BA2_RECORD_MARKER 0xBAADF00D
+//! Flags of a GNRL BA2 record
+#define BA2_GENERAL_FLAGS 0x00100100
+//! BA2 texture flags for a plain texture and a cubemap
+#define BA2_TEXTURE_FLAGS 0x0800
+#define BA2_CUBEMAP_FLAGS 0x0801
+
+//! Size of a DDS header without and with the DX10 extension, including the magic
+#define DDS_HEADER_SIZE 128
+#define DDS_DX10_HEADER_SIZE 148
+//! DDSCAPS2_CUBEMAP
+#define DDS_CUBEMAP 0x00000200
+
+
+//! An entry as it is written to the archive
+struct PackedEntry
+{
+	QByteArray data;          //!< Bytes written to the archive
+	quint32 size = 0;         //!< Unpacked size
+	bool compressed = false;  //!< Whether data holds compressed data
+	//! Chunks with offsets relative to data; BA2Textures only
+	QVector<F4TexChunk> chunks;
+	//! Set if the entry could not be packed
+	QString error;
+};
+
+//! Packs entries on a thread pool and hands them back in order.
+/*!
+ * At most a fixed number of entries per thread are packed ahead of the one being taken,
+ * which bounds the memory held by finished entries waiting to be written.
+ */
+class PackQueue final
+{
+public:
+	typedef std::function<void( int, PackedEntry & )> PackFunction;
+
+	PackQueue( int count, int threads, PackFunction pack )
+		: pack( pack ), results( count ), ready( count, false ), count( count )
+	{
+		pool.setMaxThreadCount( threads > 0 ? threads : QThread::idealThreadCount() );
+		window = pool.maxThreadCount() * PACK_WINDOW_PER_THREAD;
+	}
+
+	//! Waits for entries still being packed if the writer gave up early
+	~PackQueue() { pool.waitForDone(); }
+
+	//! Blocks until entry i is packed; entries must be taken in order
+	PackedEntry take( int i )
+	{
+		while ( next < count && next <= i + window )
+			pool.start( new Job( this, next++ ) );
+
+		QMutexLocker lock( &mutex );
+		while ( !ready[i] )
+			packed.wait( &mutex );
+
+		return std::move( results[i] );
+	}
+
+private:
+	class Job final : public QRunnable
+	{
+	public:
+		Job( PackQueue * queue, int index ) : queue( queue ), index( index ) {}
+
+		void run() override
+		{
+			PackedEntry entry;
+			queue->pack( index, entry );
+
+			QMutexLocker lock( &queue->mutex );
+			queue->results[index] = std::move( entry );
+			queue->ready[index] = true;
+			queue->packed.wakeAll();
+		}
+
+	private:
+		PackQueue * queue;
+		int index;
+	};
+
+	PackFunction pack;
+
+	QMutex mutex;
+	QWaitCondition packed;
+	std::vector<PackedEntry> results;
+	std::vector<bool> ready;
+
+	int count;
+	int next = 0;
+	int window = 0;
+
+	QThreadPool pool;
+};
+
+
+//! Compresses src as a zlib stream, or returns an empty array if it does not shrink
+static QByteArray zlibCompress( const char * src, qint64 size )
+{
+	uLongf len = compressBound( uLong( size ) );
+	QByteArray out( int( len ), Qt::Uninitialized );
+
+	if ( compress2( (Bytef *)out.data(), &len, (const Bytef *)src, uLong( size ), Z_DEFAULT_COMPRESSION ) != Z_OK )
+		return QByteArray();
+	if ( qint64( len ) >= size )
+		return QByteArray();
+
+	out.resize( int( len ) );
+	return out;
+}
+
+//! Compresses src as an LZ4 frame, or returns an empty array if it does not shrink
+static QByteArray lz4Compress( const char * src, qint64 size )
+{
+	LZ4F_preferences_t prefs = {};
+	prefs.frameInfo.contentSize = size;
+
+	size_t bound = LZ4F_compressFrameBound( size_t( size ), &prefs );
+	QByteArray out( int( bound ), Qt::Uninitialized );
+
+	size_t len = LZ4F_compressFrame( out.data(), bound, src, size_t( size ), &prefs );
+	if ( LZ4F_isError( len ) || qint64( len ) >= size )
+		return QByteArray();
+
+	out.resize( int( len ) );
+	return out;
+}
+
+//! Reads a loose file
+static bool readSource( const QString & path, QByteArray & data, QString & error )
+{
+	QFile f( path );
+	if ( !f.open( QIODevice::ReadOnly ) ) {
+		error = QString( "%1: %2" ).arg( path, f.errorString() );
+		return false;
+	}
+
+	data = f.readAll();
+	return true;
+}
+
+//! Hash of a lowercase name split into root and extension, as used by version 103-105 BSAs
+static quint64 tes4Hash( const QByteArray & root, const QByteArray & ext )
+{
+	const uchar * s = (const uchar *)root.constData();
+	int len = root.size();
+
+	quint32 hash1 = 0;
+	if ( len > 0 ) {
+		hash1 = quint32( s[len - 1] )
+			| quint32( len > 2 ? s[len - 2] : 0 ) << 8
+			| quint32( len ) << 16
+			| quint32( s[0] ) << 24;
+	}
+
+	if ( ext == ".kf" )
+		hash1 |= 0x80;
+	else if ( ext == ".nif" )
+		hash1 |= 0x8000;
+	else if ( ext == ".dds" )
+		hash1 |= 0x8080;
+	else if ( ext == ".wav" )
+		hash1 |= 0x80000000;
+
+	quint32 hash2 = 0;
+	for ( int i = 1; i < len - 2; i++ )
+		hash2 = hash2 * 0x1003F + s[i];
+
+	quint32 hash3 = 0;
+	for ( char c : ext )
+		hash3 = hash3 * 0x1003F + uchar( c );
+
+	return (quint64( hash2 + hash3 ) << 32) | hash1;
+}
+
+//! Lowercase Latin-1 path with backslashes
+static QByteArray archivePath( const QString & path )
+{
+	return QString( path ).replace( '/', '\\' ).toLower().toLatin1();
+}
+
+//! CRC-32 lookup table for the reflected polynomial 0xEDB88320
+static const QVector<quint32> crcTable = []() {
+	QVector<quint32> table( 256 );
+	for ( quint32 i = 0; i < 256; i++ ) {
+		quint32 c = i;
+		for ( int k = 0; k < 8; k++ )
+			c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : (c >> 1);
+		table[i] = c;
+	}
+	return table;
+}();
+
+//! Archive flag for the type of a file in a version 103-105 %BSA
+static quint32 bsaFileFlag( const QString & name )
+{
+	static const QHash<QString, quint32> flags = {
+		{ "nif", OB_BSAFILE_NIF }, { "kf", OB_BSAFILE_NIF }, { "dds", OB_BSAFILE_DDS },
+		{ "xml", OB_BSAFILE_XML }, { "wav", OB_BSAFILE_WAV }, { "mp3", OB_BSAFILE_MP3 },
+		{ "ogg", OB_BSAFILE_MP3 }, { "txt", OB_BSAFILE_TXT }, { "html", OB_BSAFILE_HTML },
+		{ "bat", OB_BSAFILE_BAT }, { "scc", OB_BSAFILE_SCC }, { "spt", OB_BSAFILE_SPT },
+		{ "tex", OB_BSAFILE_TEX }, { "fnt", OB_BSAFILE_FNT }, { "ctl", OB_BSAFILE_CTL }
+	};
+
+	return flags.value( QFileInfo( name ).suffix() );
+}
+
+//! Fills the name hashes and extension of a BA2 record
+template <typename T> static void setBA2Name( T & record, const BSAWriter::Entry & e )
+{
+	int dot = e.name.lastIndexOf( '.' );
+	QByteArray ext = (dot < 0) ? QByteArray() : e.name.mid( dot + 1 ).toLatin1();
+
+	record.nameHash = BSAWriter::ba2Hash( (dot < 0) ? e.name : e.name.left( dot ) );
+	record.dirHash = BSAWriter::ba2Hash( e.folder );
+	memset( record.ext, 0, sizeof( record.ext ) );
+	memcpy( record.ext, ext.constData(), qMin( ext.size(), int( sizeof( record.ext ) ) ) );
+}
+
+//! BA2 texture records followed by their chunks, as stored in the archive
+static QByteArray textureRecords( const QVector<F4Tex> & textures )
+{
+	QByteArray out;
+	for ( const F4Tex & tex : textures ) {
+		out.append( (const char *)&tex.header, sizeof( F4TexInfo ) );
+		out.append( (const char *)tex.chunks.constData(), tex.chunks.count() * sizeof( F4TexChunk ) );
+	}
+	return out;
+}
+
+/*! Bytes in one mip of the given size, or 0 if the format cannot be packed
+ *
+ * Only the formats BSA::fileContents() can rebuild a DDS header for are packed.
+ */
+static qint64 mipSize( quint32 format, quint32 width, quint32 height )
+{
+	qint64 blocks = qint64( qMax( 1u, (width + 3) / 4 ) ) * qMax( 1u, (height + 3) / 4 );
+
+	switch ( format ) {
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		return blocks * 8;
+
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return blocks * 16;
+
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+		return qint64( width ) * height * 4;
+
+	case DXGI_FORMAT_R8_UNORM:
+		return qint64( width ) * height;
+
+	default:
+		return 0;
+	}
+}
+
+//! DXGI format of a DDS pixel format without the DX10 extension
+static quint32 legacyFormat( quint32 flags, quint32 fourCC, quint32 bits, quint32 r, quint32 g, quint32 b, quint32 a )
+{
+	if ( flags & DDS_FOURCC ) {
+		switch ( fourCC ) {
+		case MAKEFOURCC( 'D', 'X', 'T', '1' ):
+			return DXGI_FORMAT_BC1_UNORM;
+		case MAKEFOURCC( 'D', 'X', 'T', '3' ):
+			return DXGI_FORMAT_BC2_UNORM;
+		case MAKEFOURCC( 'D', 'X', 'T', '5' ):
+			return DXGI_FORMAT_BC3_UNORM;
+		case MAKEFOURCC( 'A', 'T', 'I', '2' ):
+		case MAKEFOURCC( 'B', 'C', '5', 'U' ):
+			return DXGI_FORMAT_BC5_UNORM;
+		default:
+			return DXGI_FORMAT_UNKNOWN;
+		}
+	}
+
+	if ( bits == 32 && r == 0x00FF0000 && g == 0x0000FF00 && b == 0x000000FF && a == 0xFF000000 )
+		return DXGI_FORMAT_B8G8R8A8_UNORM;
+
+	if ( bits == 8 && r == 0xFF && (flags & (DDS_RGB | DDS_LUMINANCE)) )
+		return DXGI_FORMAT_R8_UNORM;
+
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+/*! Fills a BA2 texture record and its chunk layout from a DDS header.
+ *
+ * Every mip of at least BA2_MIP_CHUNK_SIZE bytes becomes a chunk of its own and the
+ * remaining small mips share the last chunk. Cubemaps keep their faces in one chunk.
+ *
+ * \param head The start of the DDS file
+ * \param fileSize The size of the DDS file
+ * \param tex The texture record to fill
+ * \param dataOffset Set to the offset of the pixel data
+ * \return False if the file is not a DDS texture which can be packed
+ */
+static bool planTexture( const QByteArray & head, qint64 fileSize, F4Tex & tex, qint64 & dataOffset )
+{
+	// Fields are read by offset; the DDS_HEADER layout depends on the size of DWORD
+	auto field = [&head]( int offset ) {
+		quint32 v;
+		memcpy( &v, head.constData() + offset, 4 );
+		return v;
+	};
+
+	if ( head.size() < DDS_HEADER_SIZE || field( 0 ) != DDS_MAGIC )
+		return false;
+
+	quint32 height = field( 12 );
+	quint32 width = field( 16 );
+	quint32 numMips = qMax( 1u, field( 28 ) );
+	quint32 pfFlags = field( 80 );
+	quint32 fourCC = field( 84 );
+	quint32 caps2 = field( 112 );
+
+	if ( caps2 & DDS_FLAGS_VOLUME )
+		return false;
+
+	quint32 format;
+	bool cubemap;
+
+	if ( (pfFlags & DDS_FOURCC) && fourCC == MAKEFOURCC( 'D', 'X', '1', '0' ) ) {
+		if ( head.size() < DDS_DX10_HEADER_SIZE )
+			return false;
+
+		format = field( 128 );
+		cubemap = field( 136 ) & DDS_RESOURCE_MISC_TEXTURECUBE;
+		if ( field( 132 ) != DDS_DIMENSION_TEXTURE2D || field( 140 ) > 1 )
+			return false;
+
+		dataOffset = DDS_DX10_HEADER_SIZE;
+	} else {
+		format = legacyFormat( pfFlags, fourCC, field( 88 ), field( 92 ), field( 96 ), field( 100 ), field( 104 ) );
+		cubemap = caps2 & DDS_CUBEMAP;
+		if ( cubemap && (caps2 & DDS_CUBEMAP_ALLFACES) != DDS_CUBEMAP_ALLFACES )
+			return false;
+
+		dataOffset = DDS_HEADER_SIZE;
+	}
+
+	if ( width == 0 || height == 0 || width > 0xFFFF || height > 0xFFFF || numMips > 0xFF )
+		return false;
+
+	QVector<qint64> mips;
+	qint64 total = 0;
+	for ( quint32 m = 0; m < numMips; m++ ) {
+		qint64 size = mipSize( format, qMax( 1u, width >> m ), qMax( 1u, height >> m ) );
+		if ( size == 0 )
+			return false;
+
+		mips << size;
+		total += size;
+	}
+
+	qint64 pixels = fileSize - dataOffset;
+	if ( pixels < total * (cubemap ? 6 : 1) )
+		return false;
+
+	auto newChunk = []( int mip ) {
+		F4TexChunk chunk = {};
+		chunk.startMip = mip;
+		chunk.endMip = mip;
+		chunk.unk14 = BA2_RECORD_MARKER;
+		return chunk;
+	};
+
+	tex.chunks.clear();
+	if ( cubemap ) {
+		F4TexChunk chunk = newChunk( 0 );
+		chunk.endMip = numMips - 1;
+		tex.chunks << chunk;
+	} else {
+		for ( int m = 0; m < mips.count(); m++ ) {
+			if ( m == 0 || mips.at( m - 1 ) >= BA2_MIP_CHUNK_SIZE )
+				tex.chunks << newChunk( m );
+			else
+				tex.chunks.last().endMip = m;
+
+			tex.chunks.last().unpackedSize += mips.at( m );
+		}
+	}
+
+	// Cubemap faces and any trailing bytes go into the last chunk
+	qint64 planned = 0;
+	for ( const F4TexChunk & chunk : tex.chunks )
+		planned += chunk.unpackedSize;
+	tex.chunks.last().unpackedSize += pixels - planned;
+
+	tex.header.unk0C = 0;
+	tex.header.numChunks = tex.chunks.count();
+	tex.header.chunkHeaderSize = sizeof( F4TexChunk );
+	tex.header.height = height;
+	tex.header.width = width;
+	tex.header.numMips = numMips;
+	tex.header.format = format;
+	tex.header.unk16 = cubemap ? BA2_CUBEMAP_FLAGS : BA2_TEXTURE_FLAGS;
+
+	return true;
+}
+
+
+BSAWriter::BSAWriter( Format format )
+	: format( format )
+{
+}
+
+// see bsawriter.h
+bool BSAWriter::addDirectory( const QString & dir )
+{
+	QDir base( dir );
+	if ( !base.exists() ) {
+		error = QString( "%1 does not exist" ).arg( dir );
+		return false;
+	}
+
+	QDirIterator it( base.absolutePath(), QDir::Files, QDirIterator::Subdirectories );
+	while ( it.hasNext() ) {
+		QString source = it.next();
+		addFile( source, base.relativeFilePath( source ) );
+	}
+
+	return true;
+}
+
+// see bsawriter.h
+bool BSAWriter::addFileList( const QString & listFile, const QString & base )
+{
+	QFile list( listFile );
+	if ( !list.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+		error = QString( "%1: %2" ).arg( listFile, list.errorString() );
+		return false;
+	}
+
+	QDir dir( base );
+	QTextStream in( &list );
+	while ( !in.atEnd() ) {
+		QString line = in.readLine().trimmed();
+		if ( line.isEmpty() )
+			continue;
+
+		QString source = dir.absoluteFilePath( line );
+		if ( !QFileInfo( source ).isFile() ) {
+			error = QString( "%1 does not exist" ).arg( source );
+			return false;
+		}
+
+		addFile( source, dir.relativeFilePath( source ) );
+	}
+
+	return true;
+}
+
+// see bsawriter.h
+void BSAWriter::addFile( const QString & source, const QString & path )
+{
+	QString p = QDir::cleanPath( path ).toLower().replace( '/', '\\' );
+	int sep = p.lastIndexOf( '\\' );
+
+	Entry e;
+	e.source = source;
+	e.folder = (sep < 0) ? QString() : p.left( sep );
+	e.name = p.mid( sep + 1 );
+	entries << e;
+}
+
+// see bsawriter.h
+quint64 BSAWriter::fileHash( const QString & name )
+{
+	QByteArray n = archivePath( name );
+	int dot = n.lastIndexOf( '.' );
+	if ( dot < 0 )
+		return tes4Hash( n, QByteArray() );
+
+	return tes4Hash( n.left( dot ), n.mid( dot ) );
+}
+
+// see bsawriter.h
+quint64 BSAWriter::folderHash( const QString & folder )
+{
+	return tes4Hash( archivePath( folder ), QByteArray() );
+}
+
+// see bsawriter.h
+quint32 BSAWriter::ba2Hash( const QString & name )
+{
+	quint32 hash = 0;
+	for ( char c : archivePath( name ) )
+		hash = (hash >> 8) ^ crcTable.at( (hash ^ uchar( c )) & 0xFF );
+
+	return hash;
+}
+
+// see bsawriter.h
+bool BSAWriter::write( const QString & archive )
+{
+	error.clear();
+
+	if ( entries.isEmpty() ) {
+		error = "No files to pack";
+		return false;
+	}
+
+	// Sorted so that the archive does not depend on the order files were added in
+	std::sort( entries.begin(), entries.end(), []( const Entry & a, const Entry & b ) {
+		return (a.folder != b.folder) ? a.folder < b.folder : a.name < b.name;
+	} );
+
+	for ( int i = 0; i < entries.count(); i++ ) {
+		const Entry & e = entries.at( i );
+		if ( e.folder.isEmpty() ) {
+			error = QString( "%1 is not inside a folder" ).arg( e.name );
+			return false;
+		}
+
+		if ( i > 0 && e.folder == entries.at( i - 1 ).folder && e.name == entries.at( i - 1 ).name ) {
+			error = QString( "%1\\%2 was added twice" ).arg( e.folder, e.name );
+			return false;
+		}
+	}
+
+	if ( format == BA2Textures && !planTextures() )
+		return false;
+
+	// Nothing replaces an existing archive unless everything was written
+	QSaveFile file( archive );
+	if ( !file.open( QIODevice::WriteOnly ) ) {
+		error = QString( "%1: %2" ).arg( archive, file.errorString() );
+		return false;
+	}
+
+	bool ok = (format == BSA104 || format == BSA105) ? writeBSA( file ) : writeBA2( file );
+
+	if ( ok && !file.commit() ) {
+		error = QString( "%1: %2" ).arg( archive, file.errorString() );
+		ok = false;
+	}
+
+	return ok;
+}
+
+// see bsawriter.h
+bool BSAWriter::writeBSA( QFileDevice & file )
+{
+	bool sse = (format == BSA105);
+
+	// Folders and the files inside each folder are stored in hash order
+	QMap<quint64, QString> folderNames;
+	QMap<quint64, QMap<quint64, int>> folderFiles;
+
+	for ( int i = 0; i < entries.count(); i++ ) {
+		const Entry & e = entries.at( i );
+
+		quint64 hash = folderHash( e.folder );
+		QString other = folderNames.value( hash, e.folder );
+		if ( other != e.folder ) {
+			error = QString( "The folders %1 and %2 have the same hash" ).arg( other, e.folder );
+			return false;
+		}
+		folderNames.insert( hash, e.folder );
+
+		QMap<quint64, int> & files = folderFiles[hash];
+		hash = fileHash( e.name );
+		if ( files.contains( hash ) ) {
+			error = QString( "The files %1 and %2 in %3 have the same hash" )
+				.arg( entries.at( files.value( hash ) ).name, e.name, e.folder );
+			return false;
+		}
+		files.insert( hash, i );
+	}
+
+	OBBSAHeader header = {};
+	header.FolderRecordOffset = 4 + 4 + sizeof( OBBSAHeader );
+	header.ArchiveFlags = OB_BSAARCHIVE_PATHNAMES | OB_BSAARCHIVE_FILENAMES;
+	if ( compression )
+		header.ArchiveFlags |= OB_BSAARCHIVE_COMPRESSFILES;
+	header.FolderCount = folderNames.count();
+	header.FileCount = entries.count();
+
+	for ( const QString & folder : folderNames ) {
+		if ( folder.size() > 254 ) {
+			error = QString( "The folder name %1 is too long" ).arg( folder );
+			return false;
+		}
+		header.FolderNameLength += folder.size() + 1;
+	}
+
+	for ( const Entry & e : entries ) {
+		header.FileNameLength += e.name.size() + 1;
+		header.FileFlags |= bsaFileFlag( e.name );
+	}
+
+	// Folder records point at their file record block, plus the file name table size
+	quint64 blockOffset = header.FolderRecordOffset
+		+ header.FolderCount * (sse ? sizeof( SEBSAFolderInfo ) : sizeof( OBBSAFolderInfo ));
+
+	QByteArray folderRecords;
+	QByteArray fileNames;
+	QVector<int> order;
+	order.reserve( entries.count() );
+
+	for ( auto f = folderFiles.constBegin(); f != folderFiles.constEnd(); ++f ) {
+		quint64 offset = blockOffset + header.FileNameLength;
+		if ( sse ) {
+			SEBSAFolderInfo info = { f.key(), quint32( f->count() ), 0, offset };
+			folderRecords.append( (const char *)&info, sizeof( info ) );
+		} else {
+			OBBSAFolderInfo info = { f.key(), quint32( f->count() ), quint32( offset ) };
+			folderRecords.append( (const char *)&info, sizeof( info ) );
+		}
+
+		blockOffset += 1 + folderNames.value( f.key() ).size() + 1 + f->count() * sizeof( OBBSAFileInfo );
+
+		for ( int i : *f ) {
+			order << i;
+			fileNames += archivePath( entries.at( i ).name );
+			fileNames += '\0';
+		}
+	}
+
+	quint32 magic = OB_BSAHEADER_FILEID;
+	quint32 version = sse ? SSE_BSAHEADER_VERSION : F3_BSAHEADER_VERSION;
+
+	file.write( (const char *)&magic, sizeof( magic ) );
+	file.write( (const char *)&version, sizeof( version ) );
+	file.write( (const char *)&header, sizeof( header ) );
+	file.write( folderRecords );
+
+	// File records are written as placeholders and filled in once the data is written
+	QVector<OBBSAFileInfo> records( order.count() );
+	QVector<qint64> blockPos;
+
+	int k = 0;
+	for ( auto f = folderFiles.constBegin(); f != folderFiles.constEnd(); ++f ) {
+		QByteArray name = archivePath( folderNames.value( f.key() ) );
+		quint8 len = name.size() + 1;
+		file.write( (const char *)&len, 1 );
+		file.write( name.constData(), len );
+
+		blockPos << file.pos();
+		for ( auto i = f->constBegin(); i != f->constEnd(); ++i ) {
+			records[k] = {};
+			records[k].hash = i.key();
+			file.write( (const char *)&records.at( k++ ), sizeof( OBBSAFileInfo ) );
+		}
+	}
+
+	file.write( fileNames );
+
+	PackQueue queue( order.count(), threads, [this, &order, sse]( int k, PackedEntry & p ) {
+		QByteArray data;
+		if ( !readSource( entries.at( order.at( k ) ).source, data, p.error ) )
+			return;
+
+		if ( data.size() > OB_BSAFILE_SIZEMASK ) {
+			p.error = QString( "%1 is too large" ).arg( entries.at( order.at( k ) ).source );
+			return;
+		}
+
+		p.size = data.size();
+
+		if ( compression && !data.isEmpty() ) {
+			QByteArray packed = sse ? lz4Compress( data.constData(), data.size() ) : zlibCompress( data.constData(), data.size() );
+
+			// The unpacked size precedes the compressed data
+			if ( !packed.isEmpty() && packed.size() + 4 < data.size() ) {
+				p.data.resize( 4 );
+				memcpy( p.data.data(), &p.size, 4 );
+				p.data += packed;
+				p.compressed = true;
+				return;
+			}
+		}
+
+		p.data = data;
+	} );
+
+	for ( k = 0; k < order.count(); k++ ) {
+		PackedEntry p = queue.take( k );
+		if ( !p.error.isEmpty() ) {
+			error = p.error;
+			return false;
+		}
+
+		qint64 offset = file.pos();
+		if ( offset + p.data.size() > 0xFFFFFFFFLL ) {
+			error = "The archive would be larger than 4 GB";
+			return false;
+		}
+
+		OBBSAFileInfo & r = records[k];
+		r.sizeFlags = p.data.size();
+		r.offset = quint32( offset );
+
+		// Stored entries in a compressed archive invert the archive default
+		if ( compression && !p.compressed )
+			r.sizeFlags |= OB_BSAFILE_FLAG_TOGGLE;
+
+		file.write( p.data );
+	}
+
+	k = 0;
+	int block = 0;
+	for ( const auto & files : folderFiles ) {
+		file.seek( blockPos.at( block++ ) );
+		file.write( (const char *)(records.constData() + k), files.count() * sizeof( OBBSAFileInfo ) );
+		k += files.count();
+	}
+
+	return true;
+}
+
+// see bsawriter.h
+bool BSAWriter::writeBA2( QFileDevice & file )
+{
+	bool dx10 = (format == BA2Textures);
+
+	quint32 magic = F4_BSAHEADER_FILEID;
+	quint32 version = F4_BSAHEADER_VERSION;
+
+	F4BSAHeader header = {};
+	memcpy( header.type, dx10 ? "DX10" : "GNRL", 4 );
+	header.numFiles = entries.count();
+
+	// Records are written as placeholders and filled in once the data is written
+	QVector<F4GeneralInfo> general;
+	if ( !dx10 ) {
+		general.resize( entries.count() );
+		for ( int i = 0; i < entries.count(); i++ ) {
+			F4GeneralInfo & r = general[i];
+			r = {};
+			setBA2Name( r, entries.at( i ) );
+			r.unk0C = BA2_GENERAL_FLAGS;
+			r.unk20 = BA2_RECORD_MARKER;
+		}
+	}
+
+	file.write( (const char *)&magic, sizeof( magic ) );
+	file.write( (const char *)&version, sizeof( version ) );
+	file.write( (const char *)&header, sizeof( header ) );
+
+	qint64 recordPos = file.pos();
+	if ( dx10 )
+		file.write( textureRecords( textures ) );
+	else
+		file.write( (const char *)general.constData(), general.count() * sizeof( F4GeneralInfo ) );
+
+	PackQueue queue( entries.count(), threads, [this, dx10]( int i, PackedEntry & p ) {
+		const Entry & e = entries.at( i );
+
+		QByteArray data;
+		if ( !readSource( e.source, data, p.error ) )
+			return;
+
+		p.size = data.size();
+
+		if ( !dx10 ) {
+			if ( compression && !data.isEmpty() ) {
+				QByteArray packed = zlibCompress( data.constData(), data.size() );
+				if ( !packed.isEmpty() ) {
+					p.data = packed;
+					p.compressed = true;
+					return;
+				}
+			}
+
+			p.data = data;
+			return;
+		}
+
+		// Every chunk is compressed on its own; a packed size of 0 means it is stored
+		qint64 pos = e.dataOffset;
+		p.chunks = textures.at( i ).chunks;
+
+		qint64 planned = pos;
+		for ( const F4TexChunk & chunk : p.chunks )
+			planned += chunk.unpackedSize;
+
+		if ( data.size() != planned ) {
+			p.error = QString( "%1 changed while it was being packed" ).arg( e.source );
+			return;
+		}
+
+		for ( F4TexChunk & chunk : p.chunks ) {
+			const char * src = data.constData() + pos;
+			QByteArray packed = compression ? zlibCompress( src, chunk.unpackedSize ) : QByteArray();
+
+			chunk.offset = p.data.size();
+			chunk.packedSize = packed.size();
+			if ( packed.isEmpty() )
+				p.data.append( src, chunk.unpackedSize );
+			else
+				p.data += packed;
+
+			pos += chunk.unpackedSize;
+		}
+	} );
+
+	for ( int i = 0; i < entries.count(); i++ ) {
+		PackedEntry p = queue.take( i );
+		if ( !p.error.isEmpty() ) {
+			error = p.error;
+			return false;
+		}
+
+		qint64 offset = file.pos();
+
+		if ( dx10 ) {
+			for ( F4TexChunk & chunk : p.chunks )
+				chunk.offset += offset;
+			textures[i].chunks = p.chunks;
+		} else {
+			F4GeneralInfo & r = general[i];
+			r.offset = offset;
+			r.packedSize = p.compressed ? p.data.size() : 0;
+			r.unpackedSize = p.size;
+		}
+
+		file.write( p.data );
+	}
+
+	header.nameTableOffset = file.pos();
+
+	for ( const Entry & e : entries ) {
+		QByteArray path = archivePath( e.folder + "\\" + e.name );
+		quint16 len = path.size();
+		file.write( (const char *)&len, sizeof( len ) );
+		file.write( path );
+	}
+
+	file.seek( recordPos - sizeof( header ) );
+	file.write( (const char *)&header, sizeof( header ) );
+
+	if ( dx10 )
+		file.write( textureRecords( textures ) );
+	else
+		file.write( (const char *)general.constData(), general.count() * sizeof( F4GeneralInfo ) );
+
+	return true;
+}
+
+// see bsawriter.h
+bool BSAWriter::planTextures()
+{
+	textures.clear();
+	textures.reserve( entries.count() );
+
+	for ( Entry & e : entries ) {
+		QFile f( e.source );
+		if ( !f.open( QIODevice::ReadOnly ) ) {
+			error = QString( "%1: %2" ).arg( e.source, f.errorString() );
+			return false;
+		}
+
+		F4Tex tex = {};
+		if ( !planTexture( f.read( DDS_DX10_HEADER_SIZE ), f.size(), tex, e.dataOffset ) ) {
+			error = QString( "%1 is not a DDS texture which can be packed" ).arg( e.source );
+			return false;
+		}
+
+		setBA2Name( tex.header, e );
+		textures << tex;
+	}
+
+	return true;
+}
+
+// see bsawriter.h
+bool BSAWriter::verify( const QString & archive )
+{
+	error.clear();
+
+	// Parse the tables that were just written rather than caching them
+	BSA bsa( archive );
+	bsa.setDirectoryCache( false );
+	if ( !bsa.open() ) {
+		error = QString( "%1: %2" ).arg( archive, bsa.statusText() );
+		return false;
+	}
+
+	for ( const Entry & e : entries ) {
+		QString path = QString( e.folder + "/" + e.name ).replace( '\\', '/' );
+
+		QByteArray source, packed;
+		if ( !readSource( e.source, source, error ) )
+			return false;
+
+		if ( !bsa.fileContents( path, packed ) ) {
+			error = QString( "%1 could not be read back" ).arg( path );
+			return false;
+		}
+
+		// The reader writes its own DDS header, so only the pixel data of textures is compared
+		if ( format == BA2Textures ) {
+			source = source.mid( e.dataOffset );
+			packed = packed.right( source.size() );
+		}
+
+		if ( packed != source ) {
+			error = QString( "%1 differs from its source" ).arg( path );
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,127 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+
+#ifndef BSAWRITER_H
+#define BSAWRITER_H
+
+
+#include "bsa.h"
+
+#include <QString>
+#include <QVector>
+
+
+class QFileDevice;
+
+
+//! \file bsawriter.h BSAWriter
+
+//! Packs loose files into a %BSA or BA2 archive.
+/*!
+ * Entries are read and compressed on a pool of worker threads while the calling thread
+ * streams the finished entries to disk in archive order, so only a small window of
+ * entries is held in memory at once. The record tables are written as placeholders and
+ * filled in once the offsets and packed sizes are known.
+ *
+ * Archive paths are stored lowercase with backslashes, as the games expect.
+ */
+class BSAWriter final
+{
+public:
+	enum Format
+	{
+		BSA104,     //!< Fallout 3, New Vegas and Skyrim %BSA; zlib
+		BSA105,     //!< Skyrim SE %BSA; LZ4 frames
+		BA2General, //!< Fallout 4 GNRL BA2; zlib
+		BA2Textures //!< Fallout 4 DX10 BA2; DDS mips split into zlib chunks
+	};
+
+	BSAWriter( Format format );
+
+	//! Adds every file below dir, named by its path relative to dir
+	bool addDirectory( const QString & dir );
+	//! Adds the files listed one per line in listFile, named by their path relative to base
+	bool addFileList( const QString & listFile, const QString & base );
+	//! Adds a single file under the given archive path
+	void addFile( const QString & source, const QString & path );
+
+	//! Whether entries are compressed; entries which do not shrink are always stored
+	void setCompressed( bool enable ) { compression = enable; }
+	//! Number of worker threads; defaults to QThread::idealThreadCount()
+	void setThreadCount( int count ) { threads = count; }
+
+	//! Writes the archive, replacing any existing file
+	bool write( const QString & archive );
+	//! Opens a written archive with the %BSA reader and compares every entry with its source
+	bool verify( const QString & archive );
+
+	//! Describes the last error
+	QString errorString() const { return error; }
+
+	//! Hash of a file name in a version 103-105 %BSA
+	static quint64 fileHash( const QString & name );
+	//! Hash of a folder path in a version 103-105 %BSA
+	static quint64 folderHash( const QString & folder );
+	//! Hash of a name or folder in a BA2; a CRC-32 without the usual inversions
+	static quint32 ba2Hash( const QString & name );
+
+	//! A loose file to be packed
+	struct Entry
+	{
+		QString source; //!< Path of the loose file
+		QString folder; //!< Lowercase folder inside the archive, with backslashes
+		QString name;   //!< Lowercase file name
+		//! Offset of the pixel data in a DDS file; BA2Textures only
+		qint64 dataOffset = 0;
+	};
+
+protected:
+	bool writeBSA( QFileDevice & file );
+	bool writeBA2( QFileDevice & file );
+
+	//! Reads the DDS header of every entry to plan its chunks; BA2Textures only
+	bool planTextures();
+
+	Format format;
+	bool compression = true;
+	int threads = 0;
+
+	QVector<Entry> entries;
+	//! Texture record and chunk layout per entry; chunk offsets are filled in when written
+	QVector<F4Tex> textures;
+
+	QString error;
+};
+
+#endif
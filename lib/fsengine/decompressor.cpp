@@ -0,0 +1,132 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#include "decompressor.h"
+#include "zlib/zlib.h"
+#include "lz4frame.h"
+
+#include <QThreadStorage>
+
+
+//! Decompression contexts owned by a single thread
+struct DecompressorContexts
+{
+	~DecompressorContexts()
+	{
+		if ( zlibReady )
+			inflateEnd( &zlib );
+		if ( lz4 )
+			LZ4F_freeDecompressionContext( lz4 );
+	}
+
+	z_stream zlib = {};
+	bool zlibReady = false;
+
+	LZ4F_decompressionContext_t lz4 = nullptr;
+};
+
+//! Deleted when their thread finishes
+static QThreadStorage<DecompressorContexts *> contexts;
+
+static DecompressorContexts * localContexts()
+{
+	if ( !contexts.hasLocalData() )
+		contexts.setLocalData( new DecompressorContexts );
+
+	return contexts.localData();
+}
+
+// see decompressor.h
+qint64 Decompressor::zlib( const char * src, qint64 srcSize, char * dst, qint64 dstSize )
+{
+	DecompressorContexts * ctx = localContexts();
+	z_stream & strm = ctx->zlib;
+
+	if ( !ctx->zlibReady ) {
+		// Automatic zlib/gzip header detection survives inflateReset
+		if ( inflateInit2( &strm, 15 + 32 ) != Z_OK )
+			return -1;
+
+		ctx->zlibReady = true;
+	} else if ( inflateReset( &strm ) != Z_OK ) {
+		return -1;
+	}
+
+	strm.next_in = (Bytef *)src;
+	strm.avail_in = uInt( srcSize );
+	strm.next_out = (Bytef *)dst;
+	strm.avail_out = uInt( dstSize );
+
+	if ( inflate( &strm, Z_FINISH ) != Z_STREAM_END )
+		return -1;
+
+	return qint64( strm.total_out );
+}
+
+// see decompressor.h
+qint64 Decompressor::lz4( const char * src, qint64 srcSize, char * dst, qint64 dstSize )
+{
+	DecompressorContexts * ctx = localContexts();
+
+	if ( !ctx->lz4 && LZ4F_isError( LZ4F_createDecompressionContext( &ctx->lz4, LZ4F_VERSION ) ) ) {
+		ctx->lz4 = nullptr;
+		return -1;
+	}
+
+	size_t srcPos = 0, dstPos = 0;
+	size_t hint = 1;
+
+	while ( hint != 0 && srcPos < size_t( srcSize ) ) {
+		size_t srcLen = size_t( srcSize ) - srcPos;
+		size_t dstLen = size_t( dstSize ) - dstPos;
+
+		hint = LZ4F_decompress( ctx->lz4, dst + dstPos, &dstLen, src + srcPos, &srcLen, nullptr );
+		if ( LZ4F_isError( hint ) )
+			break;
+
+		srcPos += srcLen;
+		dstPos += dstLen;
+
+		if ( srcLen == 0 && dstLen == 0 )
+			break;
+	}
+
+	if ( hint != 0 ) {
+		// The context is left mid-frame; start over with a fresh one next time
+		LZ4F_freeDecompressionContext( ctx->lz4 );
+		ctx->lz4 = nullptr;
+		return -1;
+	}
+
+	return qint64( dstPos );
+}
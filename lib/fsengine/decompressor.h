@@ -0,0 +1,64 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#ifndef DECOMPRESSOR_H
+#define DECOMPRESSOR_H
+
+
+#include <QtGlobal>
+
+
+//! \file decompressor.h Decompressor
+
+//! Decompresses archive entries straight into caller-provided buffers.
+/*!
+ * Each thread keeps one zlib stream and one LZ4F context which are reset rather than
+ * recreated between entries, so small entries cost little more than the decompression.
+ */
+class Decompressor final
+{
+public:
+	//! Inflates zlib or gzip data into dst.
+	/*!
+	 * \return The number of bytes written, or -1 if the stream is corrupt or does not fit
+	 */
+	static qint64 zlib( const char * src, qint64 srcSize, char * dst, qint64 dstSize );
+
+	//! Decompresses an LZ4 frame into dst.
+	/*!
+	 * \return The number of bytes written, or -1 if the frame is corrupt or does not fit
+	 */
+	static qint64 lz4( const char * src, qint64 srcSize, char * dst, qint64 dstSize );
+};
+
+#endif
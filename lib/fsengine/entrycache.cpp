@@ -0,0 +1,187 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#include "entrycache.h"
+#include "fsengine.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+
+#include <list>
+
+
+//! Entries larger than this fraction of the budget are not cached
+#define ENTRYCACHE_MAX_ENTRY_FRACTION 4
+
+typedef QPair<const FSArchiveFile *, QString> EntryKey;
+
+struct CachedEntry
+{
+	EntryKey key;
+	QByteArray data;
+};
+
+//! The cache state; the list is ordered from most to least recently used
+struct EntryCacheState
+{
+	QMutex mutex;
+	std::list<CachedEntry> entries;
+	QHash<EntryKey, std::list<CachedEntry>::iterator> lookup;
+
+	qint64 budget = 256 * 1024 * 1024;
+	qint64 size = 0;
+	quint64 hits = 0;
+	quint64 misses = 0;
+
+	void evict( qint64 limit )
+	{
+		while ( size > limit && !entries.empty() ) {
+			size -= entries.back().data.size();
+			lookup.remove( entries.back().key );
+			entries.pop_back();
+		}
+	}
+};
+
+static EntryCacheState & state()
+{
+	static EntryCacheState s;
+	return s;
+}
+
+// see entrycache.h
+bool EntryCache::fileContents( FSArchiveFile * archive, const QString & entry, QByteArray & data )
+{
+	EntryCacheState & s = state();
+	EntryKey key( archive, entry.toLower().replace( '\\', '/' ) );
+
+	{
+		QMutexLocker lock( &s.mutex );
+
+		auto it = s.lookup.find( key );
+		if ( it != s.lookup.end() ) {
+			// Move to the front; the data is implicitly shared, not copied
+			s.entries.splice( s.entries.begin(), s.entries, it.value() );
+			data = it.value()->data;
+			s.hits++;
+			return true;
+		}
+
+		s.misses++;
+	}
+
+	// Decompress outside of the lock so other threads can still hit the cache
+	if ( !archive->fileContents( key.second, data ) )
+		return false;
+
+	QMutexLocker lock( &s.mutex );
+
+	if ( s.budget <= 0 || data.size() > s.budget / ENTRYCACHE_MAX_ENTRY_FRACTION || s.lookup.contains( key ) )
+		return true;
+
+	s.entries.push_front( { key, data } );
+	s.lookup.insert( key, s.entries.begin() );
+	s.size += data.size();
+	s.evict( s.budget );
+
+	return true;
+}
+
+// see entrycache.h
+void EntryCache::remove( const FSArchiveFile * archive )
+{
+	EntryCacheState & s = state();
+	QMutexLocker lock( &s.mutex );
+
+	for ( auto it = s.entries.begin(); it != s.entries.end(); ) {
+		if ( it->key.first == archive ) {
+			s.size -= it->data.size();
+			s.lookup.remove( it->key );
+			it = s.entries.erase( it );
+		} else {
+			++it;
+		}
+	}
+}
+
+// see entrycache.h
+void EntryCache::clear()
+{
+	EntryCacheState & s = state();
+	QMutexLocker lock( &s.mutex );
+
+	s.evict( 0 );
+}
+
+// see entrycache.h
+void EntryCache::setBudget( qint64 bytes )
+{
+	EntryCacheState & s = state();
+	QMutexLocker lock( &s.mutex );
+
+	s.budget = qMax<qint64>( bytes, 0 );
+	s.evict( s.budget );
+}
+
+// see entrycache.h
+qint64 EntryCache::budget()
+{
+	EntryCacheState & s = state();
+	QMutexLocker lock( &s.mutex );
+	return s.budget;
+}
+
+// see entrycache.h
+qint64 EntryCache::size()
+{
+	EntryCacheState & s = state();
+	QMutexLocker lock( &s.mutex );
+	return s.size;
+}
+
+// see entrycache.h
+quint64 EntryCache::hits()
+{
+	EntryCacheState & s = state();
+	QMutexLocker lock( &s.mutex );
+	return s.hits;
+}
+
+// see entrycache.h
+quint64 EntryCache::misses()
+{
+	EntryCacheState & s = state();
+	QMutexLocker lock( &s.mutex );
+	return s.misses;
+}
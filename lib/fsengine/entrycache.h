@@ -0,0 +1,72 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#ifndef ENTRYCACHE_H
+#define ENTRYCACHE_H
+
+
+#include <QByteArray>
+#include <QString>
+
+
+class FSArchiveFile;
+
+//! \file entrycache.h EntryCache
+
+//! Keeps recently read archive entries in memory, decompressed.
+/*!
+ * Entries are keyed by archive and path and evicted least recently used first once
+ * the total size exceeds the budget. Entries are dropped when their archive is closed.
+ */
+class EntryCache final
+{
+public:
+	//! Reads an entry from the cache, or from the archive if it is not cached
+	static bool fileContents( FSArchiveFile * archive, const QString & entry, QByteArray & data );
+
+	//! Drops every cached entry of an archive
+	static void remove( const FSArchiveFile * archive );
+	//! Drops every cached entry
+	static void clear();
+
+	//! Sets the memory limit in bytes; 0 disables the cache
+	static void setBudget( qint64 bytes );
+	static qint64 budget();
+
+	//! Returns the total size of the cached entries in bytes
+	static qint64 size();
+	static quint64 hits();
+	static quint64 misses();
+};
+
+#endif
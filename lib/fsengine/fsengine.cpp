@@ -32,6 +32,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "fsengine.h"
 #include "bsa.h"
+#include "entrycache.h"
 
 #include <QDateTime>
 #include <QDebug>
@@ -68,6 +69,8 @@ FSArchiveHandler::FSArchiveHandler( FSArchiveFile * a )
 // see fsengine.h
 FSArchiveHandler::~FSArchiveHandler()
 {
-	if ( ! archive->ref.deref() )
+	if ( ! archive->ref.deref() ) {
+		EntryCache::remove( archive );
 		delete archive;
+	}
 }
@@ -86,6 +86,8 @@ public:
 	virtual bool hasFile( const QString & ) const = 0;
 	virtual qint64 fileSize( const QString & ) const = 0;
 	virtual bool fileContents( const QString &, QByteArray & ) = 0;
+	//! Returns the lowercase paths of all files in the archive
+	virtual QStringList fileList() const = 0;
 	virtual QString getAbsoluteFilePath( const QString & ) const = 0;
 
 	virtual uint ownerId( const QString & ) const = 0;
@@ -34,6 +34,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fsmanager.h"
 #include "fsengine.h"
 #include "bsa.h"
+#include "entrycache.h"
 
 #include <QCheckBox>
 #include <QFileDialog>
@@ -65,11 +66,44 @@ void FSManager::del()
 // see fsmanager.h
 QList <FSArchiveFile *> FSManager::archiveList()
 {
-	QList<FSArchiveFile *> archives;
-	for ( std::shared_ptr<FSArchiveHandler> an : get()->archives.values() ) {
-		archives.append( an->getArchive() );
+	return get()->orderedArchives();
+}
+
+// see fsmanager.h
+QList<FSArchiveFile *> FSManager::orderedArchives() const
+{
+	QList<FSArchiveFile *> list;
+	for ( const QString & an : archiveOrder ) {
+		if ( auto a = archives.value( an ) )
+			list.append( a->getArchive() );
 	}
-	return archives;
+	return list;
+}
+
+// see fsmanager.h
+QString FSManager::normalizePath( const QString & path )
+{
+	return path.toLower().replace( '\\', '/' );
+}
+
+// see fsmanager.h
+std::shared_ptr<FSArchiveHandler> FSManager::findFile( const QString & path )
+{
+	FSManager * mgr = get();
+
+	QReadLocker lock( &mgr->indexLock );
+	if ( FSArchiveFile * archive = mgr->index.value( normalizePath( path ) ) )
+		return mgr->handlers.value( archive );
+
+	return nullptr;
+}
+
+// see fsmanager.h
+bool FSManager::fileContents( const QString & path, QByteArray & data )
+{
+	// The handler keeps the archive open even if the archive list changes meanwhile
+	auto handler = findFile( path );
+	return handler && EntryCache::fileContents( handler->getArchive(), normalizePath( path ), data );
 }
 
 // see fsmanager.h
@@ -82,17 +116,128 @@ FSManager::FSManager( QObject * parent )
 // see fsmanager.h
 FSManager::~FSManager()
 {
+	QWriteLocker lock( &indexLock );
+	index.clear();
+	handlers.clear();
 	archives.clear();
 }
 
 void FSManager::initialize()
 {
 	QSettings cfg;
-	QStringList list = cfg.value( "Settings/Resources/Archives", QStringList() ).toStringList();
+	EntryCache::setBudget( cfg.value( "Settings/Resources/Archive Cache Size", 256 ).toLongLong() * 1024 * 1024 );
+	setArchives( cfg.value( "Settings/Resources/Archives", QStringList() ).toStringList() );
+}
+
+// see fsmanager.h
+void FSManager::setArchives( const QStringList & list )
+{
+	// Open new archives before taking the lock
+	QMap<QString, std::shared_ptr<FSArchiveHandler> > opened;
+	for ( const QString & an : list ) {
+		if ( !archives.contains( an ) && !opened.contains( an ) )
+			if ( auto a = FSArchiveHandler::openArchive( an ) )
+				opened.insert( an, a );
+	}
+
+	QList<std::shared_ptr<FSArchiveHandler> > removed;
+	for ( auto it = archives.begin(); it != archives.end(); ) {
+		if ( !list.contains( it.key() ) ) {
+			removed.append( it.value() );
+			it = archives.erase( it );
+		} else {
+			++it;
+		}
+	}
+
+	// Incremental updates are only valid if the archives that stay keep their relative order
+	QStringList keptOld, keptNew;
+	for ( const QString & an : archiveOrder )
+		if ( archives.contains( an ) )
+			keptOld << an;
+	for ( const QString & an : list )
+		if ( archives.contains( an ) && !keptNew.contains( an ) )
+			keptNew << an;
+
+	bool reordered = keptOld != keptNew;
+
+	for ( auto it = opened.begin(); it != opened.end(); ++it )
+		archives.insert( it.key(), it.value() );
+
+	QWriteLocker lock( &indexLock );
+
+	archiveOrder.clear();
+	ranks.clear();
+	handlers.clear();
+	for ( const QString & an : list ) {
+		auto a = archives.value( an );
+		if ( a && !ranks.contains( a->getArchive() ) ) {
+			ranks.insert( a->getArchive(), archiveOrder.count() );
+			handlers.insert( a->getArchive(), a );
+			archiveOrder << an;
+		}
+	}
+
+	if ( reordered || index.isEmpty() ) {
+		rebuildIndex();
+		return;
+	}
+
+	// Drop the entries of removed archives and remember which paths need a new owner
+	QStringList orphaned;
+	for ( const auto & a : removed ) {
+		FSArchiveFile * archive = a->getArchive();
+		for ( const QString & f : archive->fileList() ) {
+			auto it = index.find( f );
+			if ( it != index.end() && it.value() == archive ) {
+				index.erase( it );
+				orphaned << f;
+			}
+		}
+	}
+
+	for ( const auto & a : opened )
+		indexArchive( a->getArchive() );
+
+	// Give orphaned paths to the remaining archive with the highest precedence, if any
+	QList<FSArchiveFile *> order = orderedArchives();
+	for ( const QString & f : orphaned ) {
+		if ( index.contains( f ) )
+			continue;
+
+		for ( FSArchiveFile * archive : order ) {
+			if ( archive->hasFile( f ) ) {
+				index.insert( f, archive );
+				break;
+			}
+		}
+	}
+}
+
+// see fsmanager.h
+void FSManager::indexArchive( FSArchiveFile * archive )
+{
+	int rank = ranks.value( archive );
+
+	for ( const QString & f : archive->fileList() ) {
+		auto it = index.find( f );
+		if ( it == index.end() )
+			index.insert( f, archive );
+		else if ( rank < ranks.value( it.value() ) )
+			it.value() = archive;
+	}
+}
+
+// see fsmanager.h
+void FSManager::rebuildIndex()
+{
+	index.clear();
 
-	for ( const QString an : list ) {
-		if ( auto a = FSArchiveHandler::openArchive( an ) )
-			archives.insert( an, a );
+	// Archives of lower precedence first so that higher ones overwrite them
+	QList<FSArchiveFile *> order = orderedArchives();
+	for ( int i = order.count() - 1; i >= 0; i-- ) {
+		for ( const QString & f : order.at( i )->fileList() )
+			index.insert( f, order.at( i ) );
 	}
 }
 
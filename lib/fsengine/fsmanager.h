@@ -37,7 +37,9 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <QDialog>
 #include <QObject>
+#include <QHash>
 #include <QMap>
+#include <QReadWriteLock>
 
 #include <memory>
 
@@ -55,9 +57,23 @@ public:
 	//! Deletes the manager
 	static void del();
 
-	//! Gets the list of globally registered BSA files
+	//! Gets the list of globally registered BSA files, highest precedence first
 	static QList<FSArchiveFile *> archiveList();
 
+	//! Normalizes a path for archive lookups: lowercase with forward slashes
+	static QString normalizePath( const QString & path );
+	//! Finds the archive with the highest precedence which contains a file
+	static std::shared_ptr<FSArchiveHandler> findFile( const QString & path );
+	//! Reads a file from the archive with the highest precedence which contains it, through the EntryCache
+	static bool fileContents( const QString & path, QByteArray & data );
+
+	/*! Sets the global archives; earlier archives take precedence over later ones.
+	 *
+	 * Archives already open are kept, and the path index is updated incrementally
+	 * unless the remaining archives were reordered.
+	 */
+	void setArchives( const QStringList & list );
+
 	//! Filters a list of BSAs from a provided list
 	static QStringList filterArchives( const QStringList & list, const QString & folder = "" );
 
@@ -69,7 +85,25 @@ protected:
 	
 protected:
 	QMap<QString, std::shared_ptr<FSArchiveHandler> > archives;
+	//! The archive paths in order of precedence
+	QStringList archiveOrder;
 	bool automatic;
+
+	//! Maps every normalized file path to the archive with the highest precedence containing it
+	QHash<QString, FSArchiveFile *> index;
+	//! The precedence of each archive in the index; lower is higher precedence
+	QHash<FSArchiveFile *, int> ranks;
+	//! The handlers of the indexed archives
+	QHash<FSArchiveFile *, std::shared_ptr<FSArchiveHandler> > handlers;
+	//! Guards the index, which is read from texture loading threads
+	mutable QReadWriteLock indexLock;
+
+	//! Returns the open archives in order of precedence
+	QList<FSArchiveFile *> orderedArchives() const;
+	//! Adds the files of an archive, replacing entries from archives of lower precedence
+	void indexArchive( FSArchiveFile * archive );
+	//! Rebuilds the whole index
+	void rebuildIndex();
 	
 	//! Builds a list of global BSAs on Windows platforms
 	static QStringList autodetectArchives( const QString & folder = "" );
@@ -30,6 +30,13 @@ void BSShape::clear()
 	colors.clear();
 	bones.clear();
 	weights.clear();
+	skin.clear();
+	bonePalette.clear();
+	bindSphereVerts.clear();
+	boneNodeCache.clear();
+	boneNodeRevision = -1;
+
+	clearBuffers();
 }
 
 void BSShape::update( const NifModel * nif, const QModelIndex & index )
@@ -235,6 +242,8 @@ void BSShape::transform()
 		bones.clear();
 		weights.clear();
 		partitions.clear();
+		skin.clear();
+		boneNodeRevision = -1;
 
 		if ( iSkin.isValid() && iSkinData.isValid() ) {
 			skeletonRoot = nif->getLink( iSkin, "Skeleton Root" );
@@ -291,45 +300,31 @@ void BSShape::transformShapes()
 	if ( isSkinned && scene->options & Scene::DoSkinning ) {
 		transformRigid = false;
 
-		int vcnt = verts.count();
-
-		transVerts.resize( vcnt );
-		transVerts.fill( Vector3() );
-		transNorms.resize( vcnt );
-		transNorms.fill( Vector3() );
-		transTangents.resize( vcnt );
-		transTangents.fill( Vector3() );
-		transBitangents.resize( vcnt );
-		transBitangents.fill( Vector3() );
-
+		// Bones are looked up once per hierarchy change; missing bones do not contribute
+		QVector<Transform> palette( weights.count() );
 
-		Node * root = findParent( 0 );
-		for ( const BoneWeights & bw : weights ) {
-			Node * bone = root ? root->findChild( bw.bone ) : nullptr;
+		const QVector<Node *> & boneList = boneNodes( 0 );
+		for ( int b = 0; b < weights.count(); b++ ) {
+			const BoneWeights & bw = weights[b];
+			Node * bone = boneList.value( b );
 			if ( bone ) {
-				Transform t = scene->view * bone->localTrans( 0 ) * bw.trans;
-				for ( const VertexWeight & w : bw.weights ) {
-					if ( w.vertex >= vcnt )
-						continue;
-
-					transVerts[w.vertex] += t * verts[w.vertex] * w.weight;
-					transNorms[w.vertex] += t.rotation * norms[w.vertex] * w.weight;
-					transTangents[w.vertex] += t.rotation * tangents[w.vertex] * w.weight;
-					transBitangents[w.vertex] += t.rotation * bitangents[w.vertex] * w.weight;
+				palette[b] = scene->view * scene->rootTrans( bone, 0 ) * bw.trans;
+			} else {
+				for ( int r = 0; r < 3; r++ ) {
+					for ( int c = 0; c < 3; c++ )
+						palette[b].rotation( r, c ) = 0.0f;
 				}
+				palette[b].scale = 0.0f;
 			}
 		}
 
-		for ( int n = 0; n < vcnt; n++ ) {
-			transNorms[n].normalize();
-			transTangents[n].normalize();
-			transBitangents[n].normalize();
-		}
+		skinShape( palette );
 
-		boundSphere = BoundSphere( transVerts );
 		boundSphere.applyInv( viewTrans() );
 		updateBounds = false;
 	} else {
+		gpuSkinned = false;
+
 		transVerts = verts;
 		transNorms = norms;
 		transTangents = tangents;
@@ -390,21 +385,20 @@ void BSShape::drawShapes( NodeList * secondPass, bool presort )
 		glPolygonOffset( 1.0f, 2.0f );
 	}
 
-	glEnableClientState( GL_VERTEX_ARRAY );
-	glVertexPointer( 3, GL_FLOAT, 0, transVerts.constData() );
+	// The selection pass draws without shaders
+	if ( Node::SELECTING && gpuSkinned )
+		skinOnCpu();
 
-	if ( !Node::SELECTING ) {
-		glEnableClientState( GL_NORMAL_ARRAY );
-		glNormalPointer( GL_FLOAT, 0, transNorms.constData() );
+	bool doColors = false;
 
+	if ( !Node::SELECTING ) {
 		bool doVCs = (bssp && (bssp->getFlags2() & ShaderFlags::SLSF2_Vertex_Colors));
 		// Always do vertex colors for FO4 if colors present
 		if ( nifVersion == 130 && hasVertexColors && colors.count() )
 			doVCs = true;
 
 		if ( transColors.count() && (scene->options & Scene::DoVertexColors) && doVCs ) {
-			glEnableClientState( GL_COLOR_ARRAY );
-			glColorPointer( 4, GL_FLOAT, 0, transColors.constData() );
+			doColors = true;
 		} else if ( !hasVertexColors && (bslsp && bslsp->hasVertexColors) ) {
 			// Correctly blacken the mesh if SLSF2_Vertex_Colors is still on
 			//	yet "Has Vertex Colors" is not.
@@ -414,40 +408,43 @@ void BSShape::drawShapes( NodeList * secondPass, bool presort )
 		}
 	}
 
+	bindVertexArrays( !Node::SELECTING, doColors );
 
-	if ( !Node::SELECTING )
+	if ( !Node::SELECTING ) {
 		shader = scene->renderer->setupProgram( this, shader );
-	
+
+		// No skinned program took the shape; skin it on the CPU from now on
+		if ( gpuSkinned && shader.isEmpty() ) {
+			gpuSkinFailed = true;
+			skinOnCpu();
+			bindVertexArrays( true, doColors );
+			shader = scene->renderer->setupProgram( this, QString( "" ) );
+		}
+	}
+
 	if ( isDoubleSided ) {
 		glCullFace( GL_FRONT );
-		glDrawElements( GL_TRIANGLES, triangles.count() * 3, GL_UNSIGNED_SHORT, triangles.constData() );
+		drawTriangles( triangles );
 		glCullFace( GL_BACK );
 	}
 
 	if ( !isLOD ) {
-		glDrawElements( GL_TRIANGLES, triangles.count() * 3, GL_UNSIGNED_SHORT, triangles.constData() );
+		drawTriangles( triangles );
 	} else if ( triangles.count() ) {
-		auto lod0 = nif->get<uint>( iBlock, "LOD0 Size" );
-		auto lod1 = nif->get<uint>( iBlock, "LOD1 Size" );
-		auto lod2 = nif->get<uint>( iBlock, "LOD2 Size" );
-
-		auto lod0tris = triangles.mid( 0, lod0 );
-		auto lod1tris = triangles.mid( lod0, lod1 );
-		auto lod2tris = triangles.mid( lod0 + lod1, lod2 );
+		int lod0 = nif->get<uint>( iBlock, "LOD0 Size" );
+		int lod1 = nif->get<uint>( iBlock, "LOD1 Size" );
+		int lod2 = nif->get<uint>( iBlock, "LOD2 Size" );
 
 		// If Level2, render all
 		// If Level1, also render Level0
 		switch ( scene->lodLevel ) {
 		case Scene::Level2:
-			if ( lod2tris.count() )
-				glDrawElements( GL_TRIANGLES, lod2tris.count() * 3, GL_UNSIGNED_SHORT, lod2tris.constData() );
+			drawTriangles( triangles, lod0 + lod1, lod2 );
 		case Scene::Level1:
-			if ( lod1tris.count() )
-				glDrawElements( GL_TRIANGLES, lod1tris.count() * 3, GL_UNSIGNED_SHORT, lod1tris.constData() );
+			drawTriangles( triangles, lod0, lod1 );
 		case Scene::Level0:
 		default:
-			if ( lod0tris.count() )
-				glDrawElements( GL_TRIANGLES, lod0tris.count() * 3, GL_UNSIGNED_SHORT, lod0tris.constData() );
+			drawTriangles( triangles, 0, lod0 );
 			break;
 		}
 	}
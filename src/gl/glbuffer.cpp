@@ -0,0 +1,166 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#include "glbuffer.h"
+
+#include <QOpenGLFunctions>
+
+#include <atomic>
+
+
+//! @file glbuffer.cpp GLBuffer, GLStripBuffer
+
+static std::atomic<qint64> uploadedTotal( 0 );
+
+GLBuffer::GLBuffer( GLenum target ) : target( target )
+{
+}
+
+GLBuffer::GLBuffer( GLBuffer && other )
+	: target( other.target ), id( other.id ), size( other.size ), uploads( other.uploads ), group( other.group )
+{
+	other.id = 0;
+	other.size = 0;
+}
+
+GLBuffer::~GLBuffer()
+{
+	clear();
+}
+
+void GLBuffer::clear()
+{
+	QOpenGLContext * context = QOpenGLContext::currentContext();
+
+	if ( id && context && context->shareGroup() == group )
+		context->functions()->glDeleteBuffers( 1, &id );
+
+	id = 0;
+	size = 0;
+	uploads = 0;
+	group = nullptr;
+}
+
+bool GLBuffer::isSupported( QOpenGLFunctions * fn )
+{
+	return fn && fn->hasOpenGLFeature( QOpenGLFunctions::Buffers );
+}
+
+void GLBuffer::unbind( QOpenGLFunctions * fn, GLenum target )
+{
+	if ( isSupported( fn ) )
+		fn->glBindBuffer( target, 0 );
+}
+
+qint64 GLBuffer::uploadedBytes()
+{
+	return uploadedTotal;
+}
+
+void GLBuffer::resetUploadStats()
+{
+	uploadedTotal = 0;
+}
+
+bool GLBuffer::bind( QOpenGLFunctions * fn, const void * data, qint64 bytes, bool upload )
+{
+	if ( !isSupported( fn ) )
+		return false;
+
+	QOpenGLContext * context = QOpenGLContext::currentContext();
+
+	// The context was recreated since the buffer was made
+	if ( id && context->shareGroup() != group ) {
+		id = 0;
+		upload = true;
+	}
+
+	if ( !id ) {
+		fn->glGenBuffers( 1, &id );
+		group = context->shareGroup();
+		size = 0;
+		upload = true;
+	}
+
+	fn->glBindBuffer( target, id );
+
+	if ( upload ) {
+		if ( bytes == size ) {
+			fn->glBufferSubData( target, 0, bytes, data );
+		} else {
+			fn->glBufferData( target, bytes, data, ( uploads > 0 ) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW );
+			size = bytes;
+		}
+
+		uploads++;
+		uploadedTotal += bytes;
+	}
+
+	return true;
+}
+
+void GLStripBuffer::draw( QOpenGLFunctions * fn, const QVector<QVector<quint16>> & strips )
+{
+	bool upload = ( id == 0 || strips.constData() != uploaded.constData() );
+
+	if ( upload ) {
+		uploaded = strips;
+
+		indices.clear();
+		offsets.clear();
+		for ( const QVector<quint16> & s : strips ) {
+			offsets << indices.count();
+			indices << s;
+		}
+	}
+
+	if ( !GLBuffer::bind( fn, indices.constData(), qint64( indices.count() ) * sizeof( quint16 ), upload ) ) {
+		for ( const QVector<quint16> & s : strips )
+			glDrawElements( GL_TRIANGLE_STRIP, s.count(), GL_UNSIGNED_SHORT, s.constData() );
+		return;
+	}
+
+	for ( int i = 0; i < strips.count(); i++ ) {
+		const void * offset = reinterpret_cast<const void *>( quintptr( offsets[i] ) * sizeof( quint16 ) );
+		glDrawElements( GL_TRIANGLE_STRIP, strips[i].count(), GL_UNSIGNED_SHORT, offset );
+	}
+
+	fn->glBindBuffer( target, 0 );
+}
+
+void GLStripBuffer::clear()
+{
+	GLBuffer::clear();
+	uploaded.clear();
+	indices.clear();
+	offsets.clear();
+}
@@ -0,0 +1,156 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#ifndef GLBUFFER_H
+#define GLBUFFER_H
+
+#include <QOpenGLContext>
+#include <QVector>
+
+#include <cstring>
+
+
+//! @file glbuffer.h GLBuffer, GLArrayBuffer, GLStripBuffer
+
+class QOpenGLFunctions;
+
+/*! An OpenGL buffer object holding the copy of an array
+ *
+ * The buffer belongs to the share group of the context it was created in and is only
+ * deleted while a context of that group is current; otherwise it goes with the group.
+ */
+class GLBuffer
+{
+public:
+	GLBuffer( GLenum target );
+	GLBuffer( const GLBuffer & ) = delete;
+	GLBuffer( GLBuffer && other );
+	~GLBuffer();
+
+	GLBuffer & operator=( const GLBuffer & ) = delete;
+
+	//! Delete the buffer object; the next bind uploads the data again
+	void clear();
+
+	//! Whether buffer objects can be used with the current context
+	static bool isSupported( QOpenGLFunctions * fn );
+	//! Bind no buffer to target, so that pointers refer to client memory again
+	static void unbind( QOpenGLFunctions * fn, GLenum target );
+
+	//! Bytes uploaded since the last call to resetUploadStats()
+	static qint64 uploadedBytes();
+	static void resetUploadStats();
+
+protected:
+	/*! Bind the buffer, replacing its contents with data if upload is set
+	 *
+	 * @return	False if buffer objects are not available
+	 */
+	bool bind( QOpenGLFunctions * fn, const void * data, qint64 bytes, bool upload );
+
+	GLenum target;
+	GLuint id = 0;
+	//! The size of the buffer object in bytes
+	qint64 size = 0;
+	//! Counts uploads; buffers changed more than once are reallocated as dynamic
+	int uploads = 0;
+	//! The share group the buffer object belongs to
+	QOpenGLContextGroup * group = nullptr;
+};
+
+/*! A buffer object mirroring a QVector
+ *
+ * The last uploaded array is kept as an implicitly shared copy. Any write to the source
+ * array detaches it, so an unchanged data pointer means unchanged contents and binding
+ * costs nothing. Arrays which were rebuilt with the same contents are compared before
+ * they are uploaded.
+ */
+template <typename T> class GLArrayBuffer final : public GLBuffer
+{
+public:
+	GLArrayBuffer( GLenum target = GL_ARRAY_BUFFER ) : GLBuffer( target ) {}
+	GLArrayBuffer( GLArrayBuffer && other ) = default;
+
+	/*! Bind the buffer holding data, uploading data first if it changed
+	 *
+	 * @return	The pointer to pass to glVertexPointer(), glDrawElements() etc.;
+	 *			an offset into the buffer, or the client array if buffers are not available
+	 */
+	const void * bind( QOpenGLFunctions * fn, const QVector<T> & data )
+	{
+		bool upload = ( id == 0 || data.constData() != uploaded.constData() );
+
+		if ( upload && id && data.count() == uploaded.count()
+			 && std::memcmp( data.constData(), uploaded.constData(), data.count() * sizeof( T ) ) == 0 )
+			upload = false;
+
+		if ( upload || data.constData() != uploaded.constData() )
+			uploaded = data;
+
+		if ( !GLBuffer::bind( fn, data.constData(), qint64( data.count() ) * sizeof( T ), upload ) ) {
+			uploaded = QVector<T>();
+			return data.constData();
+		}
+
+		return nullptr;
+	}
+
+	void clear()
+	{
+		GLBuffer::clear();
+		uploaded = QVector<T>();
+	}
+
+private:
+	QVector<T> uploaded;
+};
+
+//! An element buffer holding a list of triangle strips
+class GLStripBuffer final : public GLBuffer
+{
+public:
+	GLStripBuffer() : GLBuffer( GL_ELEMENT_ARRAY_BUFFER ) {}
+
+	//! Draw each strip from the buffer, uploading strips first if they changed
+	void draw( QOpenGLFunctions * fn, const QVector<QVector<quint16>> & strips );
+
+	void clear();
+
+private:
+	QVector<QVector<quint16>> uploaded;
+	//! The strips concatenated
+	QVector<quint16> indices;
+	//! The first index of each strip
+	QVector<int> offsets;
+};
+
+#endif
@@ -80,6 +80,11 @@ void Mesh::clear()
 	tristrips.clear();
 	weights.clear();
 	partitions.clear();
+	skin.clear();
+	bonePalette.clear();
+	bindSphereVerts.clear();
+	boneNodeCache.clear();
+	boneNodeRevision = -1;
 	sortedTriangles.clear();
 	indices.clear();
 	transVerts.clear();
@@ -88,6 +93,8 @@ void Mesh::clear()
 	transTangents.clear();
 	transBitangents.clear();
 
+	clearBuffers();
+
 	isLOD = false;
 	isDoubleSided = false;
 }
@@ -176,14 +183,13 @@ void Shape::updateShaderProperties( const NifModel * nif )
 
 void Shape::boneSphere( const NifModel * nif, const QModelIndex & index ) const
 {
-	Node * root = findParent( 0 );
-	Node * bone = root ? root->findChild( bones.value( index.row() ) ) : 0;
+	Node * bone = boneNodes( 0 ).value( index.row() );
 	if ( !bone )
 		return;
 
 	Transform boneT = Transform( nif, index );
 	Transform t = (scene->options & Scene::DoSkinning) ? viewTrans() : Transform();
-	t = t * skeletonTrans * bone->localTrans( 0 ) * boneT;
+	t = t * skeletonTrans * scene->rootTrans( bone, 0 ) * boneT;
 
 	auto bSphere = BoundSphere( nif, nif->getIndex( index, "Bounding Sphere" ) );
 	if ( bSphere.radius > 0.0 ) {
@@ -193,6 +199,147 @@ void Shape::boneSphere( const NifModel * nif, const QModelIndex & index ) const
 	}
 }
 
+const QVector<Node *> & Shape::boneNodes( int root ) const
+{
+	if ( boneNodeRevision != scene->hierarchyRevision ) {
+		boneNodeCache.clear();
+		boneNodeRevision = scene->hierarchyRevision;
+	}
+
+	auto it = boneNodeCache.find( root );
+	if ( it != boneNodeCache.end() )
+		return it.value();
+
+	Node * parent = findParent( root );
+
+	QVector<Node *> & nodes = boneNodeCache[root];
+	nodes.resize( bones.count() );
+	for ( int b = 0; b < bones.count(); b++ )
+		nodes[b] = parent ? parent->findChild( bones[b] ) : nullptr;
+
+	return nodes;
+}
+
+void Shape::clearBuffers()
+{
+	vertexBuffer.clear();
+	normalBuffer.clear();
+	tangentBuffer.clear();
+	bitangentBuffer.clear();
+	colorBuffer.clear();
+	coordBuffers.clear();
+	triangleBuffer.clear();
+	stripBuffer.clear();
+}
+
+void Shape::bindVertexArrays( bool normals, bool colors )
+{
+	QOpenGLFunctions * fn = scene->renderer->fn;
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, 0, vertexBuffer.bind( fn, transVerts ) );
+
+	if ( normals ) {
+		glEnableClientState( GL_NORMAL_ARRAY );
+		glNormalPointer( GL_FLOAT, 0, normalBuffer.bind( fn, transNorms ) );
+	}
+
+	if ( colors ) {
+		glEnableClientState( GL_COLOR_ARRAY );
+		glColorPointer( 4, GL_FLOAT, 0, colorBuffer.bind( fn, transColors ) );
+	}
+
+	// The pointers keep their buffers; the texcoord arrays set up by the properties are client side
+	GLBuffer::unbind( fn, GL_ARRAY_BUFFER );
+}
+
+void Shape::drawTriangles( const QVector<Triangle> & tris, int first, int count )
+{
+	first = qBound( 0, first, tris.count() );
+	count = ( count < 0 ) ? tris.count() - first : qMin( count, tris.count() - first );
+	if ( count <= 0 )
+		return;
+
+	QOpenGLFunctions * fn = scene->renderer->fn;
+
+	quintptr ptr = quintptr( triangleBuffer.bind( fn, tris ) ) + first * sizeof( Triangle );
+	glDrawElements( GL_TRIANGLES, count * 3, GL_UNSIGNED_SHORT, reinterpret_cast<const void *>( ptr ) );
+
+	GLBuffer::unbind( fn, GL_ELEMENT_ARRAY_BUFFER );
+}
+
+GLArrayBuffer<Vector2> & Shape::coordBuffer( int set )
+{
+	if ( int( coordBuffers.size() ) <= set )
+		coordBuffers.resize( set + 1 );
+
+	return coordBuffers[set];
+}
+
+void Shape::skinShape( const QVector<Transform> & palette )
+{
+	int vcnt = verts.count();
+
+	if ( skin.isEmpty( vcnt ) ) {
+		if ( partitions.count() )
+			skin.setPartitions( partitions, vcnt );
+		else
+			skin.setWeights( weights, vcnt );
+
+		gpuSkinFailed = false;
+	}
+
+	bonePalette = palette;
+	gpuSkinned = canSkinOnGpu();
+
+	if ( !gpuSkinned ) {
+		skinOnCpu();
+		boundSphere = BoundSphere( transVerts );
+		return;
+	}
+
+	// The vertex shader skins the bind pose
+	transVerts = verts;
+	transNorms = norms;
+	transTangents = tangents;
+	transBitangents = bitangents;
+
+	if ( bindSphereVerts.constData() != verts.constData() ) {
+		bindSphereVerts = verts;
+		bindSphere = BoundSphere( verts );
+	}
+
+	// A skinned vertex is a blend of its positions under each of its bones
+	boundSphere = BoundSphere();
+	for ( const Transform & t : palette )
+		boundSphere |= t * bindSphere;
+}
+
+void Shape::skinOnCpu()
+{
+	gpuSkinned = false;
+
+	skin.transform( bonePalette, verts, norms, tangents, bitangents,
+					transVerts, transNorms, transTangents, transBitangents );
+}
+
+bool Shape::canSkinOnGpu() const
+{
+	if ( gpuSkinFailed || !scene->renderer->hasGpuSkinning() )
+		return false;
+
+	if ( (scene->options & Scene::DisableShaders) || (scene->visMode & Scene::VisSilhouette)
+		 || (scene->selMode & Scene::SelVertex) )
+		return false;
+
+	// The selection highlight draws the transformed vertices
+	auto blk = scene->currentBlock;
+	if ( blk == iBlock || blk == iData || blk == iSkin || blk == iSkinData || blk == iSkinPart )
+		return false;
+
+	return skin.packedBones.count() == verts.count() && bonePalette.count() <= SKIN_GPU_BONES;
+}
+
 void Mesh::update( const NifModel * nif, const QModelIndex & index )
 {
 	Shape::update( nif, index );
@@ -782,6 +929,8 @@ void Mesh::transform()
 		isSkinned = false;
 		weights.clear();
 		partitions.clear();
+		skin.clear();
+		boneNodeRevision = -1;
 
 		iSkinData = nif->getBlock( nif->getLink( iSkin, "Data" ), "NiSkinData" );
 		iSkinPart = nif->getBlock( nif->getLink( iSkin, "Skin Partition" ), "NiSkinPartition" );
@@ -847,104 +996,42 @@ void Mesh::transformShapes()
 	if ( isSkinned && doSkinning ) {
 		transformRigid = false;
 
-		int vcnt = verts.count();
-		int ncnt = norms.count();
-		int tcnt = tangents.count();
-		int bcnt = bitangents.count();
-
-		transVerts.resize( vcnt );
-		transVerts.fill( Vector3() );
-		transNorms.resize( vcnt );
-		transNorms.fill( Vector3() );
-		transTangents.resize( vcnt );
-		transTangents.fill( Vector3() );
-		transBitangents.resize( vcnt );
-		transBitangents.fill( Vector3() );
-
-		Node * root = findParent( skeletonRoot );
+		// Bones are looked up once per hierarchy change, their transforms once per frame
+		const QVector<Node *> & boneList = boneNodes( skeletonRoot );
+		QVector<Transform> palette;
 
 		if ( partitions.count() ) {
-			for ( const SkinPartition& part : partitions ) {
-				QVector<Transform> boneTrans( part.boneMap.count() );
-
-				for ( int t = 0; t < boneTrans.count(); t++ ) {
-					Node * bone = root ? root->findChild( bones.value( part.boneMap[t] ) ) : 0;
-					boneTrans[ t ] = scene->view;
-
-					if ( bone )
-						boneTrans[ t ] = boneTrans[ t ] * bone->localTrans( skeletonRoot ) * weights.value( part.boneMap[t] ).trans;
-
-					//if ( bone ) boneTrans[ t ] = bone->viewTrans() * weights.value( part.boneMap[t] ).trans;
-				}
-
-				for ( int v = 0; v < part.vertexMap.count(); v++ ) {
-					int vindex = part.vertexMap[ v ];
-					if ( vindex < 0 || vindex >= vcnt )
-						break;
+			palette.resize( bones.count() );
 
-					if ( transVerts[vindex] == Vector3() ) {
-						for ( int w = 0; w < part.numWeightsPerVertex; w++ ) {
-							QPair<int, float> weight = part.weights[ v * part.numWeightsPerVertex + w ];
+			for ( int b = 0; b < bones.count(); b++ ) {
+				Node * bone = boneList[b];
+				palette[b] = scene->view;
 
-
-							Transform trans = boneTrans.value( weight.first );
-
-							if ( vcnt > vindex )
-								transVerts[vindex] += trans * verts[vindex] * weight.second;
-							if ( ncnt > vindex )
-								transNorms[vindex] += trans.rotation * norms[vindex] * weight.second;
-							if ( tcnt > vindex )
-								transTangents[vindex] += trans.rotation * tangents[vindex] * weight.second;
-							if ( bcnt > vindex )
-								transBitangents[vindex] += trans.rotation * bitangents[vindex] * weight.second;
-						}
-					}
-				}
+				if ( bone )
+					palette[b] = palette[b] * scene->rootTrans( bone, skeletonRoot ) * weights.value( b ).trans;
 			}
 		} else {
-			int x = 0;
-			for ( const BoneWeights& bw : weights ) {
-				Transform trans = viewTrans() * skeletonTrans;
-				Node * bone = root ? root->findChild( bw.bone ) : 0;
+			palette.resize( weights.count() );
 
-				if ( bone )
-					trans = trans * bone->localTrans( skeletonRoot ) * bw.trans;
+			for ( int b = 0; b < weights.count(); b++ ) {
+				BoneWeights & bw = weights[b];
+				Node * bone = boneList.value( b );
+				palette[b] = viewTrans() * skeletonTrans;
 
-				if ( bone )
-					weights[x++].tcenter = bone->viewTrans() * bw.center;
-				else
-					x++;
-
-				for ( const VertexWeight& vw : bw.weights ) {
-					int vindex = vw.vertex;
-					if ( vindex < 0 || vindex >= vcnt )
-						break;
-
-					if ( vcnt > vindex )
-						transVerts[vindex] += trans * verts[vindex] * vw.weight;
-					if ( ncnt > vindex )
-						transNorms[vindex] += trans.rotation * norms[vindex] * vw.weight;
-					if ( tcnt > vindex )
-						transTangents[vindex] += trans.rotation * tangents[vindex] * vw.weight;
-					if ( bcnt > vindex )
-						transBitangents[vindex] += trans.rotation * bitangents[vindex] * vw.weight;
+				if ( bone ) {
+					palette[b] = palette[b] * scene->rootTrans( bone, skeletonRoot ) * bw.trans;
+					bw.tcenter = bone->viewTrans() * bw.center;
 				}
 			}
 		}
 
-		for ( int n = 0; n < transNorms.count(); n++ )
-			transNorms[n].normalize();
-
-		for ( int t = 0; t < transTangents.count(); t++ )
-			transTangents[t].normalize();
+		skinShape( palette );
 
-		for ( int t = 0; t < transBitangents.count(); t++ )
-			transBitangents[t].normalize();
-
-		boundSphere = BoundSphere( transVerts );
 		boundSphere.applyInv( viewTrans() );
 		updateBounds = false;
 	} else {
+		gpuSkinned = false;
+
 		transVerts = verts;
 		transNorms = norms;
 		transTangents = tangents;
@@ -1039,14 +1126,15 @@ void Mesh::drawShapes( NodeList * secondPass, bool presort )
 	glEnable( GL_POLYGON_OFFSET_FILL );
 	glPolygonOffset( 1.0f, 2.0f );
 
-	glEnableClientState( GL_VERTEX_ARRAY );
-	glVertexPointer( 3, GL_FLOAT, 0, transVerts.constData() );
+	// The selection pass draws without shaders
+	if ( Node::SELECTING && gpuSkinned )
+		skinOnCpu();
+
+	bool doNormals = false;
+	bool doColors = false;
 
 	if ( !Node::SELECTING ) {
-		if ( transNorms.count() ) {
-			glEnableClientState( GL_NORMAL_ARRAY );
-			glNormalPointer( GL_FLOAT, 0, transNorms.constData() );
-		}
+		doNormals = transNorms.count();
 
 		// Do VCs if legacy or if either bslsp or bsesp is set
 		bool doVCs = (!bssp) || (bssp && (bssp->getFlags2() & ShaderFlags::SLSF2_Vertex_Colors));
@@ -1055,8 +1143,7 @@ void Mesh::drawShapes( NodeList * secondPass, bool presort )
 			&& ( scene->options & Scene::DoVertexColors )
 			&& doVCs )
 		{
-			glEnableClientState( GL_COLOR_ARRAY );
-			glColorPointer( 4, GL_FLOAT, 0, transColors.constData() );
+			doColors = true;
 		} else {
 			if ( !hasVertexColors && (bslsp && bslsp->hasVertexColors) ) {
 				// Correctly blacken the mesh if SLSF2_Vertex_Colors is still on
@@ -1068,48 +1155,51 @@ void Mesh::drawShapes( NodeList * secondPass, bool presort )
 		}
 	}
 
+	bindVertexArrays( doNormals, doColors );
+
 	// TODO: Hotspot.  See about optimizing this.
-	if ( !Node::SELECTING )
+	if ( !Node::SELECTING ) {
 		shader = scene->renderer->setupProgram( this, shader );
 
+		// No skinned program took the shape; skin it on the CPU from now on
+		if ( gpuSkinned && shader.isEmpty() ) {
+			gpuSkinFailed = true;
+			skinOnCpu();
+			bindVertexArrays( doNormals, doColors );
+			shader = scene->renderer->setupProgram( this, QString( "" ) );
+		}
+	}
+
 	if ( isDoubleSided ) {
 		glDisable( GL_CULL_FACE );
 	}
 
 	if ( !isLOD ) {
 		// render the triangles
-		if ( sortedTriangles.count() )
-			glDrawElements( GL_TRIANGLES, sortedTriangles.count() * 3, GL_UNSIGNED_SHORT, sortedTriangles.constData() );
+		drawTriangles( sortedTriangles );
 
 	} else if ( sortedTriangles.count() ) {
-		auto lod0 = nif->get<uint>( iBlock, "LOD0 Size" );
-		auto lod1 = nif->get<uint>( iBlock, "LOD1 Size" );
-		auto lod2 = nif->get<uint>( iBlock, "LOD2 Size" );
-
-		auto lod0tris = sortedTriangles.mid( 0, lod0 );
-		auto lod1tris = sortedTriangles.mid( lod0, lod1 );
-		auto lod2tris = sortedTriangles.mid( lod0 + lod1, lod2 );
+		int lod0 = nif->get<uint>( iBlock, "LOD0 Size" );
+		int lod1 = nif->get<uint>( iBlock, "LOD1 Size" );
+		int lod2 = nif->get<uint>( iBlock, "LOD2 Size" );
 
 		// If Level2, render all
 		// If Level1, also render Level0
 		switch ( scene->lodLevel ) {
 		case Scene::Level2:
-			if ( lod2tris.count() )
-				glDrawElements( GL_TRIANGLES, lod2tris.count() * 3, GL_UNSIGNED_SHORT, lod2tris.constData() );
+			drawTriangles( sortedTriangles, lod0 + lod1, lod2 );
 		case Scene::Level1:
-			if ( lod1tris.count() )
-				glDrawElements( GL_TRIANGLES, lod1tris.count() * 3, GL_UNSIGNED_SHORT, lod1tris.constData() );
+			drawTriangles( sortedTriangles, lod0, lod1 );
 		case Scene::Level0:
 		default:
-			if ( lod0tris.count() )
-				glDrawElements( GL_TRIANGLES, lod0tris.count() * 3, GL_UNSIGNED_SHORT, lod0tris.constData() );
+			drawTriangles( sortedTriangles, 0, lod0 );
 			break;
 		}
 	}
 
 	// render the tristrips
-	for ( auto & s : tristrips )
-		glDrawElements( GL_TRIANGLE_STRIP, s.count(), GL_UNSIGNED_SHORT, s.constData() );
+	if ( tristrips.count() )
+		stripBuffer.draw( scene->renderer->fn, tristrips );
 
 	if ( isDoubleSided ) {
 		glEnable( GL_CULL_FACE );
@@ -34,12 +34,17 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define GLMESH_H
 
 #include "gl/glnode.h" // Inherited
+#include "gl/glbuffer.h"
+#include "gl/glskin.h"
 #include "gl/gltools.h"
 
+#include <QHash>
 #include <QPersistentModelIndex>
 #include <QVector>
 #include <QString>
 
+#include <vector>
+
 
 //! @file glmesh.h Mesh
 
@@ -75,6 +80,29 @@ protected:
 
 	void boneSphere( const NifModel * nif, const QModelIndex & index ) const;
 
+	//! The nodes of bones found under the ancestor \a root, looked up again only when the hierarchy changes
+	const QVector<Node *> & boneNodes( int root ) const;
+
+	//! Releases the buffer objects, e.g. when the geometry is cleared
+	void clearBuffers();
+	//! Sets the vertex, normal and color pointers to the enabled arrays' buffers
+	void bindVertexArrays( bool normals, bool colors );
+	//! Draws count triangles of tris starting at first, clamped like QVector::mid()
+	void drawTriangles( const QVector<Triangle> & tris, int first = 0, int count = -1 );
+	//! The buffer mirroring coords[set]
+	GLArrayBuffer<Vector2> & coordBuffer( int set );
+
+	/*! Skins the shape against the bone transforms of this frame
+	 *
+	 * Leaves the skinning to the vertex shader if the renderer can take it,
+	 * otherwise transforms the arrays on the CPU. Sets the view space bounds.
+	 */
+	void skinShape( const QVector<Transform> & palette );
+	//! Skins the arrays on the CPU against the bone transforms of this frame
+	void skinOnCpu();
+	//! Whether the vertex shader can skin the shape this frame
+	bool canSkinOnGpu() const;
+
 	int nifVersion = 0;
 
 	//! Shape data
@@ -125,6 +153,13 @@ protected:
 	//! Transformed bitangents
 	QVector<Vector3> transBitangents;
 
+	//! Buffer objects mirroring the arrays above; only changed arrays are uploaded
+	GLArrayBuffer<Vector3> vertexBuffer, normalBuffer, tangentBuffer, bitangentBuffer;
+	GLArrayBuffer<Color4> colorBuffer;
+	std::vector<GLArrayBuffer<Vector2>> coordBuffers;
+	GLArrayBuffer<Triangle> triangleBuffer{ GL_ELEMENT_ARRAY_BUFFER };
+	GLStripBuffer stripBuffer;
+
 	//! Does the skin data need updating?
 	bool updateSkin = false;
 	//! Toggle for skinning
@@ -133,8 +168,23 @@ protected:
 	int skeletonRoot = 0;
 	Transform skeletonTrans;
 	QVector<int> bones;
+	//! Cached lookup of bones by root, as skinning and bone spheres search from different roots; see boneNodes()
+	mutable QHash<int, QVector<Node *>> boneNodeCache;
+	mutable int boneNodeRevision = -1;
 	QVector<BoneWeights> weights;
 	QVector<SkinPartition> partitions;
+	//! The weights or partitions flattened for skinning
+	SkinWeights skin;
+	//! Bone transforms of this frame, indexed by the skin's palette indices
+	QVector<Transform> bonePalette;
+	//! Is the shape skinned by the vertex shader this frame?
+	bool gpuSkinned = false;
+	//! Did no skinned shader program take the shape?
+	bool gpuSkinFailed = false;
+	//! Bounds of the untransformed vertices, and the vertices they were taken from
+	BoundSphere bindSphere;
+	QVector<Vector3> bindSphereVerts;
+	GLArrayBuffer<Vector4> boneIndexBuffer, boneWeightBuffer;
 
 	//! Holds the name of the shader, or "" if no shader
 	QString shader = "";
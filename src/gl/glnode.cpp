@@ -313,6 +313,8 @@ void Node::update( const NifModel * nif, const QModelIndex & index )
 
 		properties = newProps;
 
+		scene->hierarchyRevision++;
+
 		children.clear();
 		QModelIndex iChildren = nif->getIndex( iBlock, "Children" );
 		QList<qint32> lChildren = nif->getChildLinks( nif->getBlockNumber( iBlock ) );
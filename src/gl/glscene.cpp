@@ -121,6 +121,9 @@ void Scene::clear( bool flushTextures )
 	//if ( flushTextures )
 	textures->flush();
 
+	hierarchyRevision++;
+	rootTransforms.clear();
+
 	sceneBoundsValid = timeBoundsValid = false;
 }
 
@@ -154,6 +157,8 @@ void Scene::update( const NifModel * nif, const QModelIndex & index )
 			p->update( nif, QModelIndex() );
 		}
 
+		hierarchyRevision++;
+
 		roots.clear();
 		for ( const auto link : nif->getRootLinks() ) {
 			QModelIndex iBlock = nif->getBlock( link );
@@ -311,6 +316,9 @@ void Scene::transform( const Transform & trans, float time )
 	viewTrans.clear();
 	bhkBodyTrans.clear();
 
+	for ( RootTransforms & r : rootTransforms )
+		r.valid.fill( false );
+
 	for ( Property * prop : properties.list() ) {
 		prop->transform();
 	}
@@ -326,6 +334,35 @@ void Scene::transform( const Transform & trans, float time )
 	// TODO: purge unused textures
 }
 
+const Transform & Scene::rootTrans( const Node * node, int root ) const
+{
+	static const Transform identity;
+
+	int id = node->id();
+	if ( id == root || id < 0 )
+		return identity;
+
+	RootTransforms & cache = rootTransforms[root];
+	if ( id < cache.valid.size() && cache.valid.testBit( id ) )
+		return cache.trans[id];
+
+	Transform t = node->localTrans();
+
+	Node * parent = node->parentNode();
+	if ( parent )
+		t = rootTrans( parent, root ) * t;
+
+	// The parent lookup may have grown the arrays, so only index them now
+	if ( id >= cache.valid.size() ) {
+		cache.trans.resize( id + 1 );
+		cache.valid.resize( id + 1 );
+	}
+
+	cache.trans[id] = t;
+	cache.valid.setBit( id );
+	return cache.trans[id];
+}
+
 void Scene::draw()
 {
 	drawShapes();
@@ -454,12 +491,22 @@ float Scene::timeMax() const
 
 QString Scene::textStats()
 {
+	QString stats;
 	for ( Node * node : nodes.list() ) {
 		if ( node->index() == currentBlock ) {
-			return node->textStats();
+			stats = node->textStats();
+			break;
 		}
 	}
-	return QString();
+
+	stats += QString( "\ntextures %1 MB" ).arg( textures->usage() / 1048576.0, 0, 'f', 1 );
+	if ( textures->budget() > 0 )
+		stats += QString( " / %1 MB" ).arg( textures->budget() / 1048576 );
+
+	// Reset by GLView at the start of every frame
+	stats += QString( "\ngeometry uploads %1 MB" ).arg( GLBuffer::uploadedBytes() / 1048576.0, 0, 'f', 1 );
+
+	return stats;
 }
 
 int Scene::bindTexture( const QString & fname )
@@ -37,6 +37,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "glproperty.h"
 #include "gltools.h"
 
+#include <QBitArray>
 #include <QFlags>
 #include <QObject>
 #include <QHash>
@@ -161,6 +162,12 @@ public:
 	mutable QHash<int, Transform> viewTrans;
 	mutable QHash<int, Transform> bhkBodyTrans;
 
+	//! Node transform relative to the ancestor \a root; see Node::localTrans( int )
+	const Transform & rootTrans( const Node * node, int root ) const;
+
+	//! Bumped whenever node links are re-read, invalidating cached bone lookups
+	int hierarchyRevision = 0;
+
 	Transform view;
 
 	bool animate;
@@ -196,6 +203,14 @@ protected:
 	mutable BoundSphere bndSphere;
 	mutable float tMin = 0, tMax = 0;
 
+	//! Flat per-frame cache of node transforms relative to one root, indexed by node id
+	struct RootTransforms
+	{
+		QVector<Transform> trans;
+		QBitArray valid;
+	};
+	mutable QHash<int, RootTransforms> rootTransforms;
+
 	void updateTimeBounds() const;
 };
 
@@ -0,0 +1,353 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#include "glskin.h"
+
+#include "gl/gltools.h"
+
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SKIN_SSE2
+#include <emmintrin.h>
+#endif
+
+
+//! @file glskin.cpp SkinWeights
+
+//! Vertices per thread below which a shape is not split any further
+#define SKIN_CHUNK_VERTS 4096
+
+void SkinWeights::clear()
+{
+	vertexCount = 0;
+	influences = 0;
+	bones.clear();
+	weights.clear();
+	packedBones.clear();
+	packedWeights.clear();
+}
+
+void SkinWeights::setWeights( const QVector<BoneWeights> & boneWeights, int vcnt )
+{
+	clear();
+
+	QVector<int> count( vcnt, 0 );
+	for ( const BoneWeights & bw : boneWeights ) {
+		for ( const VertexWeight & vw : bw.weights ) {
+			if ( vw.vertex >= 0 && vw.vertex < vcnt )
+				influences = std::max( influences, ++count[vw.vertex] );
+		}
+	}
+
+	vertexCount = vcnt;
+	bones.fill( 0, vcnt * influences );
+	weights.fill( 0.0f, vcnt * influences );
+
+	count.fill( 0 );
+	for ( int b = 0; b < boneWeights.count(); b++ ) {
+		for ( const VertexWeight & vw : boneWeights[b].weights ) {
+			if ( vw.vertex < 0 || vw.vertex >= vcnt )
+				continue;
+
+			int i = vw.vertex * influences + count[vw.vertex]++;
+			bones[i] = quint16( b );
+			weights[i] = vw.weight;
+		}
+	}
+
+	pack();
+}
+
+void SkinWeights::setPartitions( const QVector<SkinPartition> & partitions, int vcnt )
+{
+	clear();
+
+	for ( const SkinPartition & part : partitions )
+		influences = std::max( influences, part.numWeightsPerVertex );
+
+	vertexCount = vcnt;
+	bones.fill( 0, vcnt * influences );
+	weights.fill( 0.0f, vcnt * influences );
+
+	QVector<bool> done( vcnt, false );
+	for ( const SkinPartition & part : partitions ) {
+		for ( int v = 0; v < part.vertexMap.count(); v++ ) {
+			int vindex = part.vertexMap[v];
+			if ( vindex < 0 || vindex >= vcnt || done[vindex] )
+				continue;
+
+			done[vindex] = true;
+
+			for ( int w = 0; w < part.numWeightsPerVertex; w++ ) {
+				const QPair<int, float> & weight = part.weights.at( v * part.numWeightsPerVertex + w );
+				if ( weight.first < 0 || weight.first >= part.boneMap.count() )
+					continue;
+
+				int i = vindex * influences + w;
+				bones[i] = quint16( part.boneMap[weight.first] );
+				weights[i] = weight.second;
+			}
+		}
+	}
+
+	pack();
+}
+
+void SkinWeights::pack()
+{
+	if ( influences > 4 )
+		return;
+
+	packedBones.fill( Vector4(), vertexCount );
+	packedWeights.fill( Vector4(), vertexCount );
+
+	for ( int v = 0; v < vertexCount; v++ ) {
+		for ( int i = 0; i < influences; i++ ) {
+			packedBones[v][i] = bones[v * influences + i];
+			packedWeights[v][i] = weights[v * influences + i];
+		}
+	}
+}
+
+namespace
+{
+
+//! A bone transform as columns; positions use the scaled rotation, directions the plain one
+struct SkinMatrix
+{
+	float m[4][4];
+	float r[3][4];
+};
+
+//! The arrays of one skinning pass
+struct SkinPass
+{
+	const SkinWeights * skin;
+	const SkinMatrix * palette;
+	int paletteSize;
+
+	const Vector3 * in[4];
+	int inCount[4];
+	Vector3 * out[4];
+};
+
+SkinMatrix toSkinMatrix( const Transform & t )
+{
+	SkinMatrix s = {};
+
+	for ( int c = 0; c < 3; c++ ) {
+		for ( int r = 0; r < 3; r++ ) {
+			s.m[c][r] = t.rotation( r, c ) * t.scale;
+			s.r[c][r] = t.rotation( r, c );
+		}
+	}
+
+	for ( int r = 0; r < 3; r++ )
+		s.m[3][r] = t.translation[r];
+
+	return s;
+}
+
+#ifdef SKIN_SSE2
+
+inline void store3( Vector3 & v, __m128 x )
+{
+	alignas(16) float f[4];
+	_mm_store_ps( f, x );
+	v = Vector3( f[0], f[1], f[2] );
+}
+
+inline __m128 mul3( const __m128 * c, const Vector3 & v )
+{
+	__m128 x = _mm_mul_ps( c[0], _mm_set1_ps( v[0] ) );
+	x = _mm_add_ps( x, _mm_mul_ps( c[1], _mm_set1_ps( v[1] ) ) );
+	return _mm_add_ps( x, _mm_mul_ps( c[2], _mm_set1_ps( v[2] ) ) );
+}
+
+void skinRange( const SkinPass & p, int first, int last )
+{
+	const int n = p.skin->influences;
+	const quint16 * bones = p.skin->bones.constData();
+	const float * weights = p.skin->weights.constData();
+
+	for ( int v = first; v < last; v++ ) {
+		// Blend the bone matrices, then transform each attribute once
+		__m128 m[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+		__m128 r[3] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+
+		for ( int i = v * n; i < (v + 1) * n; i++ ) {
+			if ( weights[i] == 0.0f || bones[i] >= p.paletteSize )
+				continue;
+
+			const SkinMatrix & b = p.palette[bones[i]];
+			__m128 w = _mm_set1_ps( weights[i] );
+
+			for ( int c = 0; c < 4; c++ )
+				m[c] = _mm_add_ps( m[c], _mm_mul_ps( w, _mm_loadu_ps( b.m[c] ) ) );
+			for ( int c = 0; c < 3; c++ )
+				r[c] = _mm_add_ps( r[c], _mm_mul_ps( w, _mm_loadu_ps( b.r[c] ) ) );
+		}
+
+		if ( v < p.inCount[0] )
+			store3( p.out[0][v], _mm_add_ps( mul3( m, p.in[0][v] ), m[3] ) );
+
+		for ( int a = 1; a < 4; a++ ) {
+			if ( v < p.inCount[a] ) {
+				store3( p.out[a][v], mul3( r, p.in[a][v] ) );
+				p.out[a][v].normalize();
+			}
+		}
+	}
+}
+
+#else
+
+inline Vector3 mul3( const float c[][4], const Vector3 & v )
+{
+	return Vector3( c[0][0] * v[0] + c[1][0] * v[1] + c[2][0] * v[2],
+					c[0][1] * v[0] + c[1][1] * v[1] + c[2][1] * v[2],
+					c[0][2] * v[0] + c[1][2] * v[1] + c[2][2] * v[2] );
+}
+
+void skinRange( const SkinPass & p, int first, int last )
+{
+	const int n = p.skin->influences;
+	const quint16 * bones = p.skin->bones.constData();
+	const float * weights = p.skin->weights.constData();
+
+	for ( int v = first; v < last; v++ ) {
+		// Blend the bone matrices, then transform each attribute once
+		SkinMatrix s = {};
+
+		for ( int i = v * n; i < (v + 1) * n; i++ ) {
+			if ( weights[i] == 0.0f || bones[i] >= p.paletteSize )
+				continue;
+
+			const SkinMatrix & b = p.palette[bones[i]];
+			float w = weights[i];
+
+			for ( int c = 0; c < 4; c++ ) {
+				for ( int r = 0; r < 3; r++ )
+					s.m[c][r] += w * b.m[c][r];
+			}
+			for ( int c = 0; c < 3; c++ ) {
+				for ( int r = 0; r < 3; r++ )
+					s.r[c][r] += w * b.r[c][r];
+			}
+		}
+
+		if ( v < p.inCount[0] )
+			p.out[0][v] = mul3( s.m, p.in[0][v] ) + Vector3( s.m[3][0], s.m[3][1], s.m[3][2] );
+
+		for ( int a = 1; a < 4; a++ ) {
+			if ( v < p.inCount[a] )
+				p.out[a][v] = mul3( s.r, p.in[a][v] ).normalize();
+		}
+	}
+}
+
+#endif
+
+class SkinJob final : public QRunnable
+{
+public:
+	SkinJob( const SkinPass & pass, int first, int last, QSemaphore * done )
+		: pass( pass ), first( first ), last( last ), done( done )
+	{
+	}
+
+	void run() override
+	{
+		skinRange( pass, first, last );
+		done->release();
+	}
+
+private:
+	const SkinPass & pass;
+	int first, last;
+	QSemaphore * done;
+};
+
+QThreadPool * skinPool()
+{
+	static QThreadPool pool;
+	return &pool;
+}
+
+}
+
+void SkinWeights::transform( const QVector<Transform> & palette,
+							 const QVector<Vector3> & verts, const QVector<Vector3> & norms,
+							 const QVector<Vector3> & tangents, const QVector<Vector3> & bitangents,
+							 QVector<Vector3> & transVerts, QVector<Vector3> & transNorms,
+							 QVector<Vector3> & transTangents, QVector<Vector3> & transBitangents ) const
+{
+	std::vector<SkinMatrix> matrices( palette.count() );
+	for ( int b = 0; b < palette.count(); b++ )
+		matrices[b] = toSkinMatrix( palette[b] );
+
+	const QVector<Vector3> * in[4] = { &verts, &norms, &tangents, &bitangents };
+	QVector<Vector3> * out[4] = { &transVerts, &transNorms, &transTangents, &transBitangents };
+
+	SkinPass pass;
+	pass.skin = this;
+	pass.palette = matrices.data();
+	pass.paletteSize = palette.count();
+
+	for ( int a = 0; a < 4; a++ ) {
+		out[a]->resize( vertexCount );
+		out[a]->fill( Vector3() );
+
+		pass.in[a] = in[a]->constData();
+		pass.inCount[a] = std::min( in[a]->count(), vertexCount );
+		pass.out[a] = out[a]->data();
+	}
+
+	int jobs = std::min( std::max( QThread::idealThreadCount(), 1 ), vertexCount / SKIN_CHUNK_VERTS + 1 );
+	int chunk = (vertexCount + jobs - 1) / std::max( jobs, 1 );
+
+	// The calling thread takes the first range itself
+	QSemaphore done;
+	for ( int j = 1; j < jobs; j++ )
+		skinPool()->start( new SkinJob( pass, j * chunk, std::min( (j + 1) * chunk, vertexCount ), &done ) );
+
+	skinRange( pass, 0, std::min( chunk, vertexCount ) );
+
+	done.acquire( jobs - 1 );
+}
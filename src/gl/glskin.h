@@ -0,0 +1,103 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#ifndef GLSKIN_H
+#define GLSKIN_H
+
+#include "data/niftypes.h"
+
+#include <QVector>
+
+
+//! @file glskin.h SkinWeights
+
+//! Size of the bone palette of the skinned vertex shaders, boneTransforms[]
+#define SKIN_GPU_BONES 100
+
+class BoneWeights;
+class SkinPartition;
+
+/*! The bone influences of a skinned shape, flattened per vertex
+ *
+ * Bone indices and weights are kept in separate arrays with the same number of
+ * influences for every vertex, padded with zero weights, so that skinning walks
+ * them linearly. The bone indices refer to a palette of transforms which the
+ * shape resolves once per frame.
+ */
+class SkinWeights final
+{
+public:
+	void clear();
+
+	//! Whether the influences need to be gathered for vcnt vertices
+	bool isEmpty( int vcnt ) const { return vertexCount != vcnt || bones.isEmpty(); }
+
+	//! Gathers the influences listed per bone; the palette index is the position in weights
+	void setWeights( const QVector<BoneWeights> & weights, int vcnt );
+	/*! Gathers the influences of skin partitions; the palette index is the bone map entry
+	 *
+	 * A vertex found in several partitions is weighted by the first.
+	 */
+	void setPartitions( const QVector<SkinPartition> & partitions, int vcnt );
+
+	/*! Skins the vertices, normals, tangents and bitangents
+	 *
+	 * Each output is resized to the vertex count. Vertices without influences and
+	 * inputs shorter than the vertex count give zero vectors. Normals, tangents and
+	 * bitangents are normalized. Large shapes are split across threads.
+	 *
+	 * @param palette	The bone transforms
+	 */
+	void transform( const QVector<Transform> & palette,
+					const QVector<Vector3> & verts, const QVector<Vector3> & norms,
+					const QVector<Vector3> & tangents, const QVector<Vector3> & bitangents,
+					QVector<Vector3> & transVerts, QVector<Vector3> & transNorms,
+					QVector<Vector3> & transTangents, QVector<Vector3> & transBitangents ) const;
+
+	int vertexCount = 0;
+	//! The number of influences of each vertex
+	int influences = 0;
+	//! Palette index of each influence, vertexCount * influences
+	QVector<quint16> bones;
+	//! Weight of each influence, vertexCount * influences
+	QVector<float> weights;
+
+	//! Palette indices of four influences per vertex for the skinned shaders; empty if a vertex has more
+	QVector<Vector4> packedBones;
+	//! Weights of four influences per vertex for the skinned shaders
+	QVector<Vector4> packedWeights;
+
+private:
+	void pack();
+};
+
+#endif
@@ -35,24 +35,48 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "message.h"
 #include "gl/glscene.h"
 #include "gl/gltexloaders.h"
+#include "gl/gltexpaths.h"
+#include "io/material.h"
 #include "model/nifmodel.h"
 
 #include <fsengine/fsengine.h>
 #include <fsengine/fsmanager.h>
 
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QFileSystemWatcher>
 #include <QListView>
 #include <QOpenGLContext>
 #include <QOpenGLFunctions>
+#include <QPointer>
+#include <QRunnable>
+#include <QSet>
 #include <QSettings>
+#include <QTimer>
+#include <QVector>
+#include <QWaitCondition>
 
 #include <algorithm>
 
 
 //! @file gltex.cpp TexCache management
 
+//! Time per frame spent uploading prefetched textures which were not bound yet
+#define PREFETCH_UPLOAD_BUDGET_MS 8
+//! Time per frame spent uploading the larger mip levels of streamed textures
+#define STREAM_UPLOAD_BUDGET_MS 4
+//! DDS mip levels larger than this are uploaded after the first frame
+#define STREAM_FIRST_EXTENT 256
+//! Changes to watched directories within this time are reloaded together
+#define RELOAD_DELAY_MS 250
+//! The files of up to this many textures bound in the last frame are watched as well
+#define WATCH_BOUND_FILES 64
+//! How often the watched files follow the bound textures
+#define WATCH_BOUND_INTERVAL_MS 1000
+
 #ifdef WIN32
 PFNGLACTIVETEXTUREARBPROC glActiveTextureARB = nullptr;
 PFNGLCLIENTACTIVETEXTUREARBPROC glClientActiveTextureARB = nullptr;
@@ -144,142 +168,247 @@ void resetTextureUnits( int numTex )
  *  TexCache
  */
 
-TexCache::TexCache( QObject * parent ) : QObject( parent )
+/*! The textures of all caches in an OpenGL share group
+ *
+ * Entries are weak; a texture is deleted with the last cache which refers to it.
+ * The memory budget and the streaming of mip levels apply to the whole group.
+ */
+class TexCache::Store final : public QObject
 {
-	watcher = new QFileSystemWatcher( this );
-	connect( watcher, &QFileSystemWatcher::fileChanged, this, &TexCache::fileChanged );
-}
-
-TexCache::~TexCache()
+public:
+	//! The store of the share group of the current context
+	static Store * get();
+
+	//! The key of a resolved path; archive files are keyed by the archive they were read from
+	static QString key( const QString & filepath, bool archive );
+
+	~Store();
+
+	//! Creates a texture which removes itself from the store when deleted
+	std::shared_ptr<Tex> create( const QString & fname );
+	//! The texture stored under key, if any
+	std::shared_ptr<Tex> find( const QString & key );
+	//! Stores tx under key
+	void insert( const QString & key, const std::shared_ptr<Tex> & tx );
+	//! Whether the texture stored under key is uploaded and current; safe to call from worker threads
+	bool isCurrent( const QString & key );
+
+	//! Estimated video memory used by the stored textures in bytes
+	qint64 usage();
+	//! Upload the next mip level of the textures bound in the last frame
+	void streamLevels();
+	//! Release textures not bound in the last frame until the usage is within the budget
+	void evict();
+	//! Delete the GL texture of tx so that the next bind loads it again
+	static void release( Tex * tx );
+
+	//! Watches the directory of the file of tx, if it is writable
+	void watch( Tex * tx );
+	/*! Watches the files of recently bound textures in watched directories
+	 *
+	 * Directory watches miss files written in place on some platforms.
+	 */
+	void watchBound();
+
+	//! Advances when a cache begins its second frame within the current one
+	quint64 frame = 0;
+	//! See TexCache::setBudget()
+	qint64 budget = 0;
+	//! The caches using this store, refreshed when a mip level was streamed in
+	QList<TexCache *> caches;
+
+protected:
+	Store( QOpenGLContextGroup * group );
+
+	//! Removes the entry of key if its texture was deleted
+	void remove( const QString & key );
+	//! Stops watching the file of a deleted texture
+	void unwatch( const QString & key );
+	//! Marks the textures whose files changed in the changed directories for reloading
+	void reloadChanged();
+
+	//! The stores by share group; a store is deleted with its group
+	static QHash<QOpenGLContextGroup *, Store *> stores;
+
+	QOpenGLContextGroup * group;
+
+	//! Guards textures, which contains() reads from worker threads
+	QMutex mutex;
+	QHash<QString, std::weak_ptr<Tex>> textures;
+
+	//! Watches the directories of the watched files, and the files of recently bound textures
+	QFileSystemWatcher * watcher;
+	//! Starts reloadChanged() once the directories stop changing
+	QTimer * reloadTimer;
+	//! The watched files by directory, with their modification time when last loaded
+	QHash<QString, QHash<QString, QDateTime>> watched;
+	//! Directories which changed since the last reloadChanged()
+	QSet<QString> changedDirs;
+	//! Started by the last watchBound() which updated the file watches
+	QElapsedTimer watchBoundTimer;
+};
+
+QHash<QOpenGLContextGroup *, TexCache::Store *> TexCache::Store::stores;
+
+//! A texture resolved, read and decoded on a worker thread
+struct TexCache::Pending
 {
-	//flush();
-}
+	QString filename;
+	QString nifFolder;
+
+	//! The store of the cache, if it was known when the prefetch started
+	Store * store = nullptr;
+	//! Decode even if the texture is loaded by another cache
+	bool decode = false;
+
+	//! The resolved path
+	QString filepath;
+	//! The key of filepath in the store
+	QString key;
+	//! The file contents, if the texture is decoded during the upload
+	QByteArray data;
+	//! The decoded texture
+	gli::texture texture;
+	//! Not read or decoded because the store had the texture current; an empty result otherwise means a failed read
+	bool skipped = false;
+
+	QMutex mutex;
+	QWaitCondition finished;
+	bool ready = false;
+
+	bool isReady()
+	{
+		QMutexLocker lock( &mutex );
+		return ready;
+	}
 
-QString TexCache::find( const QString & file, const QString & nifdir )
-{
-	return find( file, nifdir, *(new QByteArray()) );
-}
+	void wait()
+	{
+		QMutexLocker lock( &mutex );
+		while ( !ready )
+			finished.wait( &mutex );
+	}
+};
 
-QString TexCache::find( const QString & file, const QString & nifdir, QByteArray & data )
+//! Resolves, reads and decodes one texture
+class TexCache::DecodeJob final : public QRunnable
 {
-	if ( file.isEmpty() )
-		return QString();
-
-	if ( QFile( file ).exists() )
-		return file;
+public:
+	DecodeJob( TexCache * cache, std::shared_ptr<Pending> pending ) : cache( cache ), pending( pending ) {}
 
-	QSettings settings;
-
-	QString filename = QDir::toNativeSeparators( file );
+	void run() override
+	{
+		QByteArray data;
+		QString filepath = TexCache::find( pending->filename, pending->nifFolder, data );
+		QString key = Store::key( filepath, !data.isEmpty() );
 
-	QStringList extensions;
-	extensions << ".dds";
-	bool replaceExt = false;
+		gli::texture texture;
+		bool skipped = false;
 
-	bool textureAlternatives = settings.value( "Settings/Resources/Alternate Extensions", false ).toBool();
-	if ( textureAlternatives ) {
-		extensions << ".tga" << ".bmp" << ".nif" << ".texcache";
-		for ( const QString ext : QStringList{ extensions } )
-		{
-			if ( filename.endsWith( ext, Qt::CaseInsensitive ) ) {
-				extensions.removeAll( ext );
-				extensions.prepend( ext );
-				filename = filename.left( filename.length() - ext.length() );
-				replaceExt = true;
-				break;
+		// A texture another cache has loaded is shared on upload instead
+		if ( !pending->decode && pending->store && pending->store->isCurrent( key ) ) {
+			data.clear();
+			skipped = true;
+		} else {
+			if ( data.isEmpty() ) {
+				QFile f( filepath );
+				if ( f.open( QIODevice::ReadOnly ) )
+					data = f.readAll();
 			}
-		}
-	}
 
-	// attempt to find the texture in one of the folders
-	QDir dir;
-	for ( const QString& ext : extensions ) {
-		if ( replaceExt ) {
-			filename += ext;
+			texture = texDecode( filepath, data );
+			if ( !texture.empty() )
+				data.clear();
 		}
 
-		auto appdir = QDir::currentPath();
-		
-		// First search NIF root
-		dir.setPath( nifdir );
-		if ( dir.exists( filename ) ) {
-			return dir.filePath( filename );
+		{
+			QMutexLocker lock( &pending->mutex );
+			pending->filepath = filepath;
+			pending->key = key;
+			pending->data = data;
+			pending->texture = texture;
+			pending->skipped = skipped;
+			pending->ready = true;
+			pending->finished.wakeAll();
 		}
 
-		// Next search NifSkope dir
-		dir.setPath( appdir );
-		if ( dir.exists( filename ) ) {
-			return dir.filePath( filename );
-		}
+		// Queued to the views; the cache waits for its jobs before it is destroyed
+		emit cache->sigRefresh();
+	}
 
-		
-		QStringList folders = settings.value( "Settings/Resources/Folders", QStringList() ).toStringList();
+private:
+	TexCache * cache;
+	std::shared_ptr<Pending> pending;
+};
 
-		for ( QString folder : folders ) {
-			// TODO: Always search nifdir without requiring a relative entry
-			// in folders?  Not too intuitive to require ".\" in your texture folder list
-			// even if it is added by default.
-			if ( folder.startsWith( "./" ) || folder.startsWith( ".\\" ) ) {
-				folder = nifdir + "/" + folder;
-			}
+//! Reads a BGSM/BGEM material and prefetches its textures
+class TexCache::MaterialJob final : public QRunnable
+{
+public:
+	MaterialJob( TexCache * cache, const QString & name, const QString & folder, int gen )
+		: cache( cache ), name( name ), folder( folder ), gen( gen )
+	{
+	}
 
-			dir.setPath( folder );
+	void run() override
+	{
+		std::unique_ptr<Material> material;
+		if ( name.endsWith( ".bgsm", Qt::CaseInsensitive ) )
+			material.reset( new ShaderMaterial( name ) );
+		else
+			material.reset( new EffectMaterial( name ) );
 
-			if ( dir.exists( filename ) ) {
-				filename = dir.filePath( filename );
-				filename = QDir::toNativeSeparators( filename );
-				return filename;
-			}
-		}
+		if ( !material->isValid() )
+			return;
 
-		// Search through archives last, and load any requested textures into memory.
-		for ( FSArchiveFile * archive : FSManager::archiveList() ) {
-			if ( archive ) {
-				filename = QDir::fromNativeSeparators( filename.toLower() );
-				if ( archive->hasFile( filename ) ) {
-					QByteArray outData;
-					archive->fileContents( filename, outData );
-
-					if ( !outData.isEmpty() ) {
-						data = outData;
-						filename = QDir::toNativeSeparators( filename );
-						return filename;
-					}
-				}
-			}
-		}
+		for ( const QString & file : material->textures() )
+			cache->startPrefetch( file, folder, gen );
+	}
 
-		// For Skyrim and FO4 which occasionally leave the textures off
-		if ( !filename.startsWith( "textures", Qt::CaseInsensitive ) ) {
-			QRegularExpression re( "textures[\\\\/]", QRegularExpression::CaseInsensitiveOption );
-			int texIdx = filename.indexOf( re );
-			if ( texIdx > 0 ) {
-				filename.remove( 0, texIdx );
-			} else {
-				while ( filename.startsWith( "/" ) || filename.startsWith( "\\" ) )
-					filename.remove( 0, 1 );
+private:
+	TexCache * cache;
+	QString name;
+	QString folder;
+	int gen;
+};
 
-				if ( !filename.startsWith( "textures", Qt::CaseInsensitive ) && !filename.startsWith( "shaders", Qt::CaseInsensitive ) )
-					filename.prepend( "textures\\" );
-			}
+TexCache::TexCache( QObject * parent ) : QObject( parent )
+{
+	// Views create their cache with their context current
+	if ( QOpenGLContext::currentContext() )
+		store();
+}
 
-			return find( filename, nifdir, data );
-		}
+TexCache::~TexCache()
+{
+	// Material jobs call back into the cache
+	pool.clear();
+	pool.waitForDone();
+	//flush();
 
-		if ( !replaceExt )
-			break;
+	if ( shared )
+		shared->caches.removeAll( this );
+}
 
-		// Remove file extension
-		filename = filename.left( filename.length() - ext.length() );
+TexCache::Store * TexCache::store()
+{
+	if ( !shared ) {
+		shared = Store::get();
+		shared->caches << this;
 	}
 
-	// Fix separators
-	filename = QDir::toNativeSeparators( filename );
+	return shared;
+}
 
-	if ( replaceExt )
-		return filename + extensions.value( 0 ); // Restore original file extension
+QString TexCache::find( const QString & file, const QString & nifdir )
+{
+	QByteArray data;
+	return find( file, nifdir, data );
+}
 
-	return filename;
+QString TexCache::find( const QString & file, const QString & nifdir, QByteArray & data )
+{
+	return TexturePaths::find( file, nifdir, data );
 }
 
 /*!
@@ -294,14 +423,7 @@ QString TexCache::stripPath( const QString & filepath, const QString & nifFolder
 	file = file.replace( "/", "\\" ).toLower();
 	QDir basePath;
 
-	QSettings settings;
-	QStringList folders = settings.value( "Settings/Resources/Folders", QStringList() ).toStringList();
-
-	for ( QString base : folders ) {
-		if ( base.startsWith( "./" ) || base.startsWith( ".\\" ) ) {
-			base = nifFolder + "/" + base;
-		}
-
+	for ( QString base : TexturePaths::folders( nifFolder ) ) {
 		basePath.setPath( base );
 		base = basePath.absolutePath();
 		base = base.replace( "/", "\\" ).toLower();
@@ -332,66 +454,105 @@ bool TexCache::isSupported( const QString & filePath )
 	return texIsSupported( filePath );
 }
 
-void TexCache::fileChanged( const QString & filepath )
+TexCache::Tex * TexCache::texture( const QString & fname )
 {
-	QMutableHashIterator<QString, Tex *> it( textures );
+	std::shared_ptr<Tex> & tx = textures[fname];
+	if ( !tx ) {
+		tx = store()->create( fname );
 
-	while ( it.hasNext() ) {
-		it.next();
+		if ( !isSupported( fname ) )
+			tx->id = 0xFFFFFFFF;
+	}
 
-		Tex * tx = it.value();
+	return tx.get();
+}
 
-		if ( tx && tx->filepath == filepath ) {
-			// Remove from watcher now to prevent multiple signals
-			watcher->removePath( tx->filepath );
-			if ( QFile::exists( tx->filepath ) ) {
-				tx->reload = true;
-				emit sigRefresh();
-			} else {
-				it.remove();
+TexCache::Tex * TexCache::share( const QString & fname, Tex * tx, const QString & key )
+{
+	// Already stored; it is reloaded in place
+	if ( !tx->key.isEmpty() )
+		return tx;
 
-				if ( tx->id )
-					glDeleteTextures( 1, &tx->id );
+	std::shared_ptr<Tex> & handle = textures[fname];
 
-				delete tx;
-			}
+	if ( std::shared_ptr<Tex> other = store()->find( key ) ) {
+		if ( !other->id || other->reload ) {
+			// Released or reloading elsewhere; the next load goes through this path
+			other->filepath = tx->filepath;
+			other->data = tx->data;
 		}
+
+		other->lastUsed = std::max( other->lastUsed, tx->lastUsed );
+		handle = other;
+		return other.get();
 	}
+
+	tx->key = key;
+	store()->insert( key, handle );
+	return tx;
 }
 
-int TexCache::bind( const QString & fname )
+int TexCache::upload( const QString & fname, Tex * tx, Pending * pending )
 {
-	Tex * tx = textures.value( fname );
-	if ( !tx ) {
-		tx = new Tex;
-		tx->filename = fname;
-		tx->id = 0;
-		tx->data = QByteArray();
-		tx->mipmaps = 0;
-		tx->reload  = false;
+	tx->filepath = pending->filepath;
+	tx = share( fname, tx, pending->key );
 
-		textures.insert( tx->filename, tx );
+	if ( tx->id && !tx->reload ) {
+		glBindTexture( tx->target ? tx->target : GL_TEXTURE_2D, tx->id );
+		return tx->mipmaps;
+	}
 
-		if ( !isSupported( fname ) )
-			tx->id = 0xFFFFFFFF;
+	if ( pending->skipped ) {
+		// Not decoded because another cache had the texture, which was released or marked for reloading since
+		if ( async ) {
+			startPrefetch( fname, nifFolder, -1, true );
+			return bindLoading( fname, tx );
+		}
+
+		tx->filepath = find( fname, nifFolder, tx->data );
+		tx->load();
+	} else {
+		tx->load( pending );
 	}
 
+	store()->watch( tx );
+	return tx->mipmaps;
+}
+
+int TexCache::bind( const QString & fname )
+{
+	Tex * tx = texture( fname );
+	tx->lastUsed = store()->frame;
+
 	if ( tx->id == 0xFFFFFFFF )
 		return 0;
 
+	if ( async && (!tx->id || tx->reload) )
+		return bindAsync( fname, tx );
+
+	if ( !tx->id && !tx->reload ) {
+		// Textures prefetched when the NIF was opened only need their upload
+		if ( std::shared_ptr<Pending> pending = takePrefetch( fname ) ) {
+			pending->wait();
+			return upload( fname, tx, pending.get() );
+		}
+	}
+
 	QByteArray outData;
 
 	if ( tx->filepath.isEmpty() || tx->reload )
-		tx->filepath = find( tx->filename, nifFolder, outData );
+		tx->filepath = find( fname, nifFolder, outData );
 
 	if ( !outData.isEmpty() || tx->reload ) {
 		tx->data = outData;
 	}
 
+	// Another view may have loaded the same file
+	if ( !tx->id || tx->reload )
+		tx = share( fname, tx, Store::key( tx->filepath, !tx->data.isEmpty() ) );
+
 	if ( !tx->id || tx->reload ) {
-		if ( QFile::exists( tx->filepath ) && QFileInfo( tx->filepath ).isWritable()
-			 && ( !watcher->files().contains( tx->filepath ) ) )
-			watcher->addPath( tx->filepath );
+		store()->watch( tx );
 
 		tx->load();
 	} else {
@@ -404,6 +565,217 @@ int TexCache::bind( const QString & fname )
 	return tx->mipmaps;
 }
 
+int TexCache::bindAsync( const QString & fname, Tex * tx )
+{
+	std::shared_ptr<Pending> pending = startPrefetch( fname, nifFolder, -1 );
+
+	if ( pending && pending->isReady() ) {
+		takePrefetch( fname );
+		return upload( fname, tx, pending.get() );
+	}
+
+	return bindLoading( fname, tx );
+}
+
+int TexCache::bindLoading( const QString & fname, Tex * tx )
+{
+	tx->status = QString( "loading" );
+
+	// A reloading texture keeps showing its previous image
+	if ( tx->id && tx->mipmaps ) {
+		glBindTexture( tx->target ? tx->target : GL_TEXTURE_2D, tx->id );
+		return tx->mipmaps;
+	}
+
+	return bindPlaceholder( fname );
+}
+
+int TexCache::bindPlaceholder( const QString & fname )
+{
+	QString base = QFileInfo( fname ).completeBaseName();
+	bool normal = base.endsWith( "_n", Qt::CaseInsensitive ) || base.endsWith( "_msn", Qt::CaseInsensitive );
+
+	GLuint & id = placeholders[normal ? 1 : 0];
+	if ( !id ) {
+		static const quint8 grey[4] = { 128, 128, 128, 255 };
+		static const quint8 flat[4] = { 128, 128, 255, 255 };
+
+		glGenTextures( 1, &id );
+		glBindTexture( GL_TEXTURE_2D, id );
+		glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, normal ? flat : grey );
+	} else {
+		glBindTexture( GL_TEXTURE_2D, id );
+	}
+
+	return 1;
+}
+
+void TexCache::prefetch( const NifModel * nif )
+{
+	QStringList materials;
+	QStringList files = texturePaths( nif, &materials );
+
+	int gen;
+	{
+		QMutexLocker lock( &prefetchMutex );
+		gen = generation;
+	}
+
+	for ( const QString & file : files ) {
+		if ( !textures.contains( file ) )
+			startPrefetch( file, nifFolder, gen );
+	}
+
+	for ( const QString & material : materials )
+		pool.start( new MaterialJob( this, material, nifFolder, gen ) );
+}
+
+std::shared_ptr<TexCache::Pending> TexCache::startPrefetch( const QString & fname, const QString & folder, int gen, bool decode )
+{
+	if ( fname.isEmpty() || !isSupported( fname ) )
+		return nullptr;
+
+	QMutexLocker lock( &prefetchMutex );
+	if ( gen >= 0 && gen != generation )
+		return nullptr;
+
+	std::shared_ptr<Pending> pending = prefetches.value( fname );
+	if ( pending )
+		return pending;
+
+	pending = std::make_shared<Pending>();
+	pending->store = shared;
+	pending->decode = decode;
+	pending->filename = fname;
+	pending->nifFolder = folder;
+	prefetches.insert( fname, pending );
+
+	pool.start( new DecodeJob( this, pending ) );
+
+	return pending;
+}
+
+std::shared_ptr<TexCache::Pending> TexCache::takePrefetch( const QString & fname )
+{
+	QMutexLocker lock( &prefetchMutex );
+	return prefetches.take( fname );
+}
+
+void TexCache::cancelPrefetch( const Tex * tx )
+{
+	QMutexLocker lock( &prefetchMutex );
+
+	for ( auto it = prefetches.begin(); it != prefetches.end(); ) {
+		const std::shared_ptr<Pending> & pending = it.value();
+
+		if ( textures.value( it.key() ).get() == tx || ( pending->isReady() && pending->key == tx->key ) )
+			it = prefetches.erase( it );
+		else
+			++it;
+	}
+}
+
+void TexCache::uploadPrefetched()
+{
+	QList<std::shared_ptr<Pending>> done;
+	{
+		QMutexLocker lock( &prefetchMutex );
+		for ( const auto & pending : prefetches ) {
+			if ( pending->isReady() )
+				done << pending;
+		}
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	for ( const auto & pending : done ) {
+		if ( timer.elapsed() >= PREFETCH_UPLOAD_BUDGET_MS )
+			break;
+
+		if ( !takePrefetch( pending->filename ) )
+			continue;
+
+		Tex * tx = texture( pending->filename );
+		if ( tx->id || tx->reload )
+			continue;
+
+		upload( pending->filename, tx, pending.get() );
+	}
+}
+
+void TexCache::beginFrame()
+{
+	Store * s = store();
+
+	// With several views the shared frame follows the one which draws most often
+	if ( frame == s->frame )
+		s->frame++;
+	frame = s->frame;
+
+	s->budget = memoryBudget;
+
+	uploadPrefetched();
+	s->streamLevels();
+	s->evict();
+	s->watchBound();
+}
+
+void TexCache::setGammaCorrectMipmaps( bool enable )
+{
+	texSetGammaCorrectMipmaps( enable );
+}
+
+qint64 TexCache::usage() const
+{
+	return shared ? shared->usage() : 0;
+}
+
+QStringList TexCache::texturePaths( const NifModel * nif, QStringList * materials )
+{
+	QStringList files;
+	if ( !nif )
+		return files;
+
+	QSet<QString> seen;
+	auto add = [&files, &seen]( const QString & file ) {
+		if ( !file.isEmpty() && !seen.contains( file ) ) {
+			seen.insert( file );
+			files << file;
+		}
+	};
+
+	static const QStringList shaderTextures = {
+		"File Name", "Source Texture", "Greyscale Texture", "Env Map Texture", "Normal Texture", "Env Mask Texture"
+	};
+
+	for ( int b = 0; b < nif->getBlockCount(); b++ ) {
+		QModelIndex iBlock = nif->getBlock( b );
+
+		if ( nif->isNiBlock( iBlock, "NiSourceTexture" ) ) {
+			if ( nif->get<quint8>( iBlock, "Use External" ) != 0 )
+				add( nif->get<QString>( iBlock, "File Name" ) );
+		} else if ( nif->isNiBlock( iBlock, "NiImage" ) ) {
+			add( nif->get<QString>( iBlock, "File Name" ) );
+		} else if ( nif->isNiBlock( iBlock, "BSShaderTextureSet" ) ) {
+			for ( const QString & file : nif->getArray<QString>( iBlock, "Textures" ) )
+				add( file );
+		} else if ( nif->inherits( iBlock, "BSShaderProperty" ) ) {
+			for ( const QString & name : shaderTextures ) {
+				QModelIndex iTex = nif->getIndex( iBlock, name );
+				if ( iTex.isValid() )
+					add( nif->get<QString>( iTex ) );
+			}
+
+			QString name = nif->get<QString>( iBlock, "Name" );
+			if ( materials && (name.endsWith( ".bgsm", Qt::CaseInsensitive ) || name.endsWith( ".bgem", Qt::CaseInsensitive )) )
+				*materials << name;
+		}
+	}
+
+	return files;
+}
+
 int TexCache::bind( const QModelIndex & iSource )
 {
 	const NifModel * nif = qobject_cast<const NifModel *>( iSource.model() );
@@ -445,11 +817,15 @@ int TexCache::bind( const QModelIndex & iSource )
 
 void TexCache::flush()
 {
-	for ( Tex * tx : textures ) {
-		if ( tx->id )
-			glDeleteTextures( 1, &tx->id );
+	{
+		// Decodes already running finish into prefetches which are no longer referenced
+		QMutexLocker lock( &prefetchMutex );
+		generation++;
+		prefetches.clear();
 	}
-	qDeleteAll( textures );
+	pool.clear();
+
+	// Textures still used by other caches are kept
 	textures.clear();
 
 	for ( Tex * tx : embedTextures ) {
@@ -459,8 +835,10 @@ void TexCache::flush()
 	qDeleteAll( embedTextures );
 	embedTextures.clear();
 
-	if ( !watcher->files().empty() ) {
-		watcher->removePaths( watcher->files() );
+	for ( GLuint & id : placeholders ) {
+		if ( id )
+			glDeleteTextures( 1, &id );
+		id = 0;
 	}
 }
 
@@ -492,7 +870,7 @@ QString TexCache::info( const QModelIndex & iSource )
 			}
 		} else {
 			QString filename = nif->get<QString>( iSource, "File Name" );
-			Tex * tx = textures.value( filename );
+			Tex * tx = textures.value( filename ).get();
 			temp = QString( "External texture file: %1\nTexture path: %2\nFormat: %3\nWidth: %4\nHeight: %5\nMipmaps: %6" )
 			       .arg( tx->filename )
 			       .arg( tx->filepath )
@@ -525,7 +903,7 @@ bool TexCache::importFile( NifModel * nif, const QModelIndex & iSource, QModelIn
 		if ( nif->get<quint8>( iSource, "Use External" ) == 1 ) {
 			QString filename = nif->get<QString>( iSource, "File Name" );
 			//qDebug() << "TexCache::importFile: Texture has filename (from NIF) " << filename;
-			Tex * tx = textures.value( filename );
+			Tex * tx = textures.value( filename ).get();
 			return tx->savePixelData( nif, iSource, iData );
 		}
 	}
@@ -534,11 +912,336 @@ bool TexCache::importFile( NifModel * nif, const QModelIndex & iSource, QModelIn
 }
 
 
+/*
+*  TexCache::Store
+*/
+
+TexCache::Store * TexCache::Store::get()
+{
+	QOpenGLContext * context = QOpenGLContext::currentContext();
+	QOpenGLContextGroup * group = context ? context->shareGroup() : nullptr;
+
+	Store * store = stores.value( group );
+	if ( !store ) {
+		store = new Store( group );
+		stores.insert( group, store );
+	}
+
+	return store;
+}
+
+QString TexCache::Store::key( const QString & filepath, bool archive )
+{
+	if ( archive ) {
+		QString path = FSManager::normalizePath( filepath );
+		std::shared_ptr<FSArchiveHandler> handler = FSManager::findFile( path );
+		return ( handler ? handler->getArchive()->path() : QString() ) + '|' + path;
+	}
+
+	return QFileInfo( filepath ).absoluteFilePath();
+}
+
+TexCache::Store::Store( QOpenGLContextGroup * group ) : QObject( group ), group( group )
+{
+	watcher = new QFileSystemWatcher( this );
+
+	reloadTimer = new QTimer( this );
+	reloadTimer->setSingleShot( true );
+	reloadTimer->setInterval( RELOAD_DELAY_MS );
+
+	connect( watcher, &QFileSystemWatcher::directoryChanged, this, [this]( const QString & dir ) {
+		changedDirs.insert( dir );
+		reloadTimer->start();
+	} );
+	connect( watcher, &QFileSystemWatcher::fileChanged, this, [this]( const QString & file ) {
+		changedDirs.insert( QFileInfo( file ).absolutePath() );
+		reloadTimer->start();
+	} );
+	connect( reloadTimer, &QTimer::timeout, this, [this]() { reloadChanged(); } );
+}
+
+TexCache::Store::~Store()
+{
+	stores.remove( group );
+}
+
+std::shared_ptr<TexCache::Tex> TexCache::Store::create( const QString & fname )
+{
+	Tex * tx = new Tex;
+	tx->filename = fname;
+
+	QPointer<Store> store( this );
+
+	return std::shared_ptr<Tex>( tx, [store]( Tex * tx ) {
+		if ( store ) {
+			store->remove( tx->key );
+			store->unwatch( tx->key );
+
+			// The last cache may go away after its context
+			QOpenGLContext * context = QOpenGLContext::currentContext();
+			if ( tx->id && tx->id != 0xFFFFFFFF && context && context->shareGroup() == store->group )
+				glDeleteTextures( 1, &tx->id );
+		}
+
+		delete tx;
+	} );
+}
+
+std::shared_ptr<TexCache::Tex> TexCache::Store::find( const QString & key )
+{
+	QMutexLocker lock( &mutex );
+	return textures.value( key ).lock();
+}
+
+void TexCache::Store::insert( const QString & key, const std::shared_ptr<Tex> & tx )
+{
+	QMutexLocker lock( &mutex );
+	textures.insert( key, tx );
+}
+
+bool TexCache::Store::isCurrent( const QString & key )
+{
+	QMutexLocker lock( &mutex );
+	std::shared_ptr<Tex> tx = textures.value( key ).lock();
+	return tx && tx->current.loadAcquire();
+}
+
+void TexCache::Store::remove( const QString & key )
+{
+	if ( key.isEmpty() )
+		return;
+
+	QMutexLocker lock( &mutex );
+
+	auto it = textures.find( key );
+	if ( it != textures.end() && it.value().expired() )
+		textures.erase( it );
+}
+
+qint64 TexCache::Store::usage()
+{
+	QMutexLocker lock( &mutex );
+
+	qint64 bytes = 0;
+	for ( const std::weak_ptr<Tex> & entry : textures ) {
+		if ( std::shared_ptr<Tex> tx = entry.lock() )
+			bytes += tx->bytes;
+	}
+
+	return bytes;
+}
+
+void TexCache::Store::streamLevels()
+{
+	QVector<std::shared_ptr<Tex>> streaming;
+	{
+		QMutexLocker lock( &mutex );
+		for ( const std::weak_ptr<Tex> & entry : textures ) {
+			std::shared_ptr<Tex> tx = entry.lock();
+			if ( tx && tx->levels && tx->lastUsed + 1 >= frame )
+				streaming << tx;
+		}
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	bool uploaded = false;
+
+	for ( const std::shared_ptr<Tex> & tx : streaming ) {
+		if ( timer.elapsed() >= STREAM_UPLOAD_BUDGET_MS )
+			break;
+
+		const gli::texture & levels = *tx->levels;
+
+		GLuint level = tx->baseLevel - 1;
+		if ( tx->id && tx->baseLevel > 0 && texLoadLevels( *tx->levels, tx->target, tx->id, level ) ) {
+			tx->baseLevel = level;
+			tx->bytes += qint64( levels.size( level ) ) * levels.faces() * levels.layers();
+			uploaded = true;
+		} else {
+			tx->baseLevel = 0;
+		}
+
+		if ( tx->baseLevel == 0 )
+			tx->levels.reset();
+	}
+
+	// Draw again with the sharper mip levels
+	if ( uploaded ) {
+		for ( TexCache * cache : caches )
+			emit cache->sigRefresh();
+	}
+}
+
+void TexCache::Store::evict()
+{
+	if ( budget <= 0 )
+		return;
+
+	qint64 used = usage();
+	if ( used <= budget )
+		return;
+
+	QVector<std::shared_ptr<Tex>> unused;
+	{
+		QMutexLocker lock( &mutex );
+		for ( const std::weak_ptr<Tex> & entry : textures ) {
+			std::shared_ptr<Tex> tx = entry.lock();
+			if ( tx && tx->id && tx->id != 0xFFFFFFFF && tx->lastUsed + 1 < frame )
+				unused << tx;
+		}
+	}
+
+	std::sort( unused.begin(), unused.end(), []( const std::shared_ptr<Tex> & a, const std::shared_ptr<Tex> & b ) {
+		return a->lastUsed < b->lastUsed;
+	} );
+
+	for ( const std::shared_ptr<Tex> & tx : unused ) {
+		if ( used <= budget )
+			break;
+
+		used -= tx->bytes;
+		release( tx.get() );
+	}
+}
+
+void TexCache::Store::watch( Tex * tx )
+{
+	QFileInfo file( tx->filepath );
+	if ( tx->key != file.absoluteFilePath() || !file.isFile() || !file.isWritable() )
+		return;
+
+	QString dir = file.absolutePath();
+
+	auto it = watched.find( dir );
+	if ( it == watched.end() ) {
+		it = watched.insert( dir, QHash<QString, QDateTime>() );
+		watcher->addPath( dir );
+	}
+
+	it.value().insert( tx->key, file.lastModified() );
+}
+
+void TexCache::Store::watchBound()
+{
+	if ( watchBoundTimer.isValid() && watchBoundTimer.elapsed() < WATCH_BOUND_INTERVAL_MS )
+		return;
+
+	watchBoundTimer.start();
+
+	QSet<QString> bound;
+	{
+		QMutexLocker lock( &mutex );
+		for ( auto it = textures.cbegin(); it != textures.cend() && bound.count() < WATCH_BOUND_FILES; ++it ) {
+			std::shared_ptr<Tex> tx = it.value().lock();
+			if ( !tx || tx->lastUsed + 1 < frame )
+				continue;
+
+			// Archive textures and read-only files are not in a watched directory
+			auto dir = watched.constFind( QFileInfo( it.key() ).absolutePath() );
+			if ( dir != watched.constEnd() && dir.value().contains( it.key() ) )
+				bound.insert( it.key() );
+		}
+	}
+
+	// Files replaced rather than written to drop out of the watcher; the directory watch covers those
+	QSet<QString> current = watcher->files().toSet();
+
+	QStringList added, removed;
+	for ( const QString & file : bound ) {
+		if ( !current.contains( file ) )
+			added << file;
+	}
+	for ( const QString & file : current ) {
+		if ( !bound.contains( file ) )
+			removed << file;
+	}
+
+	if ( !removed.isEmpty() )
+		watcher->removePaths( removed );
+	if ( !added.isEmpty() )
+		watcher->addPaths( added );
+}
+
+void TexCache::Store::unwatch( const QString & key )
+{
+	QString dir = QFileInfo( key ).absolutePath();
+
+	auto it = watched.find( dir );
+	if ( it == watched.end() || !it.value().remove( key ) )
+		return;
+
+	if ( it.value().isEmpty() ) {
+		watched.erase( it );
+		watcher->removePath( dir );
+		changedDirs.remove( dir );
+	}
+}
+
+void TexCache::Store::reloadChanged()
+{
+	bool changed = false;
+
+	for ( const QString & dir : changedDirs ) {
+		auto it = watched.find( dir );
+		if ( it == watched.end() )
+			continue;
+
+		// A directory which was removed and created again is no longer watched
+		if ( !watcher->directories().contains( dir ) && QFileInfo( dir ).isDir() )
+			watcher->addPath( dir );
+
+		for ( auto file = it.value().begin(); file != it.value().end(); ++file ) {
+			QFileInfo info( file.key() );
+			QDateTime modified = info.exists() ? info.lastModified() : QDateTime();
+			if ( modified == file.value() )
+				continue;
+
+			file.value() = modified;
+
+			std::shared_ptr<Tex> tx = find( file.key() );
+			if ( !tx || tx->id == 0xFFFFFFFF )
+				continue;
+
+			// Removed files are resolved again, which may find another file
+			tx->reload = true;
+			tx->current.storeRelease( 0 );
+			for ( TexCache * cache : caches )
+				cache->cancelPrefetch( tx.get() );
+
+			changed = true;
+		}
+	}
+
+	changedDirs.clear();
+
+	if ( changed ) {
+		for ( TexCache * cache : caches )
+			emit cache->sigRefresh();
+	}
+}
+
+void TexCache::Store::release( Tex * tx )
+{
+	tx->current.storeRelease( 0 );
+	glDeleteTextures( 1, &tx->id );
+	tx->id = 0;
+	tx->mipmaps = 0;
+	tx->bytes = 0;
+	tx->baseLevel = 0;
+	tx->levels.reset();
+	// Archive textures are read again through find()
+	tx->filepath.clear();
+	tx->data.clear();
+}
+
+
 /*
 *  TexCache::Tex
 */
 
-void TexCache::Tex::load()
+void TexCache::Tex::load( Pending * prefetched )
 {
 	if ( !id )
 		glGenTextures( 1, &id );
@@ -546,18 +1249,62 @@ void TexCache::Tex::load()
 	width  = height = mipmaps = 0;
 	reload = false;
 	status = QString();
+	bytes = 0;
+	baseLevel = 0;
+	levels.reset();
+
+	if ( prefetched ) {
+		filepath = prefetched->filepath;
+		data = prefetched->data;
+	}
 
 	if ( target )
 		glBindTexture( target, id );
 
 	try
 	{
-		texLoad( filepath, format, target, width, height, mipmaps, data, id );
+		if ( prefetched && !prefetched->texture.empty() ) {
+			gli::texture & texture = prefetched->texture;
+
+			// Upload the small mip levels first so that an image shows right away
+			GLuint first = 0;
+			while ( first + 1 < texture.levels()
+					&& std::max( texture.extent( first ).x, texture.extent( first ).y ) > STREAM_FIRST_EXTENT )
+				first++;
+
+			for ( size_t level = first; level < texture.levels(); level++ )
+				bytes += qint64( texture.size( level ) ) * texture.faces() * texture.layers();
+
+			if ( first ) {
+				levels = std::make_shared<gli::texture>( texture );
+				baseLevel = first;
+			}
+
+			texLoad( filepath, texture, format, target, width, height, mipmaps, id, first );
+		} else {
+			texLoad( filepath, format, target, width, height, mipmaps, data, id );
+
+			// Other formats are uploaded as RGBA8
+			bytes = qint64( width ) * height * 4;
+			if ( mipmaps > 1 )
+				bytes = bytes * 4 / 3;
+			if ( target == GL_TEXTURE_CUBE_MAP )
+				bytes *= 6;
+		}
 	}
 	catch ( QString & e )
 	{
 		status = e;
+		bytes = 0;
+		baseLevel = 0;
+		levels.reset();
 	}
+
+	// The file contents are not needed once uploaded
+	data.clear();
+
+	// Prefetches of this file may share the texture from now on
+	current.storeRelease( 1 );
 }
 
 bool TexCache::Tex::saveAsFile( const QModelIndex & index, QString & savepath )
@@ -34,29 +34,45 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define GLTEX_H
 
 #include <QObject> // Inherited
+#include <QAtomicInt>
 #include <QByteArray>
 #include <QHash>
+#include <QMutex>
 #include <QPersistentModelIndex>
+#include <QPointer>
 #include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+#include <memory>
 
 
 //! @file gltex.h TexCache etc. header
 
 class NifModel;
-class QFileSystemWatcher;
 class QOpenGLContext;
 
+namespace gli
+{
+class texture;
+}
+
 typedef unsigned int GLuint;
 typedef unsigned int GLenum;
 
 /*! A class for handling OpenGL textures.
  *
- * This class stores information on all loaded textures, and watches the texture files.
+ * This class maps the texture names of a view to the textures it has bound. The textures
+ * themselves are shared with the other caches whose contexts share objects, keyed by the
+ * resolved path, so a texture used in several windows is only loaded once. The store
+ * watches the directories of the texture files and reloads the textures which changed.
  */
 class TexCache final : public QObject
 {
 	Q_OBJECT
 
+	struct Pending;
+
 	//! A structure for storing information on a single texture.
 	struct Tex
 	{
@@ -64,6 +80,8 @@ class TexCache final : public QObject
 		QString filename;
 		//! The texture file path.
 		QString filepath;
+		//! The key in the shared store, empty until the path was resolved
+		QString key;
 		//! The texture data (if not in the filesystem)
 		QByteArray data;
 		//! ID for use with GL texture functions
@@ -78,13 +96,23 @@ class TexCache final : public QObject
 		GLuint mipmaps = 0;
 		//! Determine whether the texture needs reloading
 		bool reload = false;
+		//! Set while the texture is uploaded and not reloading; read by prefetches on worker threads
+		QAtomicInt current;
 		//! Format of the texture
 		QString format;
 		//! Status messages
 		QString status;
+		//! The shared frame in which the texture was last bound
+		quint64 lastUsed = 0;
+		//! Estimated size of the uploaded mip levels in bytes
+		qint64 bytes = 0;
+		//! The largest mip level uploaded so far
+		GLuint baseLevel = 0;
+		//! The decoded DDS which the remaining mip levels are uploaded from
+		std::shared_ptr<gli::texture> levels;
 
-		//! Load the texture
-		void load();
+		//! Load the texture, from a finished prefetch if given
+		void load( Pending * prefetched = nullptr );
 
 		//! Save the texture as a file
 		bool saveAsFile( const QModelIndex & index, QString & savepath );
@@ -96,11 +124,48 @@ public:
 	TexCache( QObject * parent = nullptr );
 	~TexCache();
 
+	/*! Load textures on worker threads instead of inside bind()
+	 *
+	 * A texture which is still loading binds its previous image or a 1x1 placeholder,
+	 * and sigRefresh() is emitted once it can be uploaded. Tex::status reads "loading"
+	 * until then.
+	 */
+	void setAsync( bool enable ) { async = enable; }
+
 	//! Bind a texture from filename
 	int bind( const QString & fname );
 	//! Bind a texture from pixel data
 	int bind( const QModelIndex & iSource );
 
+	/*! Resolve, read and decode the textures of a NIF on worker threads
+	 *
+	 * Covers texturing properties, shader texture sets and the textures of BGSM/BGEM
+	 * materials. A texture which is bound before its prefetch is done waits for it;
+	 * the rest are uploaded by uploadPrefetched().
+	 */
+	void prefetch( const NifModel * nif );
+	//! Upload prefetched textures which finished decoding; call on the GL thread
+	void uploadPrefetched();
+
+	/*! Start a new frame; call on the GL thread before drawing
+	 *
+	 * Uploads prefetched textures, adds the next mip level of textures which are still
+	 * streaming in and evicts the least recently used textures while over the budget.
+	 */
+	void beginFrame();
+
+	//! Set whether mip levels generated for TGA, BMP and NiPixelData textures are gamma correct
+	static void setGammaCorrectMipmaps( bool enable );
+
+	//! Set the video memory budget in bytes; 0 disables eviction
+	void setBudget( qint64 bytes ) { memoryBudget = bytes; }
+	qint64 budget() const { return memoryBudget; }
+	//! Estimated video memory used by the textures of the share group in bytes
+	qint64 usage() const;
+
+	//! Texture file names used by a NIF; material file names are added to materials
+	static QStringList texturePaths( const NifModel * nif, QStringList * materials = nullptr );
+
 	//! Debug function for getting info about a texture
 	QString info( const QModelIndex & iSource );
 
@@ -132,15 +197,72 @@ public slots:
 	 */
 	void setNifFolder( const QString & );
 
-protected slots:
-	void fileChanged( const QString & filepath );
-
 protected:
-	QHash<QString, Tex *> textures;
+	class DecodeJob;
+	class MaterialJob;
+	class Store;
+
+	//! The store of the share group of the current context
+	Store * store();
+
+	//! Returns the texture for fname, creating it if needed
+	Tex * texture( const QString & fname );
+	/*! Points fname at the texture already stored under key, or stores tx under key
+	 *
+	 * @return	The texture fname now refers to; tx may have been deleted
+	 */
+	Tex * share( const QString & fname, Tex * tx, const QString & key );
+	/*! Upload a finished prefetch of fname and bind it, unless another cache has loaded the file
+	 *
+	 * @return	The number of mip levels bound
+	 */
+	int upload( const QString & fname, Tex * tx, Pending * pending );
+	//! Bind for a texture which is not uploaded yet, without blocking
+	int bindAsync( const QString & fname, Tex * tx );
+	//! Bind the previous image of a reloading texture, or a placeholder
+	int bindLoading( const QString & fname, Tex * tx );
+	//! Bind a 1x1 stand-in for a texture which is still loading
+	int bindPlaceholder( const QString & fname );
+	//! Drop the prefetches which would upload an old image of tx
+	void cancelPrefetch( const Tex * tx );
+
+	/*! Queue a prefetch of fname unless one is pending; safe to call from worker threads
+	 *
+	 * @param gen		The generation the request belongs to, or -1 for the current one
+	 * @param decode	Decode even if the texture is loaded by another cache
+	 * @return			The new or pending prefetch, or null if the request is stale
+	 */
+	std::shared_ptr<Pending> startPrefetch( const QString & fname, const QString & folder, int gen, bool decode = false );
+	//! Remove and return the prefetch of fname, if any
+	std::shared_ptr<Pending> takePrefetch( const QString & fname );
+
+	//! The textures bound by name; entries may be shared with other caches
+	QHash<QString, std::shared_ptr<Tex>> textures;
 	QHash<QModelIndex, Tex *> embedTextures;
-	QFileSystemWatcher * watcher;
 
 	QString nifFolder;
+
+	//! Whether bind() loads textures on worker threads
+	bool async = false;
+	//! Stand-ins for loading textures: neutral grey and a flat normal map
+	GLuint placeholders[2] = { 0, 0 };
+
+	//! The shared frame of the last call to beginFrame()
+	quint64 frame = 0;
+	//! See setBudget()
+	qint64 memoryBudget = 0;
+
+	//! See store(); set once a context was current
+	QPointer<Store> shared;
+
+	//! Runs the prefetch jobs of this cache
+	QThreadPool pool;
+	//! Guards prefetches and generation
+	QMutex prefetchMutex;
+	//! Prefetches by file name which have not been uploaded yet
+	QHash<QString, std::shared_ptr<Pending>> prefetches;
+	//! Incremented by flush() so that jobs for an old NIF add nothing
+	int generation = 0;
 };
 
 void initializeTextureUnits( const QOpenGLContext * );
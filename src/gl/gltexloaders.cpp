@@ -31,6 +31,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ***** END LICENCE BLOCK *****/
 
 #include "gltexloaders.h"
+#include "gltexpixels.h"
 
 #include "message.h"
 #include "model/nifmodel.h"
@@ -47,6 +48,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QString>
 #include <QtEndian>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
 #ifdef __APPLE__
 #include <gl3.h>
 #include <gl3ext.h>
@@ -90,10 +95,6 @@ PFNGLCOMPRESSEDTEXIMAGE2DPROC glCompressedTexImage2D = nullptr;
 #define FOURCC_DXT3 MAKEFOURCC( 'D', 'X', 'T', '3' )
 #define FOURCC_DXT5 MAKEFOURCC( 'D', 'X', 'T', '5' )
 
-//! Shift amounts for RGBA conversion
-static const int rgbashift[4] = {
-	0, 8, 16, 24
-};
 //! Mask for TGA greyscale
 static const quint32 TGA_L_MASK[4] = {
 	0xff, 0xff, 0xff, 0x00
@@ -137,290 +138,41 @@ bool isPowerOfTwo( unsigned int x )
 	return ( x == 1 );
 }
 
-/*! Completes mipmap sequence of the current active OpenGL texture.
- *
- * @param m Number of mipmaps that are already in the texture.
- * @return	Total number of mipmaps.
- */
-int generateMipMaps( int m )
-{
-	GLint w = 0, h = 0;
-
-	// load the (m-1)'th mipmap as a basis
-	glGetTexLevelParameteriv( GL_TEXTURE_2D, m - 1, GL_TEXTURE_WIDTH, &w );
-	glGetTexLevelParameteriv( GL_TEXTURE_2D, m - 1, GL_TEXTURE_HEIGHT, &h );
-
-	//qDebug() << m-1 << w << h;
-
-	quint8 * data = (quint8 *)malloc( w * h * 4 );
-	glGetTexImage( GL_TEXTURE_2D, m - 1, GL_RGBA, GL_UNSIGNED_BYTE, data );
-
-	// now generate the mipmaps until width is one or height is one.
-	while ( w > 1 || h > 1 ) {
-		// Shut up Code Analysis C6011
-		if ( !data )
-			break;
-		// the buffer overwrites itself to save memory
-		const quint8 * src = data;
-		quint8 * dst = data;
-
-		quint32 xo = ( w > 1 ? 1 * 4 : 0 );
-		quint32 yo = ( h > 1 ? w * 4 : 0 );
-
-		w /= 2;
-		h /= 2;
-
-		if ( w == 0 )
-			w = 1;
-
-		if ( h == 0 )
-			h = 1;
-
-		//qDebug() << m << w << h;
-
-		for ( int y = 0; y < h; y++ ) {
-			for ( int x = 0; x < w; x++ ) {
-				for ( int b = 0; b < 4; b++ ) {
-					*dst++ = ( *(src + xo) + *(src + yo) + *(src + xo + yo) + *src) / 4;
-					src++;
-				}
-
-				src += xo;
-			}
-
-			src += yo;
-		}
-
-		glTexImage2D( GL_TEXTURE_2D, m++, 4, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
-	}
-
-	free( data );
-
-	return m;
-}
+//! Whether generated mip levels are filtered in linear space
+static std::atomic<bool> gammaCorrectMipmaps( false );
 
-/*! Converts RLE-encoded data into pixel data.
- *
- * TGA in particular uses the PackBits format described at
- * http://en.wikipedia.org/wiki/PackBits and in the TGA spec.
- */
-bool uncompressRLE( QIODevice & f, int w, int h, int bytespp, quint8 * pixel )
+// (public function, documented in gltexloaders.h)
+void texSetGammaCorrectMipmaps( bool enable )
 {
-	QByteArray data = f.readAll();
-
-	int c = 0; // total pixel count
-	int o = 0; // data offset
-
-	quint8 rl; // runlength - 1
-
-	while ( c < w * h ) {
-		rl = data[o++];
-
-		if ( rl & 0x80 ) {
-			// if RLE packet
-			quint8 px[8] = {}; // pixel data in this packet (assume bytespp < 8)
-
-			for ( int b = 0; b < bytespp; b++ )
-				px[b] = data[o++];
-
-			rl &= 0x7f; // strip RLE bit
-
-			do {
-				for ( int b = 0; b < bytespp; b++ )
-					*pixel++ = px[b]; // expand pixel data (rl+1) times
-			} while ( ++c < w * h && rl-- > 0 );
-		} else {
-			do {
-				for ( int b = 0; b < bytespp; b++ )
-					*pixel++ = data[o++]; // write (rl+1) raw pixels
-			} while ( ++c < w * h && rl-- > 0 );
-		}
-
-		if ( o >= data.count() )
-			return false;
-	}
-
-	return true;
+	gammaCorrectMipmaps = enable;
 }
 
-/*! Convert pixels to RGBA
- *
- * @param data		Pixels to convert
- * @param w			Width of the image
- * @param h			Height of the image
- * @param bytespp	Number of bytes per pixel
- * @param mask		Bitmask for pixel data
- * @param flipV		Whether to flip the data vertically
- * @param flipH		Whether to flip the data horizontally
- * @param pixl		Pixels to output
- */
-void convertToRGBA( const quint8 * data, int w, int h, int bytespp, const quint32 mask[], bool flipV, bool flipH, quint8 * pixl )
+//! Upload RGBA8 mip levels to the bound GL_TEXTURE_2D
+static int uploadRGBA( const RGBALevels & levels, int width, int height )
 {
-	memset( pixl, 0, w * h * 4 );
-
-	for ( int a = 0; a < 4; a++ ) {
-		if ( mask[a] ) {
-			quint32 msk = mask[ a ];
-			int rshift  = 0;
-
-			while ( msk != 0 && ( msk & 0xffffff00 ) ) {
-				msk = msk >> 1; rshift++;
-			}
-
-			int lshift = rgbashift[ a ];
-
-			while ( msk != 0 && ( ( msk & 0x80 ) == 0 ) ) {
-				msk = msk << 1; lshift++;
-			}
-
-			msk = mask[ a ];
-
-			const quint8 * src = data;
-			const quint32 inc  = ( flipH ? -1 : 1 );
-
-			for ( int y = 0; y < h; y++ ) {
-				quint32 * dst = (quint32 *)( pixl + 4 * ( w * ( flipV ? h - y - 1 : y ) + ( flipH ? w - 1 : 0 ) ) );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glPixelStorei( GL_UNPACK_SWAP_BYTES, GL_FALSE );
 
-				if ( rshift == lshift ) {
-					for ( int x = 0; x < w; x++ ) {
-						*dst |= *( (const quint32 *)src ) & msk;
-						dst  += inc;
-						src  += bytespp;
-					}
-				} else {
-					for ( int x = 0; x < w; x++ ) {
-						*dst |= ( *( (const quint32 *)src ) & msk ) >> rshift << lshift;
-						dst  += inc;
-						src  += bytespp;
-					}
-				}
-			}
-		} else if ( a == 3 ) {
-			quint32 * dst = (quint32 *)pixl;
-			quint32 x = 0xff << rgbashift[ a ];
+	for ( int m = 0; m < levels.count(); m++ ) {
+		int w = std::max( width >> m, 1 );
+		int h = std::max( height >> m, 1 );
 
-			for ( int c = w * h; c > 0; c-- )
-				*dst++ |= x;
-		}
+		glTexImage2D( GL_TEXTURE_2D, m, 4, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, levels.at( m ).constData() );
 	}
+
+	return levels.count();
 }
 
 //! Load raw pixel data
 int texLoadRaw( QIODevice & f, int width, int height, int num_mipmaps, int bpp, int bytespp, const quint32 mask[], bool flipV = false, bool flipH = false, bool rle = false )
 {
-	if ( bytespp * 8 != bpp || bpp > 32 || bpp < 8 )
-		throw QString( "unsupported image depth %1 / %2" ).arg( bpp ).arg( bytespp );
-
-	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
-	glPixelStorei( GL_UNPACK_SWAP_BYTES, GL_FALSE );
-
-	quint8 * data1 = (quint8 *)malloc( width * height * 4 );
-	quint8 * data2 = (quint8 *)malloc( width * height * 4 );
-
-	int w = width;
-	int h = height;
-	int m = 0;
-
-	while ( m < num_mipmaps ) {
-		w = width >> m;
-		h = height >> m;
-
-		if ( w == 0 )
-			w = 1;
-
-		if ( h == 0 )
-			h = 1;
-
-		if ( rle ) {
-			if ( !uncompressRLE( f, w, h, bytespp, data1 ) ) {
-				free( data2 );
-				free( data1 );
-				throw QString( "unexpected EOF" );
-			}
-		} else if ( f.read( (char *)data1, w * h * bytespp ) != w * h * bytespp ) {
-			free( data2 );
-			free( data1 );
-			throw QString( "unexpected EOF" );
-		}
-
-		convertToRGBA( data1, w, h, bytespp, mask, flipV, flipH, data2 );
-
-		glTexImage2D( GL_TEXTURE_2D, m++, 4, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data2 );
-
-		if ( w == 1 && h == 1 )
-			break;
-	}
-
-	free( data2 );
-	free( data1 );
-
-	if ( w > 1 || h > 1 )
-		m = generateMipMaps( m );
-
-	return m;
+	return uploadRGBA( decodeRaw( f, width, height, num_mipmaps, bpp, bytespp, mask, flipV, flipH, rle, gammaCorrectMipmaps ), width, height );
 }
 
 //! Load a palettised texture
 int texLoadPal( QIODevice & f, int width, int height, int num_mipmaps, int bpp, int bytespp, const quint32 colormap[], bool flipV, bool flipH, bool rle )
 {
-	if ( bpp != 8 || bytespp != 1 )
-		throw QString( "unsupported image depth %1 / %2" ).arg( bpp ).arg( bytespp );
-
-	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
-	glPixelStorei( GL_UNPACK_SWAP_BYTES, GL_FALSE );
-
-	quint8 * data = (quint8 *)malloc( width * height * 1 );
-	quint8 * pixl = (quint8 *)malloc( width * height * 4 );
-
-	int w = width;
-	int h = height;
-	int m = 0;
-
-	while ( m < num_mipmaps ) {
-		w = width >> m;
-		h = height >> m;
-
-		if ( w == 0 )
-			w = 1;
-
-		if ( h == 0 )
-			h = 1;
-
-		if ( rle ) {
-			if ( !uncompressRLE( f, w, h, bytespp, data ) ) {
-				free( pixl );
-				free( data );
-				throw QString( "unexpected EOF" );
-			}
-		} else if ( f.read( (char *)data, w * h * bytespp ) != w * h * bytespp ) {
-			free( pixl );
-			free( data );
-			throw QString( "unexpected EOF" );
-		}
-
-		quint8 * src = data;
-
-		for ( int y = 0; y < h; y++ ) {
-			quint32 * dst = (quint32 *)( pixl + 4 * ( w * ( flipV ? h - y - 1 : y ) + ( flipH ? w - 1 : 0 ) ) );
-
-			for ( int x = 0; x < w; x++ ) {
-				*dst++ = colormap[*src++];
-			}
-		}
-
-		glTexImage2D( GL_TEXTURE_2D, m++, 4, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixl );
-
-		if ( w == 1 && h == 1 )
-			break;
-	}
-
-	free( pixl );
-	free( data );
-
-	if ( w > 1 || h > 1 )
-		m = generateMipMaps( m );
-
-	return m;
+	return uploadRGBA( decodePal( f, width, height, num_mipmaps, bpp, bytespp, colormap, flipV, flipH, rle, gammaCorrectMipmaps ), width, height );
 }
 
 
@@ -435,14 +187,11 @@ int texLoadPal( QIODevice & f, int width, int height, int num_mipmaps, int bpp,
 #define TGA_COLOR_RLE    10
 #define TGA_GREY_RLE     11
 
-//! Load a TGA texture.
-GLuint texLoadTGA( QIODevice & f, QString & texformat, GLenum & target, GLuint & width, GLuint & height, GLuint & id )
+//! Decode a TGA texture.
+static RGBALevels decodeTGA( QIODevice & f, QString & texformat, GLuint & width, GLuint & height )
 {
 	// see http://en.wikipedia.org/wiki/Truevision_TGA for a lot of this
 	texformat = "TGA";
-	target = GL_TEXTURE_2D;
-
-	glBindTexture( target, id );
 
 	// read in tga header
 	quint8 hdr[18];
@@ -465,7 +214,7 @@ GLuint texLoadTGA( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 	if ( !( isPowerOfTwo( width ) && isPowerOfTwo( height ) ) )
 		throw QString( "image dimensions must be power of two" );
 
-	quint32 colormap[256];
+	quint32 colormap[256] = {};
 
 	if ( hdr[1] ) {
 		// color map present
@@ -503,7 +252,7 @@ GLuint texLoadTGA( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 		}
 	}
 
-	// check format and call texLoadPal / texLoadRaw
+	// check format and call decodePal / decodeRaw
 	switch ( hdr[2] ) {
 	case TGA_COLORMAP:
 	case TGA_COLORMAP_RLE:
@@ -514,7 +263,7 @@ GLuint texLoadTGA( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 			if ( hdr[2] == TGA_COLORMAP_RLE )
 				texformat += " (RLE)";
 
-			return texLoadPal( f, width, height, 1, depth, depth / 8, colormap, flipV, flipH, hdr[2] == TGA_COLORMAP_RLE );
+			return decodePal( f, width, height, 1, depth, depth / 8, colormap, flipV, flipH, hdr[2] == TGA_COLORMAP_RLE, gammaCorrectMipmaps );
 		}
 
 		break;
@@ -527,14 +276,14 @@ GLuint texLoadTGA( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 			if ( hdr[2] == TGA_GREY_RLE )
 				texformat += " (RLE)";
 
-			return texLoadRaw( f, width, height, 1, 8, 1, TGA_L_MASK, flipV, flipH, hdr[2] == TGA_GREY_RLE );
+			return decodeRaw( f, width, height, 1, 8, 1, TGA_L_MASK, flipV, flipH, hdr[2] == TGA_GREY_RLE, gammaCorrectMipmaps );
 		} else if ( depth == 16 ) {
 			texformat += " (greyscale) (alpha)";
 
 			if ( hdr[2] == TGA_GREY_RLE )
 				texformat += " (RLE)";
 
-			return texLoadRaw( f, width, height, 1, 16, 2, TGA_LA_MASK, flipV, flipH, hdr[2] == TGA_GREY_RLE );
+			return decodeRaw( f, width, height, 1, 16, 2, TGA_LA_MASK, flipV, flipH, hdr[2] == TGA_GREY_RLE, gammaCorrectMipmaps );
 		}
 
 		break;
@@ -547,21 +296,31 @@ GLuint texLoadTGA( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 			if ( hdr[2] == TGA_GREY_RLE )
 				texformat += " (RLE)";
 
-			return texLoadRaw( f, width, height, 1, 32, 4, TGA_RGBA_MASK, flipV, flipH, hdr[2] == TGA_COLOR_RLE );
+			return decodeRaw( f, width, height, 1, 32, 4, TGA_RGBA_MASK, flipV, flipH, hdr[2] == TGA_COLOR_RLE, gammaCorrectMipmaps );
 		} else if ( depth == 24 ) {
 			texformat += " (truecolor)";
 
 			if ( hdr[2] == TGA_COLOR_RLE )
 				texformat += " (RLE)";
 
-			return texLoadRaw( f, width, height, 1, 24, 3, TGA_RGB_MASK, flipV, flipH, hdr[2] == TGA_COLOR_RLE );
+			return decodeRaw( f, width, height, 1, 24, 3, TGA_RGB_MASK, flipV, flipH, hdr[2] == TGA_COLOR_RLE, gammaCorrectMipmaps );
 		}
 
 		break;
 	}
 
 	throw QString( "image sub format not supported" );
-	return 0;
+}
+
+//! Load a TGA texture.
+GLuint texLoadTGA( QIODevice & f, QString & texformat, GLenum & target, GLuint & width, GLuint & height, GLuint & id )
+{
+	target = GL_TEXTURE_2D;
+
+	glBindTexture( target, id );
+
+	RGBALevels levels = decodeTGA( f, texformat, width, height );
+	return uploadRGBA( levels, width, height );
 }
 
 //! Return value as a 32-bit value; possibly replace with QtEndian functions?
@@ -576,8 +335,8 @@ quint16 get16( quint8 * x )
 	return *( (quint16 *)x );
 }
 
-//! Load a BMP texture.
-GLuint texLoadBMP( QIODevice & f, QString & texformat, GLenum & target, GLuint & width, GLuint & height, GLuint & id )
+//! Decode a BMP texture.
+static RGBALevels decodeBMP( QIODevice & f, QString & texformat, GLuint & width, GLuint & height )
 {
 	// read in bmp header
 	quint8 hdr[54];
@@ -587,9 +346,6 @@ GLuint texLoadBMP( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 		throw QString( "not a BMP file" );
 
 	texformat = "BMP";
-	target = GL_TEXTURE_2D;
-
-	glBindTexture( target, id );
 
 	width  = get32( &hdr[18] );
 	height = get32( &hdr[22] );
@@ -606,7 +362,7 @@ GLuint texLoadBMP( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 	case 0:
 
 		if ( bpp == 24 ) {
-			return texLoadRaw( f, width, height, 1, bpp, 3, BMP_RGBA_MASK, true );
+			return decodeRaw( f, width, height, 1, bpp, 3, BMP_RGBA_MASK, true, false, false, gammaCorrectMipmaps );
 		}
 
 		break;
@@ -620,26 +376,36 @@ GLuint texLoadBMP( QIODevice & f, QString & texformat, GLenum & target, GLuint &
 	qDebug( "cmpr %08x", compression );
 	qDebug( "ofs  %i", offset );
 	*/
-	return 0;
 }
 
-GLuint texLoadDDS( const QString & filepath, QString & format, GLenum & target, GLuint & width, GLuint & height, GLuint & mipmaps, QByteArray & data, GLuint & id )
+//! Load a BMP texture.
+GLuint texLoadBMP( QIODevice & f, QString & texformat, GLenum & target, GLuint & width, GLuint & height, GLuint & id )
+{
+	target = GL_TEXTURE_2D;
+
+	glBindTexture( target, id );
+
+	RGBALevels levels = decodeBMP( f, texformat, width, height );
+	return uploadRGBA( levels, width, height );
+}
+
+GLuint texLoadDDS( const QString & filepath, QString & format, GLenum & target, GLuint & width, GLuint & height, GLuint & mipmaps, gli::texture & texture, GLuint & id, GLuint baseLevel = 0 )
 {
 	GLuint result = 0;
-	gli::texture texture;
-	if ( extStorageSupported ) {
-		texture = load_if_valid( data.constData(), data.size() );
-		if ( !texture.empty() )
-			result = GLI_create_texture( texture, target, id );
-	} else if ( glCompressedTexImage2D ) {
-		texture = load_if_valid( data.constData(), data.size() );
-		if ( !texture.empty() )
-			result = GLI_create_texture_fallback( texture, target, id );
+	if ( !texture.empty() ) {
+		baseLevel = std::min( baseLevel, GLuint( texture.levels() - 1 ) );
+		if ( extStorageSupported )
+			result = GLI_create_texture( texture, target, id, baseLevel );
+		else if ( glCompressedTexImage2D )
+			result = GLI_create_texture_fallback( texture, target, id, baseLevel );
 	}
 
 	if ( result ) {
 		id = result;
 		mipmaps = (GLuint)texture.levels();
+		// Level 0 may not be uploaded yet
+		width = texture.extent().x;
+		height = texture.extent().y;
 	} else {
 		mipmaps = 0;
 		QString file = filepath;
@@ -763,8 +529,9 @@ bool texLoad( const QModelIndex & iData, QString & texformat, GLenum & target, G
 
 				if ( iPalette.isValid() ) {
 					QVector<quint32> map;
-					uint nmap = nif->get<uint>( iPalette, "Num Entries" );
-					map.resize( nmap );
+					uint nmap = std::min<uint>( nif->get<uint>( iPalette, "Num Entries" ), 256 );
+					// Indices past the last entry map to transparent black
+					map.resize( 256 );
 					QModelIndex iPaletteArray = nif->getIndex( iPalette, "Palette" );
 
 					if ( nmap > 0 && iPaletteArray.isValid() ) {
@@ -862,8 +629,47 @@ void initializeTextureLoaders( const QOpenGLContext * context )
 	}
 }
 
+//! Uploads the mip levels [first, last) of every layer and face of a texture
+static bool GLI_upload_levels( gli::texture & texture, const gli::gl::format & format, GLenum target, size_t first, size_t last, bool storage )
+{
+	for ( size_t layer = 0; layer < texture.layers(); ++layer )
+	for ( size_t face = 0; face < texture.faces(); ++face )
+	for ( size_t level = first; level < last; ++level ) {
+		glm::tvec3<GLsizei> extent( texture.extent( level ) );
+		GLenum faceTarget = gli::is_target_cube( texture.target() ) ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
+			: target;
+
+		switch ( texture.target() ) {
+		case gli::TARGET_2D:
+		case gli::TARGET_CUBE:
+			if ( gli::is_compressed( texture.format() ) ) {
+				if ( storage )
+					glCompressedTexSubImage2D( faceTarget, static_cast<GLint>(level), 0, 0, extent.x, extent.y,
+											   format.Internal, static_cast<GLsizei>(texture.size( level )),
+											   texture.data( layer, face, level ) );
+				else
+					glCompressedTexImage2D( faceTarget, static_cast<GLint>(level), format.Internal, extent.x, extent.y, 0,
+											static_cast<GLsizei>(texture.size( level )),
+											texture.data( layer, face, level ) );
+			} else {
+				if ( storage )
+					glTexSubImage2D( faceTarget, static_cast<GLint>(level), 0, 0, extent.x, extent.y,
+									 format.External, format.Type, texture.data( layer, face, level ) );
+				else
+					glTexImage2D( faceTarget, static_cast<GLint>(level), format.Internal, extent.x, extent.y, 0,
+								  format.External, format.Type, texture.data( layer, face, level ) );
+			}
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
 //! Create texture with glTexStorage2D using GLI
-GLuint GLI_create_texture( gli::texture& texture, GLenum& target, GLuint& id )
+GLuint GLI_create_texture( gli::texture& texture, GLenum& target, GLuint& id, GLuint baseLevel )
 {
 	if ( !extStorageSupported )
 		return 0;
@@ -875,7 +681,7 @@ GLuint GLI_create_texture( gli::texture& texture, GLenum& target, GLuint& id )
 	if ( !id )
 		glGenTextures( 1, &id );
 	glBindTexture( target, id );
-	glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(baseLevel) );
 	glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels() - 1) );
 	glTexParameteri( target, GL_TEXTURE_SWIZZLE_R, format.Swizzles[0] );
 	glTexParameteri( target, GL_TEXTURE_SWIZZLE_G, format.Swizzles[1] );
@@ -895,42 +701,14 @@ GLuint GLI_create_texture( gli::texture& texture, GLenum& target, GLuint& id )
 		return 0;
 	}
 
-	for ( size_t layer = 0; layer < texture.layers(); ++layer )
-	for ( size_t face = 0; face < texture.faces(); ++face )
-	for ( size_t level = 0; level < texture.levels(); ++level ) {
-		glm::tvec3<GLsizei> textureLevelExtent( texture.extent( level ) );
-		switch ( texture.target() ) {
-		case gli::TARGET_2D:
-		case gli::TARGET_CUBE:
-			if ( gli::is_compressed( texture.format() ) )
-				glCompressedTexSubImage2D(
-					gli::is_target_cube( texture.target() ) ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
-					: target,
-					static_cast<GLint>(level),
-					0, 0,
-					textureLevelExtent.x, textureLevelExtent.y,
-					format.Internal, static_cast<GLsizei>(texture.size( level )),
-					texture.data( layer, face, level ) );
-			else
-				glTexSubImage2D(
-					gli::is_target_cube( texture.target() ) ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
-					: target,
-					static_cast<GLint>(level),
-					0, 0,
-					textureLevelExtent.x, textureLevelExtent.y,
-					format.External, format.Type,
-					texture.data( layer, face, level ) );
-			break;
-		default:
-			return 0;
-		}
-	}
+	if ( !GLI_upload_levels( texture, format, target, baseLevel, texture.levels(), true ) )
+		return 0;
 
 	return id;
 }
 
 //! Fallback for systems that do not have glTexStorage2D
-GLuint GLI_create_texture_fallback( gli::texture& texture, GLenum & target, GLuint& id )
+GLuint GLI_create_texture_fallback( gli::texture& texture, GLenum & target, GLuint& id, GLuint baseLevel )
 {
 	if ( texture.empty() )
 		return 0;
@@ -943,7 +721,7 @@ GLuint GLI_create_texture_fallback( gli::texture& texture, GLenum & target, GLui
 		glGenTextures( 1, &id );
 	glBindTexture( target, id );
 	// Base and max level are not supported by OpenGL ES 2.0
-	glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(baseLevel) );
 	glTexParameteri( target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels() - 1) );
 	// Texture swizzle is not supported by OpenGL ES 2.0 and OpenGL 3.2
 	glTexParameteri( target, GL_TEXTURE_SWIZZLE_R, fmt.Swizzles[0] );
@@ -951,41 +729,35 @@ GLuint GLI_create_texture_fallback( gli::texture& texture, GLenum & target, GLui
 	glTexParameteri( target, GL_TEXTURE_SWIZZLE_B, fmt.Swizzles[2] );
 	glTexParameteri( target, GL_TEXTURE_SWIZZLE_A, fmt.Swizzles[3] );
 
-	for ( std::size_t layer = 0; layer < texture.layers(); ++layer )
-	for ( std::size_t face = 0; face < texture.faces(); ++face )
-	for ( std::size_t level = 0; level < texture.levels(); ++level ) {
-		glm::tvec3<GLsizei> extent( texture.extent( level ) );
-		switch ( texture.target() ) {
-		case gli::TARGET_2D:
-		case gli::TARGET_CUBE:
-			if ( gli::is_compressed( texture.format() ) )
-				glCompressedTexImage2D(
-					gli::is_target_cube( texture.target() ) ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face) 
-					: target,
-					static_cast<GLint>(level),
-					fmt.Internal,
-					extent.x, extent.y,
-					0,
-					static_cast<GLsizei>(texture.size( level )),
-					texture.data( layer, face, level ) );
-			else
-				glTexImage2D(
-					gli::is_target_cube( texture.target() ) ? static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
-					: target,
-					static_cast<GLint>(level),
-					fmt.Internal,
-					extent.x, extent.y,
-					0,
-					fmt.External, fmt.Type,
-					texture.data( layer, face, level ) );
-			break;
-		default:
-			return 0;
-		}
-	}
+	if ( !GLI_upload_levels( texture, fmt, target, baseLevel, texture.levels(), false ) )
+		return 0;
+
 	return id;
 }
 
+// (public function, documented in gltexloaders.h)
+bool texLoadLevels( gli::texture & texture, GLenum target, GLuint id, GLuint level )
+{
+	if ( texture.empty() || level >= texture.levels() )
+		return false;
+
+	glBindTexture( target, id );
+
+	GLint base = 0;
+	glGetTexParameteriv( target, GL_TEXTURE_BASE_LEVEL, &base );
+	if ( static_cast<GLint>(level) >= base )
+		return true;
+
+	gli::gl glProfile( gli::gl::PROFILE_GL33 );
+	gli::gl::format const format = glProfile.translate( texture.format(), texture.swizzles() );
+
+	if ( !GLI_upload_levels( texture, format, target, level, base, extStorageSupported ) )
+		return false;
+
+	glTexParameteri( target, GL_TEXTURE_BASE_LEVEL, static_cast<GLint>(level) );
+	return true;
+}
+
 //! Rewrite of gli::load_dds to not crash on invalid textures
 gli::texture load_if_valid( const char * data, unsigned int size )
 {
@@ -1118,6 +890,36 @@ bool texLoad( const QString & filepath, QString & format, GLenum & target, GLuin
 	return texLoad( filepath, format, target, width, height, mipmaps, *(new QByteArray()), id );
 }
 
+//! Queries the size of a loaded texture and warns about non power of two dimensions
+static bool texLoadFinish( const QString & filepath, GLenum & target, GLuint & width, GLuint & height, GLuint mipmaps )
+{
+	if ( !target )
+		target = GL_TEXTURE_2D;
+
+	if ( mipmaps == 0 )
+		throw QString( "unknown texture format" );
+
+	GLenum t = target;
+	if ( target == GL_TEXTURE_CUBE_MAP )
+		t = GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+
+	if ( !width || !height ) {
+		glGetTexLevelParameteriv( t, 0, GL_TEXTURE_WIDTH, (GLint *)&width );
+		glGetTexLevelParameteriv( t, 0, GL_TEXTURE_HEIGHT, (GLint *)&height );
+	}
+
+	// Power of Two check
+	if ( (width & (width - 1)) || (height & (height - 1)) ) {
+		QString file = filepath;
+		file.replace( '/', "\\" );
+		Message::append( "One or more texture dimensions are not a power of two.",
+						 QString( "'%1' is %2 x %3." ).arg( file ).arg( width ).arg( height )
+		);
+	}
+
+	return true;
+}
+
 bool texLoad( const QString & filepath, QString & format, GLenum & target, GLuint & width, GLuint & height, GLuint & mipmaps, QByteArray & data, GLuint & id )
 {
 	width = height = mipmaps = 0;
@@ -1140,48 +942,77 @@ bool texLoad( const QString & filepath, QString & format, GLenum & target, GLuin
 	if ( !f.open( QIODevice::ReadWrite ) )
 		throw QString( "could not open buffer" );
 
-	bool isSupported = true;
-	if ( filepath.endsWith( ".dds", Qt::CaseInsensitive ) )
-		mipmaps = texLoadDDS( filepath, format, target, width, height, mipmaps, data, id );
-	else if ( filepath.endsWith( ".tga", Qt::CaseInsensitive ) )
+	if ( filepath.endsWith( ".dds", Qt::CaseInsensitive ) ) {
+		gli::texture texture = texDecode( filepath, data );
+		mipmaps = texLoadDDS( filepath, format, target, width, height, mipmaps, texture, id );
+	} else if ( filepath.endsWith( ".tga", Qt::CaseInsensitive ) )
 		mipmaps = texLoadTGA( f, format, target, width, height, id );
 	else if ( filepath.endsWith( ".bmp", Qt::CaseInsensitive ) )
 		mipmaps = texLoadBMP( f, format, target, width, height, id );
 	else if ( filepath.endsWith( ".nif", Qt::CaseInsensitive ) || filepath.endsWith( ".texcache", Qt::CaseInsensitive ) )
 		mipmaps = texLoadNIF( f, format, target, width, height, id );
-	else
-		isSupported = false;
 	
 	f.close();
 	data.clear();
 
-	if ( mipmaps == 0 )
-		isSupported = false;
+	return texLoadFinish( filepath, target, width, height, mipmaps );
+}
 
-	if ( !target )
-		target = GL_TEXTURE_2D;
+bool texLoad( const QString & filepath, gli::texture & texture, QString & format, GLenum & target, GLuint & width, GLuint & height, GLuint & mipmaps, GLuint & id, GLuint baseLevel )
+{
+	width = height = mipmaps = 0;
 
-	if ( isSupported ) {
-		GLenum t = target;
-		if ( target == GL_TEXTURE_CUBE_MAP )
-			t = GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+	if ( format.isEmpty() )
+		format = QFileInfo( filepath ).suffix().toUpper();
 
-		glGetTexLevelParameteriv( t, 0, GL_TEXTURE_WIDTH, (GLint *)&width );
-		glGetTexLevelParameteriv( t, 0, GL_TEXTURE_HEIGHT, (GLint *)&height );
-	} else {
-		throw QString( "unknown texture format" );
-	}
+	mipmaps = texLoadDDS( filepath, format, target, width, height, mipmaps, texture, id, baseLevel );
 
-	// Power of Two check
-	if ( (width & (width - 1)) || (height & (height - 1)) ) {
-		QString file = filepath;
-		file.replace( '/', "\\" );
-		Message::append( "One or more texture dimensions are not a power of two.",
-						 QString( "'%1' is %2 x %3." ).arg( file ).arg( width ).arg( height )
-		);
+	return texLoadFinish( filepath, target, width, height, mipmaps );
+}
+
+gli::texture texDecode( const QString & filepath, const QByteArray & data )
+{
+	if ( data.isEmpty() )
+		return gli::texture();
+
+	// Only textures which the upload can handle are decoded
+	if ( !extStorageSupported && !glCompressedTexImage2D )
+		return gli::texture();
+
+	if ( filepath.endsWith( ".dds", Qt::CaseInsensitive ) )
+		return load_if_valid( data.constData(), data.size() );
+
+	bool tga = filepath.endsWith( ".tga", Qt::CaseInsensitive );
+	if ( !tga && !filepath.endsWith( ".bmp", Qt::CaseInsensitive ) )
+		return gli::texture();
+
+	// TGA and BMP are converted to RGBA8 with a full mip chain
+	QBuffer f;
+	f.setData( data );
+	if ( !f.open( QIODevice::ReadOnly ) )
+		return gli::texture();
+
+	RGBALevels levels;
+	QString format;
+	GLuint width = 0, height = 0;
+
+	try
+	{
+		levels = tga ? decodeTGA( f, format, width, height ) : decodeBMP( f, format, width, height );
 	}
+	catch ( QString & )
+	{
+		// Loading again during the upload reports the error
+		return gli::texture();
+	}
+
+	gli::texture texture( gli::TARGET_2D, gli::FORMAT_RGBA8_UNORM_PACK8,
+						  gli::texture::extent_type( width, height, 1 ), 1, 1, levels.count() );
+
+	for ( int m = 0; m < levels.count(); m++ )
+		std::memcpy( texture.data( 0, 0, m ), levels.at( m ).constData(), levels.at( m ).size() );
 
-	return isSupported;
+	return texture;
 }
 
 bool texIsSupported( const QString & filepath )
@@ -54,9 +54,9 @@ typedef unsigned int GLenum;
 //! Initialize the GL functions necessary for texture loading
 extern void initializeTextureLoaders( const QOpenGLContext * context );
 //! Create texture with glTexStorage2D using GLI
-extern GLuint GLI_create_texture( gli::texture& texture, GLenum& target, GLuint& id );
+extern GLuint GLI_create_texture( gli::texture& texture, GLenum& target, GLuint& id, GLuint baseLevel = 0 );
 //! Fallback for systems that do not have glTexStorage2D
-extern GLuint GLI_create_texture_fallback( gli::texture& texture, GLenum & target, GLuint& id );
+extern GLuint GLI_create_texture_fallback( gli::texture& texture, GLenum & target, GLuint& id, GLuint baseLevel = 0 );
 //! Rewrite of gli::load_dds to not crash on invalid textures
 extern gli::texture load_if_valid( const char * data, unsigned int size );
 
@@ -79,6 +79,35 @@ extern gli::texture load_if_valid( const char * data, unsigned int size );
 extern bool texLoad( const QString & filepath, QString & format, GLenum & target, GLuint & width, GLuint & height, GLuint & mipmaps, GLuint & id );
 extern bool texLoad( const QString & filepath, QString & format, GLenum & target, GLuint & width, GLuint & height, GLuint & mipmaps, QByteArray & data, GLuint & id );
 
+/*! Loads a texture decoded by texDecode.
+ *
+ * Only the upload happens here; the texture is cleared afterwards.
+ * Mip levels below baseLevel are left out; texLoadLevels() adds them later
+ * from a copy of the texture.
+ */
+extern bool texLoad( const QString & filepath, gli::texture & texture, QString & format, GLenum & target, GLuint & width, GLuint & height, GLuint & mipmaps, GLuint & id, GLuint baseLevel = 0 );
+
+/*! Uploads the mip levels of a texture loaded with a base level above level.
+ *
+ * Uploads the levels from level up to the current base level, then lowers the
+ * base level to level.
+ */
+extern bool texLoadLevels( gli::texture & texture, GLenum target, GLuint id, GLuint level );
+
+/*! Decodes the parts of a texture which do not need GL.
+ *
+ * DDS files are parsed into a gli::texture. TGA and BMP files are converted to RGBA8
+ * with a full mip chain built on the CPU. Other formats are decoded while they are
+ * uploaded and give an empty texture. Safe to call from any thread.
+ *
+ * @param filepath	The path of the texture, used for its extension.
+ * @param data		The contents of the texture file.
+ */
+extern gli::texture texDecode( const QString & filepath, const QByteArray & data );
+
+//! Sets whether mip levels built on the CPU are filtered in linear space
+extern void texSetGammaCorrectMipmaps( bool enable );
+
 /*! A function for loading textures.
  *
  * Loads a texture pointed to by model index.
@@ -0,0 +1,355 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#include "gltexpaths.h"
+
+#include <fsengine/fsmanager.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QRegularExpression>
+#include <QSettings>
+#include <QThread>
+
+
+//! Global texture path resolver
+static TexturePaths * theTexturePaths = nullptr;
+static QMutex theTexturePathsMutex;
+
+static QString joinPath( const QString & dir, const QString & name )
+{
+	return dir.endsWith( '/' ) ? dir + name : dir + '/' + name;
+}
+
+// see gltexpaths.h
+TexturePaths * TexturePaths::get()
+{
+	QMutexLocker lock( &theTexturePathsMutex );
+	if ( !theTexturePaths ) {
+		theTexturePaths = new TexturePaths();
+		// The watcher needs an event loop; the first lookup may come from a loading thread
+		if ( QCoreApplication::instance() )
+			theTexturePaths->moveToThread( QCoreApplication::instance()->thread() );
+	}
+	return theTexturePaths;
+}
+
+// see gltexpaths.h
+TexturePaths::TexturePaths( QObject * parent )
+	: QObject( parent )
+{
+	watcher = new QFileSystemWatcher( this );
+	connect( watcher, &QFileSystemWatcher::directoryChanged, this, &TexturePaths::directoryChanged );
+
+	QSettings settings;
+	resourceFolders = settings.value( "Settings/Resources/Folders", QStringList() ).toStringList();
+	alternateExtensions = settings.value( "Settings/Resources/Alternate Extensions", false ).toBool();
+}
+
+// see gltexpaths.h
+void TexturePaths::updateSettings()
+{
+	QSettings settings;
+
+	QMutexLocker lock( &mutex );
+	resourceFolders = settings.value( "Settings/Resources/Folders", QStringList() ).toStringList();
+	alternateExtensions = settings.value( "Settings/Resources/Alternate Extensions", false ).toBool();
+
+	// The archives may have changed as well
+	listings.clear();
+	listingsGeneration++;
+	pendingWatches.clear();
+	missing.clear();
+
+	if ( !watcher->directories().isEmpty() )
+		watcher->removePaths( watcher->directories() );
+}
+
+void TexturePaths::directoryChanged( const QString & path )
+{
+	QString dir = QDir::cleanPath( path );
+
+	QMutexLocker lock( &mutex );
+
+	// Subdirectories which did not exist are listed as empty, so drop them too
+	QString prefix = joinPath( dir, QString() );
+	for ( auto it = listings.begin(); it != listings.end(); ) {
+		if ( it.key() == dir || it.key().startsWith( prefix ) )
+			it = listings.erase( it );
+		else
+			++it;
+	}
+	listingsGeneration++;
+
+	missing.clear();
+
+	if ( watcher->directories().contains( path ) )
+		watcher->removePath( path );
+}
+
+void TexturePaths::watchPending()
+{
+	QStringList dirs;
+	{
+		QMutexLocker lock( &mutex );
+		dirs.swap( pendingWatches );
+	}
+
+	if ( !dirs.isEmpty() )
+		watcher->addPaths( dirs );
+}
+
+// see gltexpaths.h
+TexturePaths::Listing TexturePaths::listing( const QString & dir )
+{
+	int generation;
+	{
+		QMutexLocker lock( &mutex );
+		auto it = listings.constFind( dir );
+		if ( it != listings.constEnd() )
+			return it.value();
+
+		generation = listingsGeneration;
+	}
+
+	// Read the directory without the lock so that other loading threads are not held up by the disk
+	Listing l;
+	QDir d( dir );
+	bool exists = d.exists();
+	if ( exists ) {
+		for ( const QString & name : d.entryList( QDir::Files | QDir::Hidden | QDir::System ) )
+			l.files.insert( name.toLower(), name );
+		for ( const QString & name : d.entryList( QDir::Dirs | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot ) )
+			l.dirs.insert( name.toLower(), name );
+	}
+
+	QMutexLocker lock( &mutex );
+
+	// Another thread may have listed the directory meanwhile; the first listing is kept
+	auto it = listings.constFind( dir );
+	if ( it != listings.constEnd() )
+		return it.value();
+
+	// The directory changed while it was read, so the listing may already be stale
+	if ( generation != listingsGeneration )
+		return l;
+
+	if ( exists ) {
+		if ( pendingWatches.isEmpty() )
+			QMetaObject::invokeMethod( this, "watchPending", Qt::QueuedConnection );
+		pendingWatches << dir;
+	}
+
+	return listings.insert( dir, l ).value();
+}
+
+// see gltexpaths.h
+QString TexturePaths::lookup( const QString & dir, const QString & relative )
+{
+	if ( dir.isEmpty() || relative.isEmpty() )
+		return QString();
+
+	QStringList parts = FSManager::normalizePath( relative ).split( '/', QString::SkipEmptyParts );
+	if ( parts.isEmpty() )
+		return QString();
+
+	QString path = QDir::cleanPath( QDir( dir ).absolutePath() );
+
+	for ( int i = 0; i < parts.count(); i++ ) {
+		const QString & part = parts.at( i );
+		bool last = ( i + 1 == parts.count() );
+
+		if ( part == "." && !last )
+			continue;
+
+		if ( part == ".." && !last ) {
+			path = QDir::cleanPath( joinPath( path, ".." ) );
+			continue;
+		}
+
+		Listing l = listing( path );
+		const QHash<QString, QString> & names = last ? l.files : l.dirs;
+
+		auto it = names.constFind( part );
+		if ( it == names.constEnd() )
+			return QString();
+
+		path = joinPath( path, it.value() );
+	}
+
+	return path;
+}
+
+// see gltexpaths.h
+QStringList TexturePaths::folders( const QString & nifFolder )
+{
+	TexturePaths * paths = get();
+
+	QStringList list;
+	{
+		QMutexLocker lock( &paths->mutex );
+		list = paths->resourceFolders;
+	}
+
+	for ( QString & folder : list ) {
+		// TODO: Always search nifdir without requiring a relative entry
+		// in folders?  Not too intuitive to require ".\" in your texture folder list
+		// even if it is added by default.
+		if ( folder.startsWith( "./" ) || folder.startsWith( ".\\" ) )
+			folder = nifFolder + "/" + folder;
+	}
+
+	return list;
+}
+
+// see gltexpaths.h
+QString TexturePaths::find( const QString & file, const QString & nifFolder, QByteArray & data )
+{
+	if ( file.isEmpty() )
+		return QString();
+
+	TexturePaths * paths = get();
+
+	QString key = file + QChar( '\n' ) + nifFolder;
+	{
+		QMutexLocker lock( &paths->mutex );
+		auto it = paths->missing.constFind( key );
+		if ( it != paths->missing.constEnd() )
+			return it.value();
+	}
+
+	bool found = true;
+	QString filepath = paths->resolve( file, nifFolder, data, found );
+
+	if ( !found ) {
+		QMutexLocker lock( &paths->mutex );
+		paths->missing.insert( key, filepath );
+	}
+
+	return filepath;
+}
+
+// see gltexpaths.h
+QString TexturePaths::resolve( const QString & file, const QString & nifdir, QByteArray & data, bool & found )
+{
+	found = true;
+
+	if ( QDir::isAbsolutePath( file ) && QFile::exists( file ) )
+		return file;
+
+	bool textureAlternatives;
+	{
+		QMutexLocker lock( &mutex );
+		textureAlternatives = alternateExtensions;
+	}
+
+	QString filename = QDir::toNativeSeparators( file );
+
+	QStringList extensions;
+	extensions << ".dds";
+	bool replaceExt = false;
+
+	if ( textureAlternatives ) {
+		extensions << ".tga" << ".bmp" << ".nif" << ".texcache";
+		for ( const QString ext : QStringList{ extensions } )
+		{
+			if ( filename.endsWith( ext, Qt::CaseInsensitive ) ) {
+				extensions.removeAll( ext );
+				extensions.prepend( ext );
+				filename = filename.left( filename.length() - ext.length() );
+				replaceExt = true;
+				break;
+			}
+		}
+	}
+
+	// Search the NIF root, then the NifSkope dir, then the resource folders
+	QStringList dirs;
+	dirs << nifdir << QDir::currentPath() << folders( nifdir );
+
+	for ( const QString& ext : extensions ) {
+		if ( replaceExt ) {
+			filename += ext;
+		}
+
+		for ( const QString & dir : dirs ) {
+			QString path = lookup( dir, filename );
+			if ( !path.isEmpty() )
+				return QDir::toNativeSeparators( path );
+		}
+
+		// Search through archives last, and load any requested textures into memory.
+		QByteArray outData;
+		if ( FSManager::fileContents( filename, outData ) && !outData.isEmpty() ) {
+			data = outData;
+			return QDir::toNativeSeparators( FSManager::normalizePath( filename ) );
+		}
+
+		// For Skyrim and FO4 which occasionally leave the textures off
+		if ( !filename.startsWith( "textures", Qt::CaseInsensitive ) ) {
+			QString original = filename;
+			QRegularExpression re( "textures[\\\\/]", QRegularExpression::CaseInsensitiveOption );
+			int texIdx = filename.indexOf( re );
+			if ( texIdx > 0 ) {
+				filename.remove( 0, texIdx );
+			} else {
+				while ( filename.startsWith( "/" ) || filename.startsWith( "\\" ) )
+					filename.remove( 0, 1 );
+
+				if ( !filename.startsWith( "textures", Qt::CaseInsensitive ) && !filename.startsWith( "shaders", Qt::CaseInsensitive ) )
+					filename.prepend( "textures\\" );
+			}
+
+			// Shader paths are not moved under textures
+			if ( filename != original )
+				return resolve( filename, nifdir, data, found );
+		}
+
+		if ( !replaceExt )
+			break;
+
+		// Remove file extension
+		filename = filename.left( filename.length() - ext.length() );
+	}
+
+	found = false;
+
+	// Fix separators
+	filename = QDir::toNativeSeparators( filename );
+
+	if ( replaceExt )
+		return filename + extensions.value( 0 ); // Restore original file extension
+
+	return filename;
+}
@@ -0,0 +1,111 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#ifndef GLTEXPATHS_H
+#define GLTEXPATHS_H
+
+
+#include <QObject> // Inherited
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+
+class QFileSystemWatcher;
+
+//! \file gltexpaths.h TexturePaths
+
+//! Resolves texture file names against the NIF folder, the resource folders and the archives.
+/*!
+ * Directory listings are read the first time a lookup passes through a directory and are
+ * kept current by a QFileSystemWatcher, so repeated lookups do not touch the disk. Names
+ * which could not be resolved are remembered until a watched directory or the settings change.
+ */
+class TexturePaths final : public QObject
+{
+	Q_OBJECT
+
+public:
+	//! Gets the global resolver
+	static TexturePaths * get();
+
+	//! Find a texture based on its filename; archive contents are read into data
+	static QString find( const QString & file, const QString & nifFolder, QByteArray & data );
+	//! The resource folders, with relative entries resolved against nifFolder
+	static QStringList folders( const QString & nifFolder );
+
+public slots:
+	//! Re-reads the resource settings and drops every cached listing and result
+	void updateSettings();
+
+protected slots:
+	void directoryChanged( const QString & path );
+	//! Starts watching the directories listed since the last call
+	void watchPending();
+
+protected:
+	TexturePaths( QObject * parent = nullptr );
+
+	//! The contents of a directory, lowercase name to name on disk
+	struct Listing
+	{
+		QHash<QString, QString> files;
+		QHash<QString, QString> dirs;
+	};
+
+	//! Resolves a path relative to dir using the cached listings; empty if it does not exist
+	QString lookup( const QString & dir, const QString & relative );
+	//! Returns the listing of an absolute directory, reading it outside the mutex if needed
+	Listing listing( const QString & dir );
+	//! The uncached search behind find(); found is false if the fallback name is returned
+	QString resolve( const QString & file, const QString & nifFolder, QByteArray & data, bool & found );
+
+	QFileSystemWatcher * watcher;
+
+	//! Guards everything below; find() is called from texture loading threads
+	QMutex mutex;
+	QHash<QString, Listing> listings;
+	//! Bumped when listings are dropped, so that listings read meanwhile are not cached
+	int listingsGeneration = 0;
+	//! Directories listed but not watched yet
+	QStringList pendingWatches;
+	//! Unresolved lookups, keyed by file and NIF folder, to the fallback name
+	QHash<QString, QString> missing;
+
+	//! "Settings/Resources/Folders"
+	QStringList resourceFolders;
+	//! "Settings/Resources/Alternate Extensions"
+	bool alternateExtensions = false;
+};
+
+#endif
@@ -0,0 +1,648 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#include "gltexpixels.h"
+
+#include <QIODevice>
+#include <QString>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXPIXELS_SSE2
+#include <emmintrin.h>
+#endif
+
+
+//! @file gltexpixels.cpp CPU pixel operations for texture loading
+
+//! sRGB to linear conversion of 8-bit channels
+static const float * srgbToLinear()
+{
+	static const struct Table
+	{
+		float v[256];
+
+		Table()
+		{
+			for ( int i = 0; i < 256; i++ ) {
+				float c = i / 255.0f;
+				v[i] = ( c <= 0.04045f ) ? c / 12.92f : std::pow( (c + 0.055f) / 1.055f, 2.4f );
+			}
+		}
+	} table;
+
+	return table.v;
+}
+
+//! Linear to sRGB conversion, indexed by the linear value in 1/4095 steps
+static const quint8 * linearToSrgb()
+{
+	static const struct Table
+	{
+		quint8 v[4096];
+
+		Table()
+		{
+			for ( int i = 0; i < 4096; i++ ) {
+				float c = i / 4095.0f;
+				c = ( c <= 0.0031308f ) ? c * 12.92f : 1.055f * std::pow( c, 1.0f / 2.4f ) - 0.055f;
+				v[i] = quint8( std::min( std::max( c * 255.0f + 0.5f, 0.0f ), 255.0f ) );
+			}
+		}
+	} table;
+
+	return table.v;
+}
+
+//! Averages the 2x2 block at (x0, x1) of rows r0 and r1 into one pixel
+static inline void averageBlock( const quint8 * r0, const quint8 * r1, int x0, int x1, quint8 * out )
+{
+	for ( int c = 0; c < 4; c++ )
+		out[c] = quint8( ( r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2 ) >> 2 );
+}
+
+//! Gamma-correct version of averageBlock(); alpha is averaged as is
+static inline void averageBlockLinear( const quint8 * r0, const quint8 * r1, int x0, int x1, quint8 * out )
+{
+	const float * toLinear = srgbToLinear();
+	const quint8 * toSrgb = linearToSrgb();
+
+	for ( int c = 0; c < 3; c++ ) {
+		float sum = toLinear[r0[x0 + c]] + toLinear[r0[x1 + c]] + toLinear[r1[x0 + c]] + toLinear[r1[x1 + c]];
+		out[c] = toSrgb[int( sum * (4095.0f / 4.0f) + 0.5f )];
+	}
+
+	out[3] = quint8( ( r0[x0 + 3] + r0[x1 + 3] + r1[x0 + 3] + r1[x1 + 3] + 2 ) >> 2 );
+}
+
+#ifdef TEXPIXELS_SSE2
+/*! Averages 2x2 blocks of two full rows into dw pixels, two pixels at a time.
+ *
+ * Returns the number of pixels written; the caller handles the rest.
+ */
+static int averageRowsSSE2( const quint8 * r0, const quint8 * r1, int dw, quint8 * out )
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16( 2 );
+
+	int x = 0;
+	for ( ; x + 2 <= dw; x += 2 ) {
+		// Four source pixels from each row
+		__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i *>( r0 + x * 8 ) );
+		__m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i *>( r1 + x * 8 ) );
+
+		// Vertical sums as 16-bit channels: lo holds pixels 0 and 1, hi pixels 2 and 3
+		__m128i lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+		__m128i hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+
+		// Horizontal sums of neighbouring pixels end up in the low halves
+		lo = _mm_add_epi16( lo, _mm_shuffle_epi32( lo, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		hi = _mm_add_epi16( hi, _mm_shuffle_epi32( hi, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+
+		__m128i sum = _mm_unpacklo_epi64( lo, hi );
+		sum = _mm_srli_epi16( _mm_add_epi16( sum, two ), 2 );
+
+		_mm_storel_epi64( reinterpret_cast<__m128i *>( out + x * 4 ), _mm_packus_epi16( sum, zero ) );
+	}
+
+	return x;
+}
+#endif
+
+void downsampleRGBA( const quint8 * src, int w, int h, quint8 * dst, bool gammaCorrect )
+{
+	int dw = std::max( w / 2, 1 );
+	int dh = std::max( h / 2, 1 );
+
+	// Offsets of the second pixel of each block; 0 if the dimension is 1
+	int xo = ( w > 1 ) ? 4 : 0;
+	int yo = ( h > 1 ) ? w * 4 : 0;
+
+	for ( int y = 0; y < dh; y++ ) {
+		const quint8 * r0 = src + y * 2 * w * 4;
+		const quint8 * r1 = r0 + yo;
+		quint8 * out = dst + y * dw * 4;
+
+		int x = 0;
+
+#ifdef TEXPIXELS_SSE2
+		if ( !gammaCorrect && w > 1 )
+			x = averageRowsSSE2( r0, r1, dw, out );
+#endif
+
+		for ( ; x < dw; x++ ) {
+			if ( gammaCorrect )
+				averageBlockLinear( r0, r1, x * 8, x * 8 + xo, out + x * 4 );
+			else
+				averageBlock( r0, r1, x * 8, x * 8 + xo, out + x * 4 );
+		}
+	}
+}
+
+void buildMipChain( RGBALevels & levels, int width, int height, bool gammaCorrect )
+{
+	if ( levels.isEmpty() )
+		return;
+
+	int m = levels.count() - 1;
+	int w = std::max( width >> m, 1 );
+	int h = std::max( height >> m, 1 );
+
+	while ( w > 1 || h > 1 ) {
+		int dw = std::max( w / 2, 1 );
+		int dh = std::max( h / 2, 1 );
+
+		QByteArray next( dw * dh * 4, Qt::Uninitialized );
+		downsampleRGBA( reinterpret_cast<const quint8 *>( levels.last().constData() ), w, h,
+						reinterpret_cast<quint8 *>( next.data() ), gammaCorrect );
+		levels << next;
+
+		w = dw;
+		h = dh;
+	}
+}
+
+bool uncompressRLE( QIODevice & f, int w, int h, int bytespp, quint8 * pixel )
+{
+	qint64 start = f.pos();
+	QByteArray data = f.readAll();
+
+	const quint8 * in = reinterpret_cast<const quint8 *>( data.constData() );
+	const quint8 * end = in + data.size();
+
+	qint64 remaining = qint64( w ) * h; // pixels left to write
+
+	while ( remaining > 0 ) {
+		if ( in >= end )
+			return false;
+
+		quint8 packet = *in++;
+		qint64 count = std::min<qint64>( (packet & 0x7f) + 1, remaining );
+
+		if ( packet & 0x80 ) {
+			// RLE packet: one pixel repeated count times
+			if ( end - in < bytespp )
+				return false;
+
+			std::memcpy( pixel, in, bytespp );
+			in += bytespp;
+
+			// Double the filled span until the run is complete
+			qint64 filled = bytespp;
+			qint64 total = count * bytespp;
+			while ( filled < total ) {
+				qint64 n = std::min( filled, total - filled );
+				std::memcpy( pixel + filled, pixel, n );
+				filled += n;
+			}
+		} else {
+			// Raw packet: count pixels
+			qint64 bytes = count * bytespp;
+			if ( end - in < bytes )
+				return false;
+
+			std::memcpy( pixel, in, bytes );
+			in += bytes;
+		}
+
+		pixel += count * bytespp;
+		remaining -= count;
+	}
+
+	// Leave the device after this image so that the next mip level can follow
+	if ( !f.isSequential() )
+		f.seek( start + ( in - reinterpret_cast<const quint8 *>( data.constData() ) ) );
+
+	return true;
+}
+
+//! Source layouts with a specialized converter
+enum class PixelLayout
+{
+	Generic, RGBA8, BGRA8, RGB8, BGR8, RGB565, L8, LA8, A8
+};
+
+static PixelLayout pixelLayout( int bytespp, const quint32 mask[] )
+{
+	auto is = [mask]( quint32 r, quint32 g, quint32 b, quint32 a ) {
+		return mask[0] == r && mask[1] == g && mask[2] == b && mask[3] == a;
+	};
+
+	switch ( bytespp ) {
+	case 4:
+		if ( is( 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 ) )
+			return PixelLayout::RGBA8;
+		if ( is( 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 ) )
+			return PixelLayout::BGRA8;
+		break;
+	case 3:
+		if ( is( 0x000000ff, 0x0000ff00, 0x00ff0000, 0 ) )
+			return PixelLayout::RGB8;
+		if ( is( 0x00ff0000, 0x0000ff00, 0x000000ff, 0 ) )
+			return PixelLayout::BGR8;
+		break;
+	case 2:
+		if ( is( 0xf800, 0x07e0, 0x001f, 0 ) )
+			return PixelLayout::RGB565;
+		if ( is( 0x00ff, 0x00ff, 0x00ff, 0xff00 ) )
+			return PixelLayout::LA8;
+		break;
+	case 1:
+		if ( is( 0xff, 0xff, 0xff, 0 ) )
+			return PixelLayout::L8;
+		if ( is( 0, 0, 0, 0xff ) )
+			return PixelLayout::A8;
+		break;
+	}
+
+	return PixelLayout::Generic;
+}
+
+static inline quint32 load32( const quint8 * p )
+{
+	quint32 v;
+	std::memcpy( &v, p, 4 );
+	return v;
+}
+
+static inline quint16 load16( const quint8 * p )
+{
+	quint16 v;
+	std::memcpy( &v, p, 2 );
+	return v;
+}
+
+//! Converts one row of n pixels; rows are flipped by the caller
+typedef void (*RowConverter)( const quint8 * src, int n, quint32 * dst );
+
+static void rowRGBA8( const quint8 * src, int n, quint32 * dst )
+{
+	std::memcpy( dst, src, size_t( n ) * 4 );
+}
+
+static void rowBGRA8( const quint8 * src, int n, quint32 * dst )
+{
+	int x = 0;
+
+#ifdef TEXPIXELS_SSE2
+	const __m128i ga = _mm_set1_epi32( int( 0xff00ff00 ) );
+	const __m128i lo = _mm_set1_epi32( 0xff );
+
+	for ( ; x + 4 <= n; x += 4 ) {
+		__m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + x * 4 ) );
+		__m128i r = _mm_and_si128( _mm_srli_epi32( p, 16 ), lo );
+		__m128i b = _mm_slli_epi32( _mm_and_si128( p, lo ), 16 );
+		p = _mm_or_si128( _mm_and_si128( p, ga ), _mm_or_si128( r, b ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x ), p );
+	}
+#endif
+
+	for ( ; x < n; x++ ) {
+		quint32 p = load32( src + x * 4 );
+		dst[x] = ( p & 0xff00ff00 ) | ( ( p >> 16 ) & 0xff ) | ( ( p & 0xff ) << 16 );
+	}
+}
+
+static void rowRGB8( const quint8 * src, int n, quint32 * dst )
+{
+	for ( int x = 0; x < n; x++, src += 3 )
+		dst[x] = quint32( src[0] ) | ( quint32( src[1] ) << 8 ) | ( quint32( src[2] ) << 16 ) | 0xff000000;
+}
+
+static void rowBGR8( const quint8 * src, int n, quint32 * dst )
+{
+	for ( int x = 0; x < n; x++, src += 3 )
+		dst[x] = quint32( src[2] ) | ( quint32( src[1] ) << 8 ) | ( quint32( src[0] ) << 16 ) | 0xff000000;
+}
+
+//! Expands 5 and 6 bit channels by replicating their high bits
+static inline quint32 expand565( quint16 p )
+{
+	quint32 r = ( p >> 11 ) & 0x1f;
+	quint32 g = ( p >> 5 ) & 0x3f;
+	quint32 b = p & 0x1f;
+
+	r = ( r << 3 ) | ( r >> 2 );
+	g = ( g << 2 ) | ( g >> 4 );
+	b = ( b << 3 ) | ( b >> 2 );
+
+	return r | ( g << 8 ) | ( b << 16 ) | 0xff000000;
+}
+
+static void rowRGB565( const quint8 * src, int n, quint32 * dst )
+{
+	int x = 0;
+
+#ifdef TEXPIXELS_SSE2
+	const __m128i m5 = _mm_set1_epi16( 0x1f );
+	const __m128i m6 = _mm_set1_epi16( 0x3f );
+	const __m128i alpha = _mm_set1_epi16( short( 0xff00 ) );
+
+	for ( ; x + 8 <= n; x += 8 ) {
+		__m128i p = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + x * 2 ) );
+
+		__m128i r = _mm_and_si128( _mm_srli_epi16( p, 11 ), m5 );
+		__m128i g = _mm_and_si128( _mm_srli_epi16( p, 5 ), m6 );
+		__m128i b = _mm_and_si128( p, m5 );
+
+		r = _mm_or_si128( _mm_slli_epi16( r, 3 ), _mm_srli_epi16( r, 2 ) );
+		g = _mm_or_si128( _mm_slli_epi16( g, 2 ), _mm_srli_epi16( g, 4 ) );
+		b = _mm_or_si128( _mm_slli_epi16( b, 3 ), _mm_srli_epi16( b, 2 ) );
+
+		// 16-bit lanes of R | G << 8 and B | A << 8, interleaved into RGBA
+		__m128i rg = _mm_or_si128( r, _mm_slli_epi16( g, 8 ) );
+		__m128i ba = _mm_or_si128( b, alpha );
+
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x ), _mm_unpacklo_epi16( rg, ba ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 4 ), _mm_unpackhi_epi16( rg, ba ) );
+	}
+#endif
+
+	for ( ; x < n; x++ )
+		dst[x] = expand565( load16( src + x * 2 ) );
+}
+
+static void rowL8( const quint8 * src, int n, quint32 * dst )
+{
+	int x = 0;
+
+#ifdef TEXPIXELS_SSE2
+	const __m128i ones = _mm_set1_epi8( char( 0xff ) );
+
+	for ( ; x + 16 <= n; x += 16 ) {
+		__m128i l = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + x ) );
+
+		__m128i ll = _mm_unpacklo_epi8( l, l );
+		__m128i la = _mm_unpacklo_epi8( l, ones );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x ), _mm_unpacklo_epi16( ll, la ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 4 ), _mm_unpackhi_epi16( ll, la ) );
+
+		ll = _mm_unpackhi_epi8( l, l );
+		la = _mm_unpackhi_epi8( l, ones );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 8 ), _mm_unpacklo_epi16( ll, la ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 12 ), _mm_unpackhi_epi16( ll, la ) );
+	}
+#endif
+
+	for ( ; x < n; x++ )
+		dst[x] = src[x] * 0x010101u | 0xff000000;
+}
+
+static void rowLA8( const quint8 * src, int n, quint32 * dst )
+{
+	int x = 0;
+
+#ifdef TEXPIXELS_SSE2
+	const __m128i lo = _mm_set1_epi16( 0xff );
+
+	for ( ; x + 8 <= n; x += 8 ) {
+		__m128i la = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + x * 2 ) );
+		__m128i l = _mm_and_si128( la, lo );
+		__m128i ll = _mm_or_si128( l, _mm_slli_epi16( l, 8 ) );
+
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x ), _mm_unpacklo_epi16( ll, la ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 4 ), _mm_unpackhi_epi16( ll, la ) );
+	}
+#endif
+
+	for ( ; x < n; x++ )
+		dst[x] = src[x * 2] * 0x010101u | ( quint32( src[x * 2 + 1] ) << 24 );
+}
+
+static void rowA8( const quint8 * src, int n, quint32 * dst )
+{
+	int x = 0;
+
+#ifdef TEXPIXELS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+
+	for ( ; x + 16 <= n; x += 16 ) {
+		__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i *>( src + x ) );
+
+		__m128i za = _mm_unpacklo_epi8( zero, a );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x ), _mm_unpacklo_epi16( zero, za ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 4 ), _mm_unpackhi_epi16( zero, za ) );
+
+		za = _mm_unpackhi_epi8( zero, a );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 8 ), _mm_unpacklo_epi16( zero, za ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( dst + x + 12 ), _mm_unpackhi_epi16( zero, za ) );
+	}
+#endif
+
+	for ( ; x < n; x++ )
+		dst[x] = quint32( src[x] ) << 24;
+}
+
+//! Shift amounts for RGBA conversion
+static const int rgbashift[4] = {
+	0, 8, 16, 24
+};
+
+//! Per channel conversion for masks without a specialized converter
+static void convertGeneric( const quint8 * data, int w, int h, int bytespp, const quint32 mask[], quint32 * pixl, int stride, int inc )
+{
+	for ( int a = 0; a < 4; a++ ) {
+		if ( mask[a] ) {
+			quint32 msk = mask[ a ];
+			int rshift  = 0;
+
+			while ( msk != 0 && ( msk & 0xffffff00 ) ) {
+				msk = msk >> 1; rshift++;
+			}
+
+			int lshift = rgbashift[ a ];
+
+			while ( msk != 0 && ( ( msk & 0x80 ) == 0 ) ) {
+				msk = msk << 1; lshift++;
+			}
+
+			msk = mask[ a ];
+
+			const quint8 * src = data;
+
+			for ( int y = 0; y < h; y++ ) {
+				quint32 * dst = pixl + y * stride;
+
+				for ( int x = 0; x < w; x++ ) {
+					*dst |= ( load32( src ) & msk ) >> rshift << lshift;
+					dst  += inc;
+					src  += bytespp;
+				}
+			}
+		} else if ( a == 3 ) {
+			for ( int y = 0; y < h; y++ ) {
+				quint32 * dst = pixl + y * stride;
+
+				for ( int x = 0; x < w; x++ ) {
+					*dst |= 0xffu << rgbashift[ a ];
+					dst  += inc;
+				}
+			}
+		}
+	}
+}
+
+void convertToRGBAGeneric( const quint8 * data, int w, int h, int bytespp, const quint32 mask[], bool flipV, bool flipH, quint8 * pixl )
+{
+	quint32 * out = reinterpret_cast<quint32 *>( pixl );
+
+	// Start at the first output pixel of the first source row and walk the rows by stride
+	quint32 * first = out + ( flipV ? w * ( h - 1 ) : 0 ) + ( flipH ? w - 1 : 0 );
+	std::memset( pixl, 0, size_t( w ) * h * 4 );
+	convertGeneric( data, w, h, bytespp, mask, first, flipV ? -w : w, flipH ? -1 : 1 );
+}
+
+void convertToRGBA( const quint8 * data, int w, int h, int bytespp, const quint32 mask[], bool flipV, bool flipH, quint8 * pixl )
+{
+	quint32 * out = reinterpret_cast<quint32 *>( pixl );
+
+	RowConverter row = nullptr;
+
+	switch ( pixelLayout( bytespp, mask ) ) {
+	case PixelLayout::RGBA8:  row = rowRGBA8;  break;
+	case PixelLayout::BGRA8:  row = rowBGRA8;  break;
+	case PixelLayout::RGB8:   row = rowRGB8;   break;
+	case PixelLayout::BGR8:   row = rowBGR8;   break;
+	case PixelLayout::RGB565: row = rowRGB565; break;
+	case PixelLayout::L8:     row = rowL8;     break;
+	case PixelLayout::LA8:    row = rowLA8;    break;
+	case PixelLayout::A8:     row = rowA8;     break;
+	case PixelLayout::Generic:
+		convertToRGBAGeneric( data, w, h, bytespp, mask, flipV, flipH, pixl );
+		return;
+	}
+
+	for ( int y = 0; y < h; y++ ) {
+		quint32 * dst = out + w * ( flipV ? h - y - 1 : y );
+		row( data + size_t( y ) * w * bytespp, w, dst );
+
+		if ( flipH )
+			std::reverse( dst, dst + w );
+	}
+}
+
+void convertPalToRGBA( const quint8 * data, int w, int h, const quint32 colormap[], bool flipV, bool flipH, quint8 * pixl )
+{
+	quint32 * out = reinterpret_cast<quint32 *>( pixl );
+
+	for ( int y = 0; y < h; y++ ) {
+		const quint8 * src = data + size_t( y ) * w;
+		quint32 * dst = out + w * ( flipV ? h - y - 1 : y );
+
+		// SSE2 has no gather; unrolling lets the lookups overlap
+		int x = 0;
+		for ( ; x + 4 <= w; x += 4 ) {
+			dst[x]     = colormap[src[x]];
+			dst[x + 1] = colormap[src[x + 1]];
+			dst[x + 2] = colormap[src[x + 2]];
+			dst[x + 3] = colormap[src[x + 3]];
+		}
+
+		for ( ; x < w; x++ )
+			dst[x] = colormap[src[x]];
+
+		if ( flipH )
+			std::reverse( dst, dst + w );
+	}
+}
+
+RGBALevels decodeRaw( QIODevice & f, int width, int height, int num_mipmaps, int bpp, int bytespp, const quint32 mask[], bool flipV, bool flipH, bool rle, bool gammaCorrect )
+{
+	if ( bytespp * 8 != bpp || bpp > 32 || bpp < 8 )
+		throw QString( "unsupported image depth %1 / %2" ).arg( bpp ).arg( bytespp );
+
+	// convertToRGBA reads whole words, so leave room past the last pixel
+	QByteArray data( width * height * 4, Qt::Uninitialized );
+	quint8 * data1 = (quint8 *)data.data();
+
+	RGBALevels levels;
+
+	for ( int m = 0; m < num_mipmaps; m++ ) {
+		int w = std::max( width >> m, 1 );
+		int h = std::max( height >> m, 1 );
+
+		if ( rle ) {
+			if ( !uncompressRLE( f, w, h, bytespp, data1 ) )
+				throw QString( "unexpected EOF" );
+		} else if ( f.read( (char *)data1, w * h * bytespp ) != w * h * bytespp ) {
+			throw QString( "unexpected EOF" );
+		}
+
+		QByteArray pixl( w * h * 4, Qt::Uninitialized );
+		convertToRGBA( data1, w, h, bytespp, mask, flipV, flipH, (quint8 *)pixl.data() );
+		levels << pixl;
+
+		if ( w == 1 && h == 1 )
+			break;
+	}
+
+	buildMipChain( levels, width, height, gammaCorrect );
+
+	return levels;
+}
+
+RGBALevels decodePal( QIODevice & f, int width, int height, int num_mipmaps, int bpp, int bytespp, const quint32 colormap[], bool flipV, bool flipH, bool rle, bool gammaCorrect )
+{
+	if ( bpp != 8 || bytespp != 1 )
+		throw QString( "unsupported image depth %1 / %2" ).arg( bpp ).arg( bytespp );
+
+	QByteArray indices( width * height, Qt::Uninitialized );
+	quint8 * data = (quint8 *)indices.data();
+
+	RGBALevels levels;
+
+	for ( int m = 0; m < num_mipmaps; m++ ) {
+		int w = std::max( width >> m, 1 );
+		int h = std::max( height >> m, 1 );
+
+		if ( rle ) {
+			if ( !uncompressRLE( f, w, h, bytespp, data ) )
+				throw QString( "unexpected EOF" );
+		} else if ( f.read( (char *)data, w * h * bytespp ) != w * h * bytespp ) {
+			throw QString( "unexpected EOF" );
+		}
+
+		QByteArray pixl( w * h * 4, Qt::Uninitialized );
+		convertPalToRGBA( data, w, h, colormap, flipV, flipH, (quint8 *)pixl.data() );
+		levels << pixl;
+
+		if ( w == 1 && h == 1 )
+			break;
+	}
+
+	buildMipChain( levels, width, height, gammaCorrect );
+
+	return levels;
+}
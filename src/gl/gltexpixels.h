@@ -0,0 +1,118 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+#ifndef GLTEXPIXELS_H
+#define GLTEXPIXELS_H
+
+
+#include <QByteArray>
+#include <QVector>
+
+
+class QIODevice;
+
+
+//! @file gltexpixels.h CPU pixel operations for texture loading
+
+//! Mip levels of an RGBA8 image, largest first, each tightly packed
+typedef QVector<QByteArray> RGBALevels;
+
+/*! Halves an RGBA8 image with a 2x2 box filter.
+ *
+ * A dimension of 1 stays 1; the last row or column of an odd dimension is dropped.
+ * Uses SSE2 where the compiler targets it.
+ *
+ * @param src			The source pixels, w * h * 4 bytes
+ * @param w				Width of the source
+ * @param h				Height of the source
+ * @param dst			The halved pixels
+ * @param gammaCorrect	Average the color channels as linear values, treating them as sRGB
+ */
+void downsampleRGBA( const quint8 * src, int w, int h, quint8 * dst, bool gammaCorrect );
+
+/*! Adds mip levels to an RGBA8 image until the smallest is 1x1.
+ *
+ * @param levels		The levels decoded so far; at least the base level
+ * @param width			Width of the base level
+ * @param height		Height of the base level
+ * @param gammaCorrect	See downsampleRGBA()
+ */
+void buildMipChain( RGBALevels & levels, int width, int height, bool gammaCorrect );
+
+/*! Converts RLE-encoded data into pixel data.
+ *
+ * TGA in particular uses the PackBits format described at
+ * http://en.wikipedia.org/wiki/PackBits and in the TGA spec.
+ * Reads only the packets of the image from f.
+ */
+bool uncompressRLE( QIODevice & f, int w, int h, int bytespp, quint8 * pixel );
+
+/*! Convert pixels to RGBA
+ *
+ * BGRA8, RGBA8, BGR8, RGB8, RGB565, L8, LA8 and A8 masks have specialized converters;
+ * other masks go through a generic per channel conversion. Reads whole 32-bit words,
+ * so data must be readable up to 3 bytes past the last pixel.
+ *
+ * @param data		Pixels to convert
+ * @param w			Width of the image
+ * @param h			Height of the image
+ * @param bytespp	Number of bytes per pixel
+ * @param mask		Bitmask for pixel data
+ * @param flipV		Whether to flip the data vertically
+ * @param flipH		Whether to flip the data horizontally
+ * @param pixl		Pixels to output
+ */
+void convertToRGBA( const quint8 * data, int w, int h, int bytespp, const quint32 mask[], bool flipV, bool flipH, quint8 * pixl );
+
+//! Convert pixels to RGBA with the per channel conversion only; the reference for the specialized converters
+void convertToRGBAGeneric( const quint8 * data, int w, int h, int bytespp, const quint32 mask[], bool flipV, bool flipH, quint8 * pixl );
+
+/*! Convert palette indices to RGBA
+ *
+ * @param colormap	The RGBA palette; must have 256 entries
+ */
+void convertPalToRGBA( const quint8 * data, int w, int h, const quint32 colormap[], bool flipV, bool flipH, quint8 * pixl );
+
+/*! Decode raw pixel data and complete its mip chain
+ *
+ * Throws a QString on errors.
+ *
+ * @param num_mipmaps	The number of mip levels stored in f
+ * @param rle			Whether the levels are RLE compressed
+ * @param gammaCorrect	See downsampleRGBA()
+ */
+RGBALevels decodeRaw( QIODevice & f, int width, int height, int num_mipmaps, int bpp, int bytespp, const quint32 mask[], bool flipV, bool flipH, bool rle, bool gammaCorrect );
+
+//! Decode palettised pixel data and complete its mip chain; see decodeRaw()
+RGBALevels decodePal( QIODevice & f, int width, int height, int num_mipmaps, int bpp, int bytespp, const quint32 colormap[], bool flipV, bool flipH, bool rle, bool gammaCorrect );
+
+#endif
@@ -0,0 +1,297 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#include "gltexpixels.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+
+//! \file pixeltest.cpp Pixel format conversion benchmark for the TGA/BMP/NiPixelData decoders
+
+//! A source pixel layout as passed to decodeRaw()
+struct Layout
+{
+	const char * name;
+	int bytespp;
+	quint32 mask[4];
+};
+
+static const Layout layouts[] = {
+	{ "RGBA8",  4, { 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 } },
+	{ "BGRA8",  4, { 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 } },
+	{ "RGB8",   3, { 0x000000ff, 0x0000ff00, 0x00ff0000, 0 } },
+	{ "BGR8",   3, { 0x00ff0000, 0x0000ff00, 0x000000ff, 0 } },
+	{ "RGB565", 2, { 0xf800, 0x07e0, 0x001f, 0 } },
+	{ "LA8",    2, { 0x00ff, 0x00ff, 0x00ff, 0xff00 } },
+	{ "L8",     1, { 0xff, 0xff, 0xff, 0 } },
+	{ "A8",     1, { 0, 0, 0, 0xff } },
+	{ "ARGB1555 (generic)", 2, { 0x7c00, 0x03e0, 0x001f, 0x8000 } },
+};
+
+//! Encodes each mip level as TGA style RLE packets with runs of random length
+static QByteArray encodeRLE( const QByteArray & data, int size, int bytespp, std::mt19937 & rng )
+{
+	QByteArray out;
+	const char * px = data.constData();
+
+	// Packets may not cross levels
+	for ( int s = size; s > 0; s /= 2 ) {
+		int count = s * s;
+
+		for ( int c = 0; c < count; ) {
+			int n = std::min<int>( 1 + rng() % 128, count - c );
+
+			if ( rng() & 1 ) {
+				out.append( char( 0x80 | ( n - 1 ) ) );
+				out.append( px, bytespp );
+			} else {
+				out.append( char( n - 1 ) );
+				out.append( px, n * bytespp );
+			}
+
+			px += n * bytespp;
+			c += n;
+		}
+	}
+
+	return out;
+}
+
+//! Returns count random bytes
+static QByteArray randomBytes( int count, std::mt19937 & rng )
+{
+	QByteArray data( count, Qt::Uninitialized );
+	for ( char & c : data )
+		c = char( rng() );
+
+	return data;
+}
+
+//! Fills a full mip chain of random pixels
+static QByteArray randomLevels( int size, int bytespp, std::mt19937 & rng )
+{
+	int pixels = 0;
+	for ( int s = size; s > 0; s /= 2 )
+		pixels += s * s;
+
+	return randomBytes( pixels * bytespp, rng );
+}
+
+//! Copies the high bits of each 565 channel into its low bits, as the specialized converter does
+static quint32 replicate565( quint32 p )
+{
+	quint32 r = p & 0xff, g = ( p >> 8 ) & 0xff, b = ( p >> 16 ) & 0xff;
+
+	r |= r >> 5;
+	g |= g >> 6;
+	b |= b >> 5;
+
+	return r | ( g << 8 ) | ( b << 16 ) | ( p & 0xff000000 );
+}
+
+/*! Compares the specialized converters with the per channel conversion
+ *
+ * Odd widths exercise the scalar tails after the SSE2 blocks; every flip is checked.
+ * Returns the number of mismatching images.
+ */
+static int checkConverters( QTextStream & out, std::mt19937 & rng )
+{
+	const int widths[] = { 1, 3, 4, 7, 8, 15, 16, 17, 31, 33, 61 };
+	const int heights[] = { 1, 2, 5 };
+
+	int failed = 0;
+
+	for ( const Layout & l : layouts ) {
+		bool is565 = ( l.bytespp == 2 && l.mask[1] == 0x07e0 && !l.mask[3] );
+
+		for ( int w : widths ) {
+			for ( int h : heights ) {
+				// The converters read whole words, so keep 3 readable bytes past the last pixel
+				QByteArray data = randomBytes( w * h * l.bytespp + 3, rng );
+				const quint8 * src = reinterpret_cast<const quint8 *>( data.constData() );
+
+				for ( int flip = 0; flip < 4; flip++ ) {
+					bool flipV = flip & 1, flipH = flip & 2;
+
+					QVector<quint32> fast( w * h ), ref( w * h );
+					convertToRGBA( src, w, h, l.bytespp, l.mask, flipV, flipH, reinterpret_cast<quint8 *>( fast.data() ) );
+					convertToRGBAGeneric( src, w, h, l.bytespp, l.mask, flipV, flipH, reinterpret_cast<quint8 *>( ref.data() ) );
+
+					for ( int i = 0; i < w * h; i++ ) {
+						quint32 expected = is565 ? replicate565( ref[i] ) : ref[i];
+						if ( fast[i] != expected ) {
+							out << QString( "%1 %2 x %3 flipV %4 flipH %5: pixel %6 is %7, expected %8" )
+								.arg( l.name ).arg( w ).arg( h ).arg( flipV ).arg( flipH ).arg( i )
+								.arg( fast[i], 8, 16, QChar( '0' ) ).arg( expected, 8, 16, QChar( '0' ) ) << endl;
+							failed++;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	quint32 colormap[256];
+	for ( quint32 & c : colormap )
+		c = rng();
+
+	for ( int w : widths ) {
+		for ( int h : heights ) {
+			QByteArray data = randomBytes( w * h, rng );
+			const quint8 * src = reinterpret_cast<const quint8 *>( data.constData() );
+
+			for ( int flip = 0; flip < 4; flip++ ) {
+				bool flipV = flip & 1, flipH = flip & 2;
+
+				QVector<quint32> pixl( w * h );
+				convertPalToRGBA( src, w, h, colormap, flipV, flipH, reinterpret_cast<quint8 *>( pixl.data() ) );
+
+				for ( int i = 0; i < w * h; i++ ) {
+					int x = i % w, y = i / w;
+					int dst = ( flipV ? h - y - 1 : y ) * w + ( flipH ? w - x - 1 : x );
+
+					if ( pixl[dst] != colormap[src[i]] ) {
+						out << QString( "PAL8 %1 x %2 flipV %3 flipH %4: pixel %5 differs" )
+							.arg( w ).arg( h ).arg( flipV ).arg( flipH ).arg( i ) << endl;
+						failed++;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	return failed;
+}
+
+//! Runs decode on data for the given number of passes and returns the best rate in MPixels/s
+static double measure( const QByteArray & data, qint64 pixels, int passes, const std::function<void ( QIODevice & )> & decode )
+{
+	double best = 0;
+
+	for ( int p = 0; p < passes; p++ ) {
+		QByteArray copy = data;
+		QBuffer buf( &copy );
+		buf.open( QIODevice::ReadOnly );
+
+		QElapsedTimer timer;
+		timer.start();
+
+		decode( buf );
+
+		qint64 ns = std::max<qint64>( timer.nsecsElapsed(), 1 );
+		best = std::max( best, ( pixels / 1e6 ) / ( ns / 1e9 ) );
+	}
+
+	return best;
+}
+
+int main( int argc, char * argv[] )
+{
+	QCoreApplication app( argc, argv );
+	QTextStream out( stdout );
+
+	QStringList args = app.arguments();
+
+	int size = (args.count() > 1) ? args.at( 1 ).toInt() : 2048;
+	int passes = (args.count() > 2) ? args.at( 2 ).toInt() : 5;
+
+	if ( size < 1 || ( size & ( size - 1 ) ) ) {
+		out << "Usage: pixeltest [size] [passes]" << endl;
+		out << "size must be a power of two" << endl;
+		return 1;
+	}
+
+	std::mt19937 rng( 1 );
+
+	// Every level is stored so that the timing covers conversion, not mip generation
+	int mipmaps = 0;
+	qint64 pixels = 0;
+	for ( int s = size; s > 0; s /= 2 ) {
+		mipmaps++;
+		pixels += qint64( s ) * s;
+	}
+
+	auto raw = [size, mipmaps]( const Layout & l, bool rle ) {
+		return [size, mipmaps, &l, rle]( QIODevice & f ) {
+			decodeRaw( f, size, size, mipmaps, l.bytespp * 8, l.bytespp, l.mask, false, false, rle, false );
+		};
+	};
+
+	int failed = checkConverters( out, rng );
+	if ( failed ) {
+		out << failed << " conversions differ from the generic path" << endl;
+		return 1;
+	}
+
+	out << "Specialized converters match the generic path" << endl;
+
+	out << QString( "%1 x %1 with %2 levels, best of %3 passes" ).arg( size ).arg( mipmaps ).arg( passes ) << endl;
+
+	for ( const Layout & l : layouts ) {
+		QByteArray data = randomLevels( size, l.bytespp, rng );
+
+		out << QString( "%1 raw %2 MPixels/s, RLE %3 MPixels/s" )
+			.arg( l.name, -20 )
+			.arg( measure( data, pixels, passes, raw( l, false ) ), 8, 'f', 1 )
+			.arg( measure( encodeRLE( data, size, l.bytespp, rng ), pixels, passes, raw( l, true ) ), 8, 'f', 1 ) << endl;
+	}
+
+	quint32 colormap[256];
+	for ( quint32 & c : colormap )
+		c = rng();
+
+	auto pal = [size, mipmaps, &colormap]( bool rle ) {
+		return [size, mipmaps, &colormap, rle]( QIODevice & f ) {
+			decodePal( f, size, size, mipmaps, 8, 1, colormap, false, false, rle, false );
+		};
+	};
+
+	QByteArray indices = randomLevels( size, 1, rng );
+
+	out << QString( "%1 raw %2 MPixels/s, RLE %3 MPixels/s" )
+		.arg( "PAL8", -20 )
+		.arg( measure( indices, pixels, passes, pal( false ) ), 8, 'f', 1 )
+		.arg( measure( encodeRLE( indices, size, 1, rng ), pixels, passes, pal( true ) ), 8, 'f', 1 ) << endl;
+
+	return 0;
+}
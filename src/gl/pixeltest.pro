@@ -0,0 +1,20 @@
+TEMPLATE = app
+LANGUAGE = C++
+TARGET   = pixeltest
+
+# Pixel format conversion benchmark for the raw and palettised texture decoders:
+#   pixeltest [size] [passes]
+# First checks the specialized row converters against the generic per channel
+# conversion for every layout and flip, and exits with 1 on any mismatch.
+# Reports the conversion rate in MPixels/s for each source layout, raw and RLE.
+
+CONFIG += qt release thread warn_on console c++11
+CONFIG -= app_bundle
+QT -= gui
+
+DESTDIR = ./
+
+HEADERS += gltexpixels.h
+SOURCES += gltexpixels.cpp pixeltest.cpp
+
+# vim: set filetype=config : 
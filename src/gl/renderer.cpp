@@ -346,6 +346,9 @@ bool Renderer::Program::load( const QString & filepath, Renderer * renderer )
 					throw QString( "texture unit %1 is assigned twiced" ).arg( unit );
 
 				texcoords.insert( unit, CoordType(id) );
+
+				if ( id == CT_BONE || id == CT_WEIGHT )
+					skinned = true;
 			}
 		}
 
@@ -404,6 +407,7 @@ void Renderer::updateSettings()
 	QSettings settings;
 
 	cfg.useShaders = settings.value( "Settings/Render/General/Use Shaders", true ).toBool();
+	cfg.gpuSkinning = settings.value( "Settings/Render/General/GPU Skinning", false ).toBool();
 
 	bool prevStatus = shader_ready;
 
@@ -481,6 +485,9 @@ QString Renderer::setupProgram( Shape * mesh, const QString & hint )
 	QVector<QModelIndex> iBlocks;
 	iBlocks << mesh->index();
 	iBlocks << mesh->iData;
+	// Lets the skinned programs check for the skin instance
+	if ( mesh->gpuSkinned )
+		iBlocks << mesh->iSkin;
 	for ( Property * p : props.list() ) {
 		iBlocks.append( p->index() );
 	}
@@ -547,6 +554,18 @@ void Renderer::Program::uni4m( UniformType var, const Matrix4 & val )
 		f->glUniformMatrix4fv( uniformLocations[var], 1, 0, val.data() );
 }
 
+void Renderer::Program::uni4mv( UniformType var, const QVector<Transform> & val )
+{
+	if ( uniformLocations[var] < 0 )
+		return;
+
+	QVector<Matrix4> m( val.count() );
+	for ( int i = 0; i < val.count(); i++ )
+		m[i] = val[i].toMatrix4();
+
+	f->glUniformMatrix4fv( uniformLocations[var], m.count(), 0, m.constData()->data() );
+}
+
 bool Renderer::Program::uniSampler( BSShaderLightingProperty * bsprop, UniformType var,
 									int textureSlot, int & texunit, const QString & alternate,
 									uint clamp, const QString & forced )
@@ -594,6 +613,17 @@ static QString magenta = "shaders/magenta.dds";
 static QString default_n = "shaders/default_n.dds";
 static QString cube = "shaders/cubemap.dds";
 
+//! Points the texcoord array of the active unit at the buffer mirroring data
+template <typename T>
+static void texCoordPointer( QOpenGLFunctions * fn, GLArrayBuffer<T> & buffer, const QVector<T> & data )
+{
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glTexCoordPointer( sizeof( T ) / sizeof( float ), GL_FLOAT, 0, buffer.bind( fn, data ) );
+
+	// Leave no buffer bound in case the fixed function path takes over with client arrays
+	GLBuffer::unbind( fn, GL_ARRAY_BUFFER );
+}
+
 bool Renderer::setupProgram( Program * prog, Shape * mesh, const PropertyList & props,
 							 const QVector<QModelIndex> & iBlocks, bool eval )
 {
@@ -602,11 +632,18 @@ bool Renderer::setupProgram( Program * prog, Shape * mesh, const PropertyList &
 	if ( !mesh->index().isValid() || !nif )
 		return false;
 
+	// Skinned shapes take the skinned programs and nothing else
+	if ( prog->skinned != mesh->gpuSkinned )
+		return false;
+
 	if ( eval && !prog->conditions.eval( nif, iBlocks ) )
 		return false;
 
 	fn->glUseProgram( prog->id );
 
+	if ( prog->skinned )
+		prog->uni4mv( GPU_BONES, mesh->bonePalette );
+
 	auto opts = mesh->scene->options;
 	auto vis = mesh->scene->visMode;
 
@@ -933,25 +970,25 @@ bool Renderer::setupProgram( Program * prog, Shape * mesh, const PropertyList &
 		auto it = itx.value();
 		if ( it == Program::CT_TANGENT ) {
 			if ( mesh->transTangents.count() ) {
-				glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-				glTexCoordPointer( 3, GL_FLOAT, 0, mesh->transTangents.constData() );
+				texCoordPointer( fn, mesh->tangentBuffer, mesh->transTangents );
 			} else if ( mesh->tangents.count() ) {
-				glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-				glTexCoordPointer( 3, GL_FLOAT, 0, mesh->tangents.constData() );
+				texCoordPointer( fn, mesh->tangentBuffer, mesh->tangents );
 			} else {
 				return false;
 			}
 
 		} else if ( it == Program::CT_BITANGENT ) {
 			if ( mesh->transBitangents.count() ) {
-				glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-				glTexCoordPointer( 3, GL_FLOAT, 0, mesh->transBitangents.constData() );
+				texCoordPointer( fn, mesh->bitangentBuffer, mesh->transBitangents );
 			} else if ( mesh->bitangents.count() ) {
-				glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-				glTexCoordPointer( 3, GL_FLOAT, 0, mesh->bitangents.constData() );
+				texCoordPointer( fn, mesh->bitangentBuffer, mesh->bitangents );
 			} else {
 				return false;
 			}
+		} else if ( it == Program::CT_BONE ) {
+			texCoordPointer( fn, mesh->boneIndexBuffer, mesh->skin.packedBones );
+		} else if ( it == Program::CT_WEIGHT ) {
+			texCoordPointer( fn, mesh->boneWeightBuffer, mesh->skin.packedWeights );
 		} else if ( texprop ) {
 			int txid = it;
 			if ( txid < 0 )
@@ -962,8 +999,7 @@ bool Renderer::setupProgram( Program * prog, Shape * mesh, const PropertyList &
 			if ( set < 0 || !(set < mesh->coords.count()) || !mesh->coords[set].count() )
 				return false;
 
-			glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-			glTexCoordPointer( 2, GL_FLOAT, 0, mesh->coords[set].constData() );
+			texCoordPointer( fn, mesh->coordBuffer( set ), mesh->coords[set] );
 		} else if ( bsprop ) {
 			int txid = it;
 			if ( txid < 0 )
@@ -974,8 +1010,7 @@ bool Renderer::setupProgram( Program * prog, Shape * mesh, const PropertyList &
 			if ( set < 0 || !(set < mesh->coords.count()) || !mesh->coords[set].count() )
 				return false;
 
-			glEnableClientState( GL_TEXTURE_COORD_ARRAY );
-			glTexCoordPointer( 2, GL_FLOAT, 0, mesh->coords[set].constData() );
+			texCoordPointer( fn, mesh->coordBuffer( set ), mesh->coords[set] );
 		}
 	}
 
@@ -71,6 +71,8 @@ public:
 	bool initialize();
 	//! Whether shader support is available
 	bool hasShaderSupport();
+	//! Whether skinned shapes may be skinned by the vertex shader
+	bool hasGpuSkinning() const { return shader_ready && cfg.gpuSkinning; }
 
 	//! Updates shaders
 	void updateShaders();
@@ -151,7 +153,6 @@ public:
 		USE_FALLOFF,
 		UV_OFFSET,
 		UV_SCALE,
-		GPU_SKINNED,
 		GPU_BONES,
 
 		NUM_UNIFORM_TYPES
@@ -265,6 +266,8 @@ public:
 
 		ConditionGroup conditions;
 		QMap<int, CoordType> texcoords;
+		//! Does the vertex shader skin the vertices, taking bone indices and weights?
+		bool skinned = false;
 
 		std::array<std::string, NUM_UNIFORM_TYPES> uniforms = { {
 			"BaseMap",
@@ -327,7 +330,6 @@ public:
 			"useFalloff",
 			"uvOffset",
 			"uvScale",
-			"isGPUSkinned",
 			"boneTransforms"
 		} };
 
@@ -342,6 +344,7 @@ public:
 		void uni1i( UniformType var, int val );
 		void uni3m( UniformType var, const Matrix & val );
 		void uni4m( UniformType var, const Matrix4 & val );
+		void uni4mv( UniformType var, const QVector<Transform> & val );
 		bool uniSampler( class BSShaderLightingProperty * bsprop, UniformType var, int textureSlot,
 						 int & texunit, const QString & alternate, uint clamp, const QString & forced = {} );
 		bool uniSamplerBlank( UniformType var, int & texunit );
@@ -356,6 +359,7 @@ public:
 	struct Settings
 	{
 		bool useShaders = true;
+		bool gpuSkinning = false;
 	} cfg;
 };
 
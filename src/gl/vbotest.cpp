@@ -0,0 +1,495 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+   used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#include "glbuffer.h"
+
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QImage>
+#include <QMatrix4x4>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+
+//! @file vbotest.cpp Frame time benchmark for drawing static meshes from client arrays and buffer objects, and for skinning them on the CPU and in the vertex shader
+
+//! Vertices along each side of a grid; keeps the indices within 16 bits
+#define GRID_SIZE 256
+
+struct Vertex
+{
+	float x, y, z;
+};
+
+struct Triangle
+{
+	quint16 v1, v2, v3;
+};
+
+//! Four bone indices or weights, as sent to the skinned shaders in texture coordinates 3 and 4
+struct Influences
+{
+	float v[4];
+};
+
+struct Grid
+{
+	QVector<Vertex> verts;
+	QVector<Vertex> norms;
+	QVector<Triangle> tris;
+
+	GLArrayBuffer<Vertex> vertexBuffer;
+	GLArrayBuffer<Vertex> normalBuffer;
+	GLArrayBuffer<Triangle> triangleBuffer{ GL_ELEMENT_ARRAY_BUFFER };
+};
+
+static void makeGrid( Grid & g, float z )
+{
+	for ( int y = 0; y < GRID_SIZE; y++ ) {
+		for ( int x = 0; x < GRID_SIZE; x++ ) {
+			g.verts << Vertex{ x * 2.0f / GRID_SIZE - 1.0f, y * 2.0f / GRID_SIZE - 1.0f, z };
+			g.norms << Vertex{ 0.0f, 0.0f, 1.0f };
+		}
+	}
+
+	for ( int y = 0; y < GRID_SIZE - 1; y++ ) {
+		for ( int x = 0; x < GRID_SIZE - 1; x++ ) {
+			quint16 i = quint16( y * GRID_SIZE + x );
+			g.tris << Triangle{ i, quint16( i + 1 ), quint16( i + GRID_SIZE ) };
+			g.tris << Triangle{ quint16( i + 1 ), quint16( i + GRID_SIZE + 1 ), quint16( i + GRID_SIZE ) };
+		}
+	}
+}
+
+//! Bones along the x axis of a skinned grid
+#define SKIN_BONES 16
+
+//! A grid skinned by two neighbouring bones per vertex
+struct SkinnedGrid
+{
+	Grid grid;
+
+	QVector<Influences> bones;
+	QVector<Influences> weights;
+	//! Tangents and bitangents; the comparison shader only outputs the normals
+	QVector<Vertex> tangents;
+	QVector<Vertex> bitangents;
+
+	QVector<Vertex> transVerts;
+	QVector<Vertex> transNorms;
+
+	GLArrayBuffer<Influences> boneBuffer;
+	GLArrayBuffer<Influences> weightBuffer;
+	GLArrayBuffer<Vertex> tangentBuffer;
+	GLArrayBuffer<Vertex> bitangentBuffer;
+};
+
+static void makeSkinnedGrid( SkinnedGrid & s, float z )
+{
+	makeGrid( s.grid, z );
+
+	for ( const Vertex & v : s.grid.verts ) {
+		float t = ( v.x + 1.0f ) * 0.5f * ( SKIN_BONES - 1 );
+		int b0 = std::min( int( t ), SKIN_BONES - 1 );
+		int b1 = std::min( b0 + 1, SKIN_BONES - 1 );
+		float w1 = t - b0;
+
+		s.bones << Influences{ { float( b0 ), float( b1 ), 0.0f, 0.0f } };
+		s.weights << Influences{ { 1.0f - w1, w1, 0.0f, 0.0f } };
+		s.tangents << Vertex{ 1.0f, 0.0f, 0.0f };
+		s.bitangents << Vertex{ 0.0f, 1.0f, 0.0f };
+	}
+}
+
+//! Bends every bone about its joint; the same frame gives the same palette
+static QVector<QMatrix4x4> bonePalette( int frame )
+{
+	QVector<QMatrix4x4> palette( SKIN_BONES );
+
+	for ( int b = 0; b < SKIN_BONES; b++ ) {
+		float joint = -1.0f + 2.0f * b / ( SKIN_BONES - 1 );
+
+		QMatrix4x4 & m = palette[b];
+		m.translate( joint, 0.0f, 0.0f );
+		m.rotate( 8.0f * std::sin( frame * 0.1f + b * 0.5f ), 0.0f, 1.0f, 0.0f );
+		m.rotate( 4.0f * std::cos( frame * 0.07f + b * 0.3f ), 1.0f, 0.0f, 0.0f );
+		m.translate( -joint, 0.0f, 0.0f );
+	}
+
+	return palette;
+}
+
+//! Blends the palette per vertex like the skinned vertex shaders, on the CPU
+static void skinGrid( SkinnedGrid & s, const QVector<QMatrix4x4> & palette )
+{
+	int count = s.grid.verts.count();
+	s.transVerts.resize( count );
+	s.transNorms.resize( count );
+
+	for ( int i = 0; i < count; i++ ) {
+		float m[16] = {};
+		for ( int k = 0; k < 4; k++ ) {
+			float w = s.weights[i].v[k];
+			if ( w == 0.0f )
+				continue;
+
+			const float * bone = palette[int( s.bones[i].v[k] )].constData();
+			for ( int e = 0; e < 16; e++ )
+				m[e] += bone[e] * w;
+		}
+
+		// Column-major like OpenGL
+		const Vertex & v = s.grid.verts[i];
+		const Vertex & n = s.grid.norms[i];
+		s.transVerts[i] = Vertex{ m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12],
+								  m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13],
+								  m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] };
+		s.transNorms[i] = Vertex{ m[0] * n.x + m[4] * n.y + m[8] * n.z,
+								  m[1] * n.x + m[5] * n.y + m[9] * n.z,
+								  m[2] * n.x + m[6] * n.y + m[10] * n.z };
+	}
+}
+
+typedef void ( QOPENGLF_APIENTRYP ClientActiveTexture )( GLenum );
+
+//! Points a texture coordinate set at a buffer, like Renderer does for the shader programs
+template <typename T> static void texCoordBuffer( QOpenGLFunctions * fn, ClientActiveTexture clientActive, int set, GLArrayBuffer<T> & buffer, const QVector<T> & data )
+{
+	clientActive( GL_TEXTURE0 + set );
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glTexCoordPointer( sizeof( T ) / sizeof( float ), GL_FLOAT, 0, buffer.bind( fn, data ) );
+	GLBuffer::unbind( fn, GL_ARRAY_BUFFER );
+}
+
+struct SkinResult
+{
+	//! Milliseconds per frame, and the part of it spent skinning on the CPU
+	double frameMs = 0, skinMs = 0;
+	//! The last frame
+	QImage image;
+};
+
+/*! Draws the skinned grids for the given number of frames
+ *
+ * With gpu set the palette is uploaded to the skinned program and the vertex shader
+ * blends it; otherwise the grids are skinned on the CPU and drawn with the rigid program.
+ */
+static SkinResult measureSkinning( QOpenGLFunctions * fn, ClientActiveTexture clientActive, QOpenGLFramebufferObject & fbo,
+								   QOpenGLShaderProgram & program, std::vector<SkinnedGrid> & grids, bool gpu, int frames )
+{
+	SkinResult result;
+
+	program.bind();
+	int boneTransforms = program.uniformLocation( "boneTransforms" );
+
+	QElapsedTimer timer, skinTimer;
+	qint64 skinNs = 0;
+
+	for ( int f = -1; f < frames; f++ ) {
+		if ( f == 0 ) {
+			timer.start();
+			skinNs = 0;
+		}
+
+		QVector<QMatrix4x4> palette = bonePalette( std::max( f, 0 ) );
+
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+		if ( gpu )
+			program.setUniformValueArray( boneTransforms, palette.constData(), palette.count() );
+
+		for ( SkinnedGrid & s : grids ) {
+			texCoordBuffer( fn, clientActive, 1, s.tangentBuffer, s.tangents );
+			texCoordBuffer( fn, clientActive, 2, s.bitangentBuffer, s.bitangents );
+
+			if ( gpu ) {
+				texCoordBuffer( fn, clientActive, 3, s.boneBuffer, s.bones );
+				texCoordBuffer( fn, clientActive, 4, s.weightBuffer, s.weights );
+
+				glVertexPointer( 3, GL_FLOAT, 0, s.grid.vertexBuffer.bind( fn, s.grid.verts ) );
+				glNormalPointer( GL_FLOAT, 0, s.grid.normalBuffer.bind( fn, s.grid.norms ) );
+			} else {
+				skinTimer.start();
+				skinGrid( s, palette );
+				skinNs += skinTimer.nsecsElapsed();
+
+				glVertexPointer( 3, GL_FLOAT, 0, s.grid.vertexBuffer.bind( fn, s.transVerts ) );
+				glNormalPointer( GL_FLOAT, 0, s.grid.normalBuffer.bind( fn, s.transNorms ) );
+			}
+			GLBuffer::unbind( fn, GL_ARRAY_BUFFER );
+
+			glDrawElements( GL_TRIANGLES, s.grid.tris.count() * 3, GL_UNSIGNED_SHORT, s.grid.triangleBuffer.bind( fn, s.grid.tris ) );
+			GLBuffer::unbind( fn, GL_ELEMENT_ARRAY_BUFFER );
+
+			for ( int set = 4; set > 0; set-- ) {
+				clientActive( GL_TEXTURE0 + set );
+				glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+			}
+			clientActive( GL_TEXTURE0 );
+		}
+
+		glFinish();
+	}
+
+	result.frameMs = double( timer.nsecsElapsed() ) / 1000000.0 / frames;
+	result.skinMs = double( skinNs ) / 1000000.0 / frames;
+	result.image = fbo.toImage();
+
+	program.release();
+	return result;
+}
+
+/*! Counts the pixels of two images which differ by more than tolerance in any channel
+ *
+ * @param maxDiff	Set to the largest channel difference
+ */
+static int comparePixels( const QImage & a, const QImage & b, int tolerance, int & maxDiff )
+{
+	maxDiff = 0;
+
+	if ( a.size() != b.size() )
+		return a.width() * a.height();
+
+	int differ = 0;
+	for ( int y = 0; y < a.height(); y++ ) {
+		const QRgb * la = reinterpret_cast<const QRgb *>( a.constScanLine( y ) );
+		const QRgb * lb = reinterpret_cast<const QRgb *>( b.constScanLine( y ) );
+
+		for ( int x = 0; x < a.width(); x++ ) {
+			int d = std::max( { std::abs( qRed( la[x] ) - qRed( lb[x] ) ),
+								std::abs( qGreen( la[x] ) - qGreen( lb[x] ) ),
+								std::abs( qBlue( la[x] ) - qBlue( lb[x] ) ) } );
+
+			maxDiff = std::max( maxDiff, d );
+			if ( d > tolerance )
+				differ++;
+		}
+	}
+
+	return differ;
+}
+
+enum Mode
+{
+	ClientArrays,
+	StaticBuffers,
+	ChangedBuffers
+};
+
+static void drawGrid( QOpenGLFunctions * fn, Grid & g, Mode mode )
+{
+	if ( mode == ClientArrays ) {
+		glVertexPointer( 3, GL_FLOAT, 0, g.verts.constData() );
+		glNormalPointer( GL_FLOAT, 0, g.norms.constData() );
+		glDrawElements( GL_TRIANGLES, g.tris.count() * 3, GL_UNSIGNED_SHORT, g.tris.constData() );
+		return;
+	}
+
+	// Stands in for skinning, which rewrites the transformed vertices every frame
+	if ( mode == ChangedBuffers )
+		g.verts[0].z += 0.0001f;
+
+	glVertexPointer( 3, GL_FLOAT, 0, g.vertexBuffer.bind( fn, g.verts ) );
+	glNormalPointer( GL_FLOAT, 0, g.normalBuffer.bind( fn, g.norms ) );
+	GLBuffer::unbind( fn, GL_ARRAY_BUFFER );
+
+	glDrawElements( GL_TRIANGLES, g.tris.count() * 3, GL_UNSIGNED_SHORT, g.triangleBuffer.bind( fn, g.tris ) );
+	GLBuffer::unbind( fn, GL_ELEMENT_ARRAY_BUFFER );
+}
+
+//! Milliseconds per frame, skipping the first frame which uploads the buffers
+static double measure( QOpenGLFunctions * fn, std::vector<Grid> & grids, Mode mode, int frames )
+{
+	GLBuffer::resetUploadStats();
+
+	QElapsedTimer timer;
+
+	for ( int f = -1; f < frames; f++ ) {
+		if ( f == 0 )
+			timer.start();
+
+		glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+		for ( Grid & g : grids )
+			drawGrid( fn, g, mode );
+
+		glFinish();
+	}
+
+	return double( timer.nsecsElapsed() ) / 1000000.0 / frames;
+}
+
+int main( int argc, char * argv[] )
+{
+	QGuiApplication app( argc, argv );
+	QTextStream out( stdout );
+
+	QStringList args = app.arguments();
+
+	int meshes = (args.count() > 1) ? args.at( 1 ).toInt() : 8;
+	int frames = (args.count() > 2) ? args.at( 2 ).toInt() : 100;
+	QString shaders = (args.count() > 3) ? args.at( 3 ) : QString( "../../res/shaders" );
+
+	if ( meshes < 1 || frames < 1 ) {
+		out << "Usage: vbotest [meshes] [frames] [shader folder]" << endl;
+		return 1;
+	}
+
+	QSurfaceFormat fmt;
+	fmt.setVersion( 2, 1 );
+	fmt.setDepthBufferSize( 24 );
+
+	QOpenGLContext context;
+	context.setFormat( fmt );
+
+	QOffscreenSurface surface;
+	surface.setFormat( fmt );
+	surface.create();
+
+	if ( !context.create() || !context.makeCurrent( &surface ) ) {
+		out << "Could not create an OpenGL context" << endl;
+		return 1;
+	}
+
+	QOpenGLFunctions * fn = context.functions();
+	if ( !GLBuffer::isSupported( fn ) ) {
+		out << "Buffer objects are not supported" << endl;
+		return 1;
+	}
+
+	QOpenGLFramebufferObject fbo( 512, 512, QOpenGLFramebufferObject::Depth );
+	fbo.bind();
+	glViewport( 0, 0, 512, 512 );
+
+	glEnable( GL_DEPTH_TEST );
+	glEnable( GL_LIGHTING );
+	glEnable( GL_LIGHT0 );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_NORMAL_ARRAY );
+
+	std::vector<Grid> grids( meshes );
+	for ( int i = 0; i < meshes; i++ )
+		makeGrid( grids[i], -float( i ) / meshes );
+
+	out << QString( "%1 meshes of %2 triangles, %3 frames" )
+		.arg( meshes ).arg( (GRID_SIZE - 1) * (GRID_SIZE - 1) * 2 ).arg( frames ) << endl;
+	out << (const char *)glGetString( GL_RENDERER ) << endl;
+
+	out << QString( "%1 %2 ms/frame" ).arg( "client arrays", -16 )
+		.arg( measure( fn, grids, ClientArrays, frames ), 8, 'f', 2 ) << endl;
+	out << QString( "%1 %2 ms/frame" ).arg( "static buffers", -16 )
+		.arg( measure( fn, grids, StaticBuffers, frames ), 8, 'f', 2 ) << endl;
+	out << QString( "%1 %2 ms/frame, %3 MB uploaded" ).arg( "changed buffers", -16 )
+		.arg( measure( fn, grids, ChangedBuffers, frames ), 8, 'f', 2 )
+		.arg( GLBuffer::uploadedBytes() / 1048576.0, 0, 'f', 1 ) << endl;
+
+	for ( Grid & g : grids ) {
+		g.vertexBuffer.clear();
+		g.normalBuffer.clear();
+		g.triangleBuffer.clear();
+	}
+
+	// Skinning: the rigid and skinned vertex shaders with a fragment shader which shows the normals
+	static const char * normalsFrag =
+		"#version 120\n"
+		"varying vec3 N;\n"
+		"void main( void ) { gl_FragColor = vec4( normalize( N ) * 0.5 + 0.5, 1.0 ); }\n";
+
+	QOpenGLShaderProgram rigid, skinned;
+	if ( !rigid.addShaderFromSourceFile( QOpenGLShader::Vertex, shaders + "/sk_default.vert" )
+		 || !rigid.addShaderFromSourceCode( QOpenGLShader::Fragment, normalsFrag ) || !rigid.link()
+		 || !skinned.addShaderFromSourceFile( QOpenGLShader::Vertex, shaders + "/sk_default_skinned.vert" )
+		 || !skinned.addShaderFromSourceCode( QOpenGLShader::Fragment, normalsFrag ) || !skinned.link() ) {
+		out << "Could not build the skinning shaders from " << shaders << endl;
+		out << rigid.log() << skinned.log() << endl;
+		return 1;
+	}
+
+	auto clientActive = reinterpret_cast<ClientActiveTexture>( context.getProcAddress( "glClientActiveTexture" ) );
+	if ( !clientActive ) {
+		out << "glClientActiveTexture is not available" << endl;
+		return 1;
+	}
+
+	glDisable( GL_LIGHTING );
+
+	std::vector<SkinnedGrid> skinnedGrids( meshes );
+	for ( int i = 0; i < meshes; i++ )
+		makeSkinnedGrid( skinnedGrids[i], -0.5f * i / meshes );
+
+	SkinResult cpu = measureSkinning( fn, clientActive, fbo, rigid, skinnedGrids, false, frames );
+	SkinResult gpu = measureSkinning( fn, clientActive, fbo, skinned, skinnedGrids, true, frames );
+
+	out << QString( "%1 %2 ms/frame, %3 ms skinning" ).arg( "CPU skinning", -16 )
+		.arg( cpu.frameMs, 8, 'f', 2 ).arg( cpu.skinMs, 0, 'f', 2 ) << endl;
+	out << QString( "%1 %2 ms/frame" ).arg( "GPU skinning", -16 )
+		.arg( gpu.frameMs, 8, 'f', 2 ) << endl;
+
+	// Rasterization may round edge pixels differently, but the shading must agree
+	int maxDiff = 0;
+	int differ = comparePixels( cpu.image, gpu.image, 2, maxDiff );
+	int allowed = cpu.image.width() * cpu.image.height() / 200;
+
+	out << QString( "%1 %2 pixels differ, largest difference %3" ).arg( "CPU vs GPU", -16 )
+		.arg( differ, 8 ).arg( maxDiff ) << endl;
+
+	for ( SkinnedGrid & s : skinnedGrids ) {
+		s.grid.vertexBuffer.clear();
+		s.grid.normalBuffer.clear();
+		s.grid.triangleBuffer.clear();
+		s.boneBuffer.clear();
+		s.weightBuffer.clear();
+		s.tangentBuffer.clear();
+		s.bitangentBuffer.clear();
+	}
+
+	fbo.release();
+	context.doneCurrent();
+
+	if ( differ > allowed ) {
+		out << "The skinned shader does not match CPU skinning" << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+TEMPLATE = app
+LANGUAGE = C++
+TARGET   = vbotest
+
+# Frame time benchmark for static meshes drawn from client arrays and from buffer objects:
+#   vbotest [meshes] [frames] [shader folder]
+# Runs offscreen; LIBGL_ALWAYS_SOFTWARE=1 measures Mesa's llvmpipe.
+#
+# Also draws skinned grids with CPU skinning and with sk_default_skinned.vert from the
+# shader folder, ../../res/shaders by default, and reports the time per frame of each.
+# Exits with 1 if the two images differ by more than rasterization rounding.
+
+CONFIG += qt release thread warn_on console c++11
+CONFIG -= app_bundle
+QT += gui
+
+DESTDIR = ./
+
+HEADERS += glbuffer.h
+SOURCES += glbuffer.cpp vbotest.cpp
+
+# vim: set filetype=config :
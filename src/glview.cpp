@@ -35,8 +35,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "message.h"
 #include "nifskope.h"
 #include "gl/renderer.h"
+#include "gl/glbuffer.h"
 #include "gl/glmesh.h"
 #include "gl/gltex.h"
+#include "gl/gltexpaths.h"
 #include "model/nifmodel.h"
 #include "ui/settingsdialog.h"
 #include "ui/widgets/fileselect.h"
@@ -195,6 +197,7 @@ GLView::GLView( const QGLFormat & format, QWidget * p, const QGLWidget * shareWi
 	lastTime = QTime::currentTime();
 
 	textures = new TexCache( this );
+	textures->setAsync( true );
 
 	updateSettings();
 
@@ -239,7 +242,13 @@ void GLView::updateSettings()
 	cfg.rotSpd = settings.value( "General/Camera/Rotation Speed" ).toFloat();
 	cfg.upAxis = UpAxis(settings.value( "General/Up Axis", ZAxis ).toInt());
 
+	textures->setBudget( qint64( settings.value( "General/Texture Memory", 1024 ).toInt() ) * 1024 * 1024 );
+	TexCache::setGammaCorrectMipmaps( settings.value( "General/Gamma Correct Mipmaps", false ).toBool() );
+
 	settings.endGroup();
+
+	// Resource folders or archives may have changed
+	TexturePaths::get()->updateSettings();
 }
 
 QColor GLView::clearColor() const
@@ -390,6 +399,9 @@ void GLView::paintGL()
 {
 #endif
 	
+	// The stats overlay shows the geometry uploaded by this frame
+	GLBuffer::resetUploadStats();
+
 
 	// Save GL state
 	glPushAttrib( GL_ALL_ATTRIB_BITS );
@@ -409,6 +421,8 @@ void GLView::paintGL()
 	// Compile the model
 	if ( doCompile ) {
 		textures->setNifFolder( model->getFolder() );
+		// Decode textures on worker threads while the scene is built
+		textures->prefetch( model );
 		scene->make( model );
 		scene->transform( Transform(), scene->timeMin() );
 		axis = (scene->bounds().radius <= 0) ? 1024.0 : scene->bounds().radius;
@@ -427,6 +441,8 @@ void GLView::paintGL()
 		doCompile = false;
 	}
 
+	textures->beginFrame();
+
 	// Center the model
 	if ( doCenter ) {
 		setCenter();
@@ -0,0 +1,282 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+used to endorse or promote products derived from this software
+without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#include "nifdiff.h"
+
+#include "model/nifmodel.h"
+
+#include <QBuffer>
+#include <QHash>
+#include <QStringList>
+
+#include <algorithm>
+
+#include "xxhash.h"
+
+
+//! @file nifdiff.cpp Block hashing and item comparison
+
+//! Maximum number of item changes reported per block
+#define MAX_BLOCK_CHANGES 50
+
+//! Hashes the serialized bytes of an item
+static quint64 hashItem( const NifModel * nif, const QModelIndex & idx )
+{
+	QBuffer buf;
+	if ( !buf.open( QIODevice::WriteOnly ) || !nif->saveIndex( buf, idx ) )
+		return 0;
+
+	const QByteArray & data = buf.data();
+	return XXH64( data.constData(), size_t( data.size() ), 0 );
+}
+
+//! Returns the display string of a value, resolving header strings
+static QString itemValue( const NifModel * nif, const QModelIndex & idx )
+{
+	NifValue v = nif->getValue( idx );
+	if ( v.isString() )
+		return nif->get<QString>( idx );
+
+	return v.toString();
+}
+
+quint64 NifDiff::headerHash( const NifModel * nif )
+{
+	return hashItem( nif, nif->getHeader() );
+}
+
+QVector<quint64> NifDiff::blockHashes( const NifModel * nif )
+{
+	QVector<quint64> hashes( nif->getBlockCount() );
+	for ( int b = 0; b < hashes.count(); b++ ) {
+		hashes[b] = hashItem( nif, nif->getBlock( b ) );
+	}
+
+	return hashes;
+}
+
+void NifDiff::compareItems( const NifModel * a, const QModelIndex & ia, const NifModel * b, const QModelIndex & ib,
+							const QString & path, const Change & proto, QList<Change> & changes, int & budget )
+{
+	int rowsA = a->rowCount( ia );
+	int rowsB = b->rowCount( ib );
+	bool array = a->isArray( ia );
+
+	for ( int r = 0; r < std::min( rowsA, rowsB ) && budget > 0; r++ ) {
+		QModelIndex ca = a->index( r, 0, ia );
+		QModelIndex cb = b->index( r, 0, ib );
+
+		QString name;
+		if ( array )
+			name = QString( "%1[%2]" ).arg( path ).arg( r );
+		else
+			name = path.isEmpty() ? a->itemName( ca ) : path + "/" + a->itemName( ca );
+
+		if ( a->rowCount( ca ) > 0 || b->rowCount( cb ) > 0 ) {
+			compareItems( a, ca, b, cb, name, proto, changes, budget );
+			continue;
+		}
+
+		QString va = itemValue( a, ca );
+		QString vb = itemValue( b, cb );
+
+		if ( va != vb || a->itemName( ca ) != b->itemName( cb ) ) {
+			Change c = proto;
+			c.item = name;
+			c.valueA = va;
+			c.valueB = vb;
+			changes << c;
+			budget--;
+		}
+	}
+
+	if ( rowsA != rowsB && budget > 0 ) {
+		Change c = proto;
+		c.item = path.isEmpty() ? QString( "(rows)" ) : path + " (rows)";
+		c.valueA = QString::number( rowsA );
+		c.valueB = QString::number( rowsB );
+		changes << c;
+		budget--;
+	}
+}
+
+QList<NifDiff::Change> NifDiff::compare( const NifModel * a, const NifModel * b )
+{
+	QList<Change> changes;
+
+	// Drills into a pair of items whose bytes differ
+	auto drill = [&]( const QModelIndex & ia, const QModelIndex & ib, Change proto ) {
+		int budget = MAX_BLOCK_CHANGES;
+		int before = changes.count();
+
+		compareItems( a, ia, b, ib, QString(), proto, changes, budget );
+
+		if ( changes.count() == before ) {
+			// The bytes differ but every value reads the same
+			changes << proto;
+		} else if ( budget <= 0 ) {
+			proto.item = "...";
+			changes << proto;
+		}
+	};
+
+	if ( headerHash( a ) != headerHash( b ) ) {
+		Change proto;
+		proto.block = "Header";
+		drill( a->getHeader(), b->getHeader(), proto );
+	}
+
+	QVector<quint64> hashA = blockHashes( a );
+	QVector<quint64> hashB = blockHashes( b );
+
+	int countA = hashA.count();
+	int countB = hashB.count();
+
+	QVector<int> pairA( countA, -1 );
+	QVector<int> pairB( countB, -1 );
+
+	auto pair = [&pairA, &pairB]( int i, int j ) {
+		pairA[i] = j;
+		pairB[j] = i;
+	};
+
+	// Identical blocks in the same place
+	for ( int i = 0; i < std::min( countA, countB ); i++ ) {
+		if ( hashA[i] == hashB[i] )
+			pair( i, i );
+	}
+
+	// Identical blocks which moved
+	QHash<quint64, QList<int>> unpairedB;
+	for ( int j = 0; j < countB; j++ ) {
+		if ( pairB[j] < 0 )
+			unpairedB[hashB[j]].append( j );
+	}
+
+	for ( int i = 0; i < countA; i++ ) {
+		if ( pairA[i] >= 0 )
+			continue;
+
+		auto it = unpairedB.find( hashA[i] );
+		if ( it != unpairedB.end() && !it.value().isEmpty() )
+			pair( i, it.value().takeFirst() );
+	}
+
+	// Blocks of the same type in the same place were changed
+	for ( int i = 0; i < std::min( countA, countB ); i++ ) {
+		if ( pairA[i] < 0 && pairB[i] < 0 && a->getBlockName( a->getBlock( i ) ) == b->getBlockName( b->getBlock( i ) ) )
+			pair( i, i );
+	}
+
+	for ( int i = 0; i < countA; i++ ) {
+		int j = pairA[i];
+
+		Change proto;
+		proto.blockA = i;
+		proto.blockB = j;
+		proto.block = a->getBlockName( a->getBlock( i ) );
+
+		if ( j < 0 ) {
+			proto.type = Removed;
+			changes << proto;
+		} else if ( hashA[i] != hashB[j] ) {
+			drill( a->getBlock( i ), b->getBlock( j ), proto );
+		} else if ( i != j ) {
+			proto.item = "(block number)";
+			proto.valueA = QString::number( i );
+			proto.valueB = QString::number( j );
+			changes << proto;
+		}
+	}
+
+	for ( int j = 0; j < countB; j++ ) {
+		if ( pairB[j] >= 0 )
+			continue;
+
+		Change c;
+		c.type = Added;
+		c.blockB = j;
+		c.block = b->getBlockName( b->getBlock( j ) );
+		changes << c;
+	}
+
+	return changes;
+}
+
+QList<NifDiff::Change> NifDiff::compare( const NifModel * nif, const QByteArray & data )
+{
+	NifModel other;
+	other.setMessageMode( BaseModel::TstMessage );
+
+	QBuffer buf;
+	buf.setData( data );
+
+	if ( !buf.open( QIODevice::ReadOnly ) || !other.load( buf ) ) {
+		Change c;
+		c.block = "File";
+		c.valueB = "failed to load";
+		return { c };
+	}
+
+	return compare( nif, &other );
+}
+
+QString NifDiff::report( const QList<Change> & changes )
+{
+	QStringList lines;
+
+	for ( const Change & c : changes ) {
+		int num = (c.type == Added) ? c.blockB : c.blockA;
+
+		QString block = c.block;
+		if ( num >= 0 )
+			block = QString( "Block %1 (%2)" ).arg( num ).arg( c.block );
+
+		switch ( c.type ) {
+		case Added:
+			lines << QString( "%1 added" ).arg( block );
+			break;
+		case Removed:
+			lines << QString( "%1 removed" ).arg( block );
+			break;
+		case Changed:
+			if ( c.item.isEmpty() )
+				lines << QString( "%1 changed %2" ).arg( block ).arg( c.valueB ).trimmed();
+			else
+				lines << QString( "%1 %2: %3 -> %4" ).arg( block ).arg( c.item ).arg( c.valueA ).arg( c.valueB );
+			break;
+		}
+	}
+
+	return lines.join( "\n" );
+}
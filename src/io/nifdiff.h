@@ -0,0 +1,95 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+used to endorse or promote products derived from this software
+without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#ifndef NIFDIFF_H
+#define NIFDIFF_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+
+//! @file nifdiff.h NifDiff
+
+class NifModel;
+class QModelIndex;
+
+/*! Structural comparison of two NIFs.
+ *
+ * Blocks are compared by an XXH64 hash of their serialized bytes, so identical blocks
+ * cost one hash each. Only blocks whose hashes differ are walked item by item.
+ */
+class NifDiff final
+{
+public:
+	enum ChangeType
+	{
+		Added, Removed, Changed
+	};
+
+	//! A single difference between two NIFs
+	struct Change
+	{
+		ChangeType type = Changed;
+		//! Block number in the first NIF, or -1 for the header or an added block
+		int blockA = -1;
+		//! Block number in the second NIF, or -1 for the header or a removed block
+		int blockB = -1;
+		//! Block type, or "Header"
+		QString block;
+		//! Path of the changed item inside the block; empty for whole blocks
+		QString item;
+		QString valueA;
+		QString valueB;
+	};
+
+	//! Compares two NIFs block by block
+	static QList<Change> compare( const NifModel * a, const NifModel * b );
+	//! Compares a NIF to serialized NIF data, e.g. its own re-saved bytes
+	static QList<Change> compare( const NifModel * nif, const QByteArray & data );
+
+	//! Returns the XXH64 hash of the serialized header
+	static quint64 headerHash( const NifModel * nif );
+	//! Returns the XXH64 hashes of the serialized blocks
+	static QVector<quint64> blockHashes( const NifModel * nif );
+
+	//! Formats a list of changes as plain text, one change per line
+	static QString report( const QList<Change> & changes );
+
+protected:
+	static void compareItems( const NifModel * a, const QModelIndex & ia, const NifModel * b, const QModelIndex & ib,
+							  const QString & path, const Change & proto, QList<Change> & changes, int & budget );
+};
+
+#endif
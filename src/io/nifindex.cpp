@@ -0,0 +1,342 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+used to endorse or promote products derived from this software
+without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#include "nifindex.h"
+
+#include "model/nifmodel.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+
+//! @file nifindex.cpp NifIndex persistence and queries
+
+#define NIFINDEX_MAGIC 0x58444E49 // "INDX"
+#define NIFINDEX_VERSION 1
+
+static QDataStream & operator<<( QDataStream & out, const NifIndex::Entry & e )
+{
+	return out << e.size << e.modified << e.version << e.userVersion << e.userVersion2
+		<< e.blockTypes << e.strings << e.textures;
+}
+
+static QDataStream & operator>>( QDataStream & in, NifIndex::Entry & e )
+{
+	return in >> e.size >> e.modified >> e.version >> e.userVersion >> e.userVersion2
+		>> e.blockTypes >> e.strings >> e.textures;
+}
+
+//! Normalizes a texture path for storing and matching
+static QString texturePath( QString path )
+{
+	return path.replace( "/", "\\" ).toLower();
+}
+
+static bool isTexturePath( const QString & path )
+{
+	static const QStringList suffixes = { ".dds", ".tga", ".bmp", ".bgsm", ".bgem" };
+	for ( const QString & suffix : suffixes ) {
+		if ( path.endsWith( suffix, Qt::CaseInsensitive ) )
+			return true;
+	}
+	return false;
+}
+
+//! Collects texture paths from the string values of a block and its string arrays
+static void collectTextures( const NifModel * nif, const QModelIndex & iBlock, QSet<QString> & textures )
+{
+	for ( int r = 0; r < nif->rowCount( iBlock ); r++ ) {
+		QModelIndex idx = nif->index( r, 0, iBlock );
+
+		if ( nif->rowCount( idx ) > 0 ) {
+			// Only descend into string arrays, e.g. BSShaderTextureSet
+			if ( !nif->getValue( nif->index( 0, 0, idx ) ).isString() )
+				continue;
+
+			for ( int c = 0; c < nif->rowCount( idx ); c++ ) {
+				QString path = nif->get<QString>( nif->index( c, 0, idx ) );
+				if ( isTexturePath( path ) )
+					textures.insert( texturePath( path ) );
+			}
+		} else if ( nif->getValue( idx ).isString() ) {
+			QString path = nif->get<QString>( idx );
+			if ( isTexturePath( path ) )
+				textures.insert( texturePath( path ) );
+		}
+	}
+}
+
+QString NifIndex::cacheFile( const QString & root )
+{
+	QString key = QDir::cleanPath( QFileInfo( root ).absoluteFilePath() ).toLower();
+	QString hash = QString::fromLatin1( QCryptographicHash::hash( key.toUtf8(), QCryptographicHash::Md5 ).toHex() );
+
+	return QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) + "/index/" + hash + ".idx";
+}
+
+bool NifIndex::load( const QString & root )
+{
+	QString path = QFileInfo( root ).absoluteFilePath();
+
+	QWriteLocker locker( &lock );
+	if ( path == rootPath )
+		return true;
+
+	entries.clear();
+	seen.clear();
+	rootPath = path;
+	dirty = false;
+
+	QFile f( cacheFile( path ) );
+	if ( !f.open( QIODevice::ReadOnly ) )
+		return false;
+
+	// Read the whole index at once and parse it from memory
+	QByteArray data = f.readAll();
+	QDataStream in( data );
+	in.setVersion( QDataStream::Qt_5_7 );
+
+	quint32 magic = 0, version = 0;
+	QString storedRoot;
+	in >> magic >> version >> storedRoot;
+
+	if ( magic != NIFINDEX_MAGIC || version != NIFINDEX_VERSION || storedRoot != path )
+		return false;
+
+	in >> entries;
+
+	if ( in.status() != QDataStream::Ok ) {
+		entries.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool NifIndex::save()
+{
+	QWriteLocker locker( &lock );
+	if ( !dirty || rootPath.isEmpty() )
+		return true;
+
+	QString path = cacheFile( rootPath );
+	QDir().mkpath( QFileInfo( path ).absolutePath() );
+
+	QByteArray data;
+	QDataStream out( &data, QIODevice::WriteOnly );
+	out.setVersion( QDataStream::Qt_5_7 );
+	out << quint32( NIFINDEX_MAGIC ) << quint32( NIFINDEX_VERSION ) << rootPath << entries;
+
+	QSaveFile f( path );
+	if ( !f.open( QIODevice::WriteOnly ) || f.write( data ) != data.size() || !f.commit() )
+		return false;
+
+	dirty = false;
+	return true;
+}
+
+int NifIndex::count() const
+{
+	QReadLocker locker( &lock );
+	return entries.count();
+}
+
+void NifIndex::setQuery( const QString & blockType, quint32 version, const QString & texture )
+{
+	QSet<QString> types;
+	if ( !blockType.isEmpty() ) {
+		// Resolve the inheritance once so matching is a set lookup
+		NifModel nif;
+		for ( const QString & id : NifModel::allNiBlocks() ) {
+			if ( nif.inherits( id, blockType ) )
+				types.insert( id );
+		}
+		types.insert( blockType );
+	}
+
+	QWriteLocker locker( &lock );
+	queryTypes = types;
+	queryBlock = blockType;
+	queryVersion = version;
+	queryTexture = texturePath( texture );
+}
+
+bool NifIndex::matches( const Entry & entry ) const
+{
+	if ( queryVersion != 0 && entry.version != queryVersion )
+		return false;
+
+	if ( !queryBlock.isEmpty() ) {
+		bool found = false;
+		for ( auto it = entry.blockTypes.constBegin(); it != entry.blockTypes.constEnd() && !found; ++it ) {
+			found = queryTypes.contains( it.key() );
+		}
+
+		if ( !found )
+			return false;
+	}
+
+	if ( !queryTexture.isEmpty() ) {
+		bool found = false;
+		for ( const QString & tex : entry.textures ) {
+			if ( tex.contains( queryTexture ) ) {
+				found = true;
+				break;
+			}
+		}
+
+		if ( !found )
+			return false;
+	}
+
+	return true;
+}
+
+bool NifIndex::matches( const QString & path ) const
+{
+	QReadLocker locker( &lock );
+
+	auto it = entries.constFind( path );
+	if ( it == entries.constEnd() )
+		return false;
+
+	return matches( it.value() );
+}
+
+QStringList NifIndex::query() const
+{
+	QReadLocker locker( &lock );
+
+	QStringList result;
+	for ( auto it = entries.constBegin(); it != entries.constEnd(); ++it ) {
+		if ( matches( it.value() ) )
+			result << it.key();
+	}
+
+	result.sort();
+	return result;
+}
+
+void NifIndex::beginScan()
+{
+	QWriteLocker locker( &lock );
+	seen.clear();
+}
+
+bool NifIndex::inScope( const QString & path, bool recursive, bool archives ) const
+{
+	// A single archive is always scanned as a whole
+	if ( QFileInfo( rootPath ).isFile() )
+		return true;
+
+	QString rel = QDir( rootPath ).relativeFilePath( QFileInfo( path ).absoluteFilePath() );
+
+	// Archive entries are keyed as "<archive>/<entry>"; the archive decides the depth
+	static const QRegularExpression archive( "\\.(bsa|ba2)/", QRegularExpression::CaseInsensitiveOption );
+	QRegularExpressionMatch m = archive.match( rel );
+	if ( m.hasMatch() ) {
+		if ( !archives )
+			return false;
+
+		rel = rel.left( m.capturedEnd() - 1 );
+	}
+
+	return recursive || !rel.contains( '/' );
+}
+
+void NifIndex::endScan( const QStringList & suffixes, bool recursive, bool archives )
+{
+	QWriteLocker locker( &lock );
+
+	for ( auto it = entries.begin(); it != entries.end(); ) {
+		bool scanned = false;
+		for ( const QString & suffix : suffixes ) {
+			if ( it.key().endsWith( suffix, Qt::CaseInsensitive ) ) {
+				scanned = true;
+				break;
+			}
+		}
+
+		if ( scanned && !seen.contains( it.key() ) && inScope( it.key(), recursive, archives ) ) {
+			it = entries.erase( it );
+			dirty = true;
+		} else {
+			++it;
+		}
+	}
+
+	seen.clear();
+}
+
+bool NifIndex::isCurrent( const QString & path, qint64 size, const QDateTime & modified )
+{
+	QWriteLocker locker( &lock );
+	seen.insert( path );
+
+	auto it = entries.constFind( path );
+	if ( it == entries.constEnd() )
+		return false;
+
+	return it.value().size == size && it.value().modified == modified.toMSecsSinceEpoch();
+}
+
+void NifIndex::update( const QString & path, qint64 size, const QDateTime & modified, const NifModel * nif )
+{
+	Entry e;
+	e.size = size;
+	e.modified = modified.toMSecsSinceEpoch();
+	e.version = nif->getVersionNumber();
+	e.userVersion = nif->getUserVersion();
+	e.userVersion2 = nif->getUserVersion2();
+	e.strings = nif->getArray<QString>( nif->getHeader(), "Strings" ).toList();
+
+	QSet<QString> textures;
+	for ( int b = 0; b < nif->getBlockCount(); b++ ) {
+		QModelIndex iBlock = nif->getBlock( b );
+
+		e.blockTypes[nif->getBlockName( iBlock )]++;
+		collectTextures( nif, iBlock, textures );
+	}
+	e.textures = textures.toList();
+
+	QWriteLocker locker( &lock );
+	entries.insert( path, e );
+	seen.insert( path );
+	dirty = true;
+}
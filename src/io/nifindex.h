@@ -0,0 +1,130 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+used to endorse or promote products derived from this software
+without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+#ifndef NIFINDEX_H
+#define NIFINDEX_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+
+//! @file nifindex.h NifIndex
+
+class NifModel;
+
+/*! A persistent index of the headers and contents of a corpus of NIF files.
+ *
+ * The index is keyed by file path, or "archive.bsa/entry" for archive entries,
+ * and is stored in the cache folder per root directory. An entry is current while
+ * the size and modification time of its file are unchanged, so re-indexing only
+ * touches files which changed since the last scan.
+ */
+class NifIndex final
+{
+public:
+	//! The indexed data of a single file
+	struct Entry
+	{
+		qint64 size = 0;
+		qint64 modified = 0;
+		quint32 version = 0;
+		quint32 userVersion = 0;
+		quint32 userVersion2 = 0;
+		//! Number of blocks per block type
+		QHash<QString, quint32> blockTypes;
+		//! The header strings
+		QStringList strings;
+		//! Lowercase texture and material paths
+		QStringList textures;
+	};
+
+	NifIndex() {}
+
+	//! Loads the index of a directory or archive from the cache, unless it is already loaded
+	bool load( const QString & root );
+	//! Writes the index to the cache if it was changed
+	bool save();
+
+	//! Returns the directory or archive the index belongs to
+	QString root() const { return rootPath; }
+	//! Number of indexed files
+	int count() const;
+
+	//! Sets the block type, version and texture that matches() and query() filter on
+	void setQuery( const QString & blockType, quint32 version, const QString & texture );
+	//! Whether the entry for a file matches the query
+	bool matches( const QString & path ) const;
+	//! Returns all indexed files matching the query
+	QStringList query() const;
+
+	//! Starts a scan; entries not seen until endScan() are dropped
+	void beginScan();
+	/*! Drops the entries of files with the given suffixes that were not seen during the scan
+	 *
+	 * Only files the scan could have reached are dropped; a scan without
+	 * recursion or archives keeps the entries of sub directories and archives.
+	 */
+	void endScan( const QStringList & suffixes, bool recursive, bool archives );
+
+	//! Whether the stored entry for a file is current; marks the file as seen
+	bool isCurrent( const QString & path, qint64 size, const QDateTime & modified );
+	//! Updates the entry for a file from a loaded model
+	void update( const QString & path, qint64 size, const QDateTime & modified, const NifModel * nif );
+
+	//! Returns the cache file for a directory or archive
+	static QString cacheFile( const QString & root );
+
+protected:
+	bool matches( const Entry & entry ) const;
+	//! Whether a scan with the given options visits the file
+	bool inScope( const QString & path, bool recursive, bool archives ) const;
+
+	mutable QReadWriteLock lock;
+
+	QHash<QString, Entry> entries;
+	QSet<QString> seen;
+
+	QString rootPath;
+	bool dirty = false;
+
+	QSet<QString> queryTypes;
+	QString queryBlock;
+	quint32 queryVersion = 0;
+	QString queryTexture;
+};
+
+#endif
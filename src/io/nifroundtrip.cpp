@@ -0,0 +1,150 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+used to endorse or promote products derived from this software
+without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+
+#include "nifroundtrip.h"
+
+#include "io/nifdiff.h"
+#include "model/nifmodel.h"
+
+#include <QBuffer>
+#include <QReadLocker>
+
+#include "xxhash.h"
+
+
+//! @file nifroundtrip.cpp In-memory round-trip verification
+
+HashDevice::HashDevice( QObject * parent )
+	: QIODevice( parent ), state( XXH64_createState() )
+{
+}
+
+HashDevice::~HashDevice()
+{
+	XXH64_freeState( state );
+}
+
+bool HashDevice::open( OpenMode mode )
+{
+	if ( mode & ReadOnly )
+		return false;
+
+	XXH64_reset( state, 0 );
+	return QIODevice::open( mode );
+}
+
+quint64 HashDevice::hash() const
+{
+	return XXH64_digest( state );
+}
+
+qint64 HashDevice::writeData( const char * data, qint64 len )
+{
+	XXH64_update( state, data, size_t( len ) );
+	return len;
+}
+
+
+RoundTripCheck::RoundTripCheck( const QByteArray & source, quint64 sourceHash, const QString & path, QObject * parent )
+	: QThread( parent ), source( source ), sourceHash( sourceHash ), path( path )
+{
+}
+
+void RoundTripCheck::run()
+{
+	// The check works on its own copy of the NIF so the views are never blocked
+	NifModel nif;
+	nif.setMessageMode( BaseModel::TstMessage );
+
+	QReadLocker lck( &NifModel::XMLlock );
+
+	QBuffer in( &source );
+	if ( !in.open( QIODevice::ReadOnly ) || !nif.load( in ) )
+		return;
+
+	if ( isInterruptionRequested() )
+		return;
+
+	HashDevice out;
+	if ( !out.open( QIODevice::WriteOnly ) || !nif.save( out ) )
+		return;
+
+	if ( out.hash() == sourceHash || isInterruptionRequested() )
+		return;
+
+	// Only serialize to memory when there is something to report
+	QBuffer saved;
+	if ( !saved.open( QIODevice::WriteOnly ) || !nif.save( saved ) )
+		return;
+
+	QString details = firstDifference( &nif, saved.data() );
+
+	QString diff = NifDiff::report( NifDiff::compare( &nif, saved.data() ) );
+	if ( !diff.isEmpty() )
+		details += "\n\n" + diff;
+
+	emit mismatch( path, details );
+}
+
+QString RoundTripCheck::firstDifference( const NifModel * nif, const QByteArray & saved ) const
+{
+	int size = qMin( source.size(), saved.size() );
+	int ofs = 0;
+	while ( ofs < size && source.at( ofs ) == saved.at( ofs ) )
+		ofs++;
+
+	QString where = "Header";
+
+	// Find the last block starting at or before the offset
+	int lo = 0, hi = nif->getBlockCount() - 1, block = -1;
+	while ( lo <= hi ) {
+		int mid = (lo + hi) / 2;
+		int start = nif->fileOffset( nif->getBlock( mid ) );
+		if ( start >= 0 && start <= ofs ) {
+			block = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	if ( block >= 0 )
+		where = QString( "%1 [%2]" ).arg( nif->getBlockName( nif->getBlock( block ) ) ).arg( block );
+
+	QString sizes;
+	if ( source.size() != saved.size() )
+		sizes = QString( " (%1 bytes read, %2 bytes saved)" ).arg( source.size() ).arg( saved.size() );
+
+	return QString( "First difference at offset 0x%1 in %2%3" ).arg( ofs, 0, 16 ).arg( where, sizes );
+}
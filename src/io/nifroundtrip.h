@@ -0,0 +1,100 @@
+/***** BEGIN LICENSE BLOCK *****
+
+BSD License
+
+Copyright (c) 2005-2015, NIF File Format Library and Tools
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions
+are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+3. The name of the NIF File Format Library and Tools project may not be
+used to endorse or promote products derived from this software
+without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+***** END LICENCE BLOCK *****/
+
+
+
+
+#ifndef NIFROUNDTRIP_H
+#define NIFROUNDTRIP_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+#include <QThread>
+
+
+//! @file nifroundtrip.h HashDevice, RoundTripCheck
+
+class NifModel;
+struct XXH64_state_s;
+
+//! Write-only device which feeds everything written to it into an XXH64 hash
+class HashDevice final : public QIODevice
+{
+public:
+	HashDevice( QObject * parent = nullptr );
+	~HashDevice();
+
+	bool open( OpenMode mode ) override;
+	bool isSequential() const override { return true; }
+
+	//! Returns the hash of all bytes written since the device was opened
+	quint64 hash() const;
+
+protected:
+	qint64 readData( char *, qint64 ) override { return -1; }
+	qint64 writeData( const char * data, qint64 len ) override;
+
+	XXH64_state_s * state;
+};
+
+
+/*! Verifies that a NIF will be saved byte for byte as it was read.
+ *
+ * The source bytes are loaded into a private NifModel on a background thread and
+ * serialized straight into a HashDevice, so nothing is written to disk. If the hashes
+ * differ the NIF is serialized again to locate the first differing byte.
+ */
+class RoundTripCheck final : public QThread
+{
+	Q_OBJECT
+
+public:
+	//! sourceHash is the HashDevice hash of source, taken while it was read
+	RoundTripCheck( const QByteArray & source, quint64 sourceHash, const QString & path, QObject * parent = nullptr );
+
+signals:
+	//! Emitted when the saved bytes differ from the source
+	void mismatch( const QString & path, const QString & details );
+
+protected:
+	void run() override;
+
+	//! Describes where the saved bytes first differ from the source
+	QString firstDifference( const NifModel * nif, const QByteArray & saved ) const;
+
+	QByteArray source;
+	quint64 sourceHash;
+	QString path;
+};
+
+#endif
@@ -33,15 +33,19 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "nifskope.h"
 #include "version.h"
 #include "data/nifvalue.h"
+#include "io/nifdiff.h"
 #include "model/nifmodel.h"
 #include "model/kfmmodel.h"
 
+#include <fsengine/bsawriter.h>
+
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QDesktopServices>
 #include <QDir>
 #include <QSettings>
 #include <QStack>
+#include <QTextStream>
 #include <QUdpSocket>
 #include <QUrl>
 
@@ -148,7 +152,122 @@ int main( int argc, char * argv[] )
 			return 0;
 		}
 	} else {
-		// Future command line batch tools here
+		// Command line batch tools
+		QCoreApplication::setOrganizationName( "NifTools" );
+		QCoreApplication::setOrganizationDomain( "niftools.org" );
+		QCoreApplication::setApplicationName( "NifSkope " + NifSkopeVersion::rawToMajMin( NIFSKOPE_VERSION ) );
+		QCoreApplication::setApplicationVersion( NIFSKOPE_VERSION );
+
+		QCommandLineParser parser;
+		parser.setSingleDashWordOptionMode( QCommandLineParser::ParseAsLongOptions );
+		parser.addHelpOption();
+		parser.addVersionOption();
+
+		QCommandLineOption noGuiOption( "no-gui", "Run without the GUI" );
+		parser.addOption( noGuiOption );
+
+		QCommandLineOption diffOption( "diff", "Compare two NIF files block by block; exits with 1 if they differ" );
+		parser.addOption( diffOption );
+
+		QCommandLineOption packOption( "pack", "Pack a folder, or the files listed in a text file, into an archive", "archive" );
+		parser.addOption( packOption );
+
+		QCommandLineOption formatOption( "format", "Archive format for --pack: bsa104, bsa105, ba2 or ba2dx10", "format" );
+		parser.addOption( formatOption );
+
+		QCommandLineOption storeOption( "store", "Do not compress packed files" );
+		parser.addOption( storeOption );
+
+		QCommandLineOption threadsOption( "threads", "Number of threads used by --pack", "count" );
+		parser.addOption( threadsOption );
+
+		QCommandLineOption verifyOption( "verify", "Read a packed archive back and compare it with its sources" );
+		parser.addOption( verifyOption );
+
+		parser.addPositionalArgument( "files", "The files to process" );
+
+		parser.process( *app );
+
+		QTextStream out( stdout );
+		QTextStream err( stderr );
+
+		if ( parser.isSet( diffOption ) ) {
+			QStringList files = parser.positionalArguments();
+			if ( files.count() != 2 ) {
+				err << "--diff requires two files" << endl;
+				return 2;
+			}
+
+			if ( !NifModel::loadXML() ) {
+				err << "Could not load nif.xml" << endl;
+				return 2;
+			}
+
+			NifModel a, b;
+			a.setMessageMode( BaseModel::TstMessage );
+			b.setMessageMode( BaseModel::TstMessage );
+
+			if ( !a.loadFromFile( files.at( 0 ) ) ) {
+				err << "Could not load " << files.at( 0 ) << endl;
+				return 2;
+			}
+
+			if ( !b.loadFromFile( files.at( 1 ) ) ) {
+				err << "Could not load " << files.at( 1 ) << endl;
+				return 2;
+			}
+
+			auto changes = NifDiff::compare( &a, &b );
+			if ( !changes.isEmpty() )
+				out << NifDiff::report( changes ) << endl;
+
+			return changes.isEmpty() ? 0 : 1;
+		}
+
+		if ( parser.isSet( packOption ) ) {
+			QStringList inputs = parser.positionalArguments();
+			if ( inputs.count() != 1 ) {
+				err << "--pack requires a folder or a file list" << endl;
+				return 2;
+			}
+
+			QString archive = parser.value( packOption );
+
+			static const QHash<QString, BSAWriter::Format> formats = {
+				{ "bsa104", BSAWriter::BSA104 }, { "bsa105", BSAWriter::BSA105 },
+				{ "ba2", BSAWriter::BA2General }, { "ba2dx10", BSAWriter::BA2Textures }
+			};
+
+			QString format = parser.value( formatOption ).toLower();
+			if ( format.isEmpty() )
+				format = archive.endsWith( ".ba2", Qt::CaseInsensitive ) ? "ba2" : "bsa104";
+
+			if ( !formats.contains( format ) ) {
+				err << "Unknown archive format " << format << endl;
+				return 2;
+			}
+
+			BSAWriter writer( formats.value( format ) );
+			writer.setCompressed( !parser.isSet( storeOption ) );
+			if ( parser.isSet( threadsOption ) )
+				writer.setThreadCount( parser.value( threadsOption ).toInt() );
+
+			QFileInfo input( inputs.at( 0 ) );
+			bool ok = input.isDir() ? writer.addDirectory( input.filePath() )
+			                        : writer.addFileList( input.filePath(), input.absolutePath() );
+
+			if ( ok )
+				ok = writer.write( archive );
+			if ( ok && parser.isSet( verifyOption ) )
+				ok = writer.verify( archive );
+
+			if ( !ok ) {
+				err << writer.errorString() << endl;
+				return 1;
+			}
+
+			return 0;
+		}
 	}
 
 	return 0;
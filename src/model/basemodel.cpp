@@ -646,6 +646,45 @@ bool BaseModel::loadFromFile( const QString & file )
 	return false;
 }
 
+bool BaseModel::loadFromFile( const QString & file, QByteArray * data, QIODevice * copy )
+{
+	QFile f( file );
+	QFileInfo finfo( f );
+
+	setState( Loading );
+
+	if ( f.exists() && finfo.isFile() && f.open( QIODevice::ReadOnly ) ) {
+		if ( copy ) {
+			// Pass each chunk on while it is still in cache
+			data->resize( int( f.size() ) );
+
+			qint64 ofs = 0, n;
+			while ( ofs < data->size() && (n = f.read( data->data() + ofs, qMin<qint64>( data->size() - ofs, 1 << 20 ) )) > 0 ) {
+				copy->write( data->constData() + ofs, n );
+				ofs += n;
+			}
+
+			data->resize( int( ofs ) );
+		} else {
+			*data = f.readAll();
+		}
+		f.close();
+
+		QBuffer buf( data );
+		if ( buf.open( QIODevice::ReadOnly ) && load( buf ) ) {
+			fileinfo = finfo;
+			filename = finfo.baseName();
+			folder = finfo.absolutePath();
+			resetState();
+			return true;
+		}
+	}
+
+	data->clear();
+	resetState();
+	return false;
+}
+
 bool BaseModel::saveToFile( const QString & str ) const
 {
 	QFile f( str );
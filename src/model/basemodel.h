@@ -113,6 +113,8 @@ public:
 
 	//! Load from file.
 	bool loadFromFile( const QString & filename );
+	//! Load from file, reading it into memory once; the bytes are returned in data and also written to copy if given.
+	bool loadFromFile( const QString & filename, QByteArray * data, QIODevice * copy = nullptr );
 	//! Save to file.
 	bool saveToFile( const QString & str ) const;
 
@@ -2119,16 +2119,22 @@ bool NifModel::loadAndMapLinks( QIODevice & device, const QModelIndex & index, c
 
 bool NifModel::loadHeaderOnly( const QString & fname )
 {
-	clear();
-
 	QFile f( fname );
 
 	if ( !f.open( QIODevice::ReadOnly ) ) {
+		clear();
 		Message::critical( nullptr, tr( "Failed to open %1" ).arg( fname ) );
 		return false;
 	}
 
-	NifIStream stream( this, &f );
+	return loadHeaderOnly( f );
+}
+
+bool NifModel::loadHeaderOnly( QIODevice & device )
+{
+	clear();
+
+	NifIStream stream( this, &device );
 
 	// read header
 	NifItem * header = getHeaderItem();
@@ -2147,9 +2153,20 @@ bool NifModel::loadHeaderOnly( const QString & fname )
 
 bool NifModel::earlyRejection( const QString & filepath, const QString & blockId, quint32 v )
 {
-	NifModel nif;
+	QFile f( filepath );
 
-	if ( nif.loadHeaderOnly( filepath ) == false ) {
+	if ( !f.open( QIODevice::ReadOnly ) ) {
+		Message::critical( nullptr, tr( "Failed to open %1" ).arg( filepath ) );
+		return false;
+	}
+
+	return earlyRejection( f, blockId, v );
+}
+
+bool NifModel::earlyRejection( QIODevice & device, const QString & blockId, quint32 v )
+{
+	// The header is read into this model, so a caller checking many files reuses its allocations
+	if ( loadHeaderOnly( device ) == false ) {
 		//File failed to read entierly
 		return false;
 	}
@@ -2158,7 +2175,7 @@ bool NifModel::earlyRejection( const QString & filepath, const QString & blockId
 
 	if ( v == 0 ) {
 		ver_match = true;
-	} else if ( v != 0 && nif.getVersionNumber() == v ) {
+	} else if ( v != 0 && getVersionNumber() == v ) {
 		ver_match = true;
 	}
 
@@ -2167,7 +2184,7 @@ bool NifModel::earlyRejection( const QString & filepath, const QString & blockId
 	if ( blockId.isEmpty() == true || v < 0x0A000100 ) {
 		blk_match = true;
 	} else {
-		const auto & types = nif.getArray<QString>( nif.getHeader(), "Block Types" );
+		const auto & types = getArray<QString>( getHeader(), "Block Types" );
 		for ( const QString& s : types ) {
 			if ( inherits( s, blockId ) ) {
 				blk_match = true;
@@ -125,6 +125,8 @@ public:
 	bool loadAndMapLinks( QIODevice & device, const QModelIndex &, const QMap<qint32, qint32> & map );
 	//! Loads the header from a filename
 	bool loadHeaderOnly( const QString & fname );
+	//! Loads the header from a device
+	bool loadHeaderOnly( QIODevice & device );
 
 	//! Returns the the estimated file offset of the model index
 	int fileOffset( const QModelIndex & ) const;
@@ -138,13 +140,16 @@ public:
 
 	/*! Checks if the specified file contains the specified block ID in its header and is of the specified version
 	 *
-	 * Note that it will not open the full file to look for block types, only the header
+	 * Note that it will not open the full file to look for block types, only the header.
+	 * The header replaces the contents of this model.
 	 *
 	 * @param filepath	The NIF to check
 	 * @param blockId	The block to check for
 	 * @param version	The version to check for
 	 */
 	bool earlyRejection( const QString & filepath, const QString & blockId, quint32 version );
+	//! Checks the header read from a device, such as a QBuffer holding an archive entry
+	bool earlyRejection( QIODevice & device, const QString & blockId, quint32 version );
 
 	//! Returns the model index of the NiHeader
 	QModelIndex getHeader() const;
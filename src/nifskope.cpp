@@ -38,6 +38,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "spellbook.h"
 #include "version.h"
 #include "gl/glscene.h"
+#include "io/nifroundtrip.h"
 #include "model/kfmmodel.h"
 #include "model/nifmodel.h"
 #include "model/nifproxymodel.h"
@@ -64,13 +65,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QTimer>
 #include <QTranslator>
 #include <QUrl>
-#include <QCryptographicHash>
 
 #include <QListView>
 #include <QTreeView>
 #include <QStandardItemModel>
 
 #include <fsengine/bsa.h>
+#include <fsengine/entrycache.h>
 #include <fsengine/fsmanager.h>
 
 #ifdef WIN32
@@ -232,7 +233,22 @@ NifSkope::NifSkope()
 	connect( bsaView, &QTreeView::doubleClicked, this, &NifSkope::openArchiveFile );
 
 	bsaModel = new BSAModel( this );
-	bsaProxyModel = new BSAProxyModel( this );
+
+	// Filter once typing pauses; the matching itself runs on a background thread
+	auto filterTimer = new QTimer( this );
+	filterTimer->setSingleShot( true );
+
+	connect( ui->bsaFilter, &QLineEdit::textChanged, [filterTimer]() { filterTimer->start( 300 ); } );
+	connect( filterTimer, &QTimer::timeout, [this]() {
+		bsaModel->setFilter( ui->bsaFilter->text() );
+	} );
+
+	connect( ui->bsaFilenameOnly, &QCheckBox::toggled, bsaModel, &BSAModel::setFilterByNameOnly );
+	// Expanding every match would create all rows at once; folders are filled as they are opened
+	connect( bsaModel, &BSAModel::filterApplied, [this]( bool filtered ) {
+		if ( !filtered )
+			bsaView->collapseAll();
+	} );
 
 	// Empty Model for swapping out before model fill
 	emptyModel = new QStandardItemModel( this );
@@ -343,6 +359,12 @@ void NifSkope::exitRequested()
 
 NifSkope::~NifSkope()
 {
+	// Round-trip checks are children of the window and must stop before it goes away
+	for ( auto check : findChildren<RoundTripCheck *>() ) {
+		check->requestInterruption();
+		check->wait();
+	}
+
 	delete ui;
 }
 
@@ -371,6 +393,7 @@ void NifSkope::updateSettings()
 
 	cfg.locale = settings.value( "Locale", "en" ).toLocale();
 	cfg.suppressSaveConfirm = settings.value( "UI/Suppress Save Confirmation", false ).toBool();
+	cfg.roundTripCheck = settings.value( "UI/Check Round Trip On Load", false ).toBool();
 
 	settings.endGroup();
 }
@@ -726,53 +749,34 @@ void NifSkope::updateRecentArchiveFileActions()
 	mRecentArchiveFiles->setEnabled( numRecentFiles > 0 );
 }
 
-QByteArray fileChecksum( const QString &fileName, QCryptographicHash::Algorithm hashAlgorithm )
+void NifSkope::checkFile( const QByteArray & data, quint64 hash, const QString & path )
 {
-	QFile f( fileName );
-	if ( f.open( QFile::ReadOnly ) ) {
-		QCryptographicHash hash( hashAlgorithm );
-		if ( hash.addData( &f ) ) {
-			return hash.result();
-		}
+	// Results from a check of a previously loaded file are no longer wanted
+	if ( roundTrip ) {
+		disconnect( roundTrip, &RoundTripCheck::mismatch, this, &NifSkope::roundTripMismatch );
+		roundTrip->requestInterruption();
 	}
-	return QByteArray();
+
+	// The check runs on its own copy of the source
+	roundTrip = new RoundTripCheck( data, hash, path, this );
+	connect( roundTrip, &RoundTripCheck::mismatch, this, &NifSkope::roundTripMismatch );
+	connect( roundTrip, &QThread::finished, roundTrip, &QObject::deleteLater );
+	roundTrip->start( QThread::LowPriority );
 }
 
-void NifSkope::checkFile( QFileInfo fInfo, QByteArray hash )
+void NifSkope::roundTripMismatch( const QString & path, const QString & details )
 {
-	QString fname = fInfo.fileName();
-	QString fpath = fInfo.filePath();
-	QDir::temp().mkdir( "NifSkope" );
-	QString tmpDir = QDir::tempPath() + "/NifSkope";
-	QDir tmp( tmpDir );
-	QString tmpFile = tmpDir + "/" + fInfo.fileName();
-
-	emit beginSave();
-	bool saved = nif->saveToFile( tmpFile );
-	if ( saved ) {
-		auto filehash2 = fileChecksum( tmpFile, QCryptographicHash::Md5 );
+	// Reported in the status bar; the details go to the log
+	ui->statusbar->showMessage( tr( "%1 will not be 100% identical upon saving: %2" ).arg( QFileInfo( path ).fileName(), details.section( '\n', 0, 0 ) ) );
 
-		if ( hash == filehash2 ) {
-			tmp.remove( fname );
-		} else {
-			QString err = "An MD5 hash comparison indicates this file will not be 100% identical upon saving. This could indicate underlying issues with the data in this file.";
-			Message::warning( this, err, fpath );
-#ifdef QT_NO_DEBUG
-			tmp.remove( fname );
-#endif
-		}
-	}
-	emit completeSave( saved, fpath );
+	qCInfo( nsIo ) << "Round-trip check failed for" << path << "\n" << qPrintable( details );
 }
 
 void NifSkope::openArchive( const QString & archive )
 {
 	// Clear memory from previously opened archives
 	bsaModel->clear();
-	bsaProxyModel->clear();
-	bsaProxyModel->setSourceModel( emptyModel );
 	bsaView->setModel( emptyModel );
-	bsaView->setSortingEnabled( false );
 
 	archiveHandler.reset();
 
@@ -787,32 +791,26 @@ void NifSkope::openArchive( const QString & archive )
 
 		setCurrentArchive( bsa );
 
-		// Models
-		bsaModel->init();
-
-		// Populate model from BSA
-		bsa->fillModel( bsaModel, "meshes" );
+		// Rows are created from the BSA as folders are expanded
+		bsaModel->setFiletypes( { ".nif", ".bto", ".btr" } );
+		bsaModel->setFilter( ui->bsaFilter->text() );
+		bsaModel->setArchive( archiveHandler, "meshes" );
 
+		// Only the top level is created to find a folder holding meshes
 		if ( bsaModel->rowCount() == 0 ) {
 			qCWarning( nsIo ) << "The BSA does not contain any meshes.";
+			bsaModel->clear();
 			clearCurrentArchive();
 			return;
 		}
 
-		// Set proxy and view only after filling source model
-		bsaProxyModel->setSourceModel( bsaModel );
-		bsaView->setModel( bsaProxyModel );
-		bsaView->setSortingEnabled( true );
+		bsaView->setModel( bsaModel );
+		bsaView->setSortingEnabled( false );
 
 		bsaView->hideColumn( 1 );
 		bsaView->setColumnWidth( 0, 300 );
 		bsaView->setColumnWidth( 2, 50 );
 
-		// Sort proxy after model/view is populated
-		bsaProxyModel->sort( 0, Qt::AscendingOrder );
-		bsaProxyModel->setFiletypes( { ".nif", ".bto", ".btr" } );
-		bsaProxyModel->resetFilter();
-
 		// Set filename label
 		ui->bsaName->setText( currentArchive->name() );
 
@@ -822,28 +820,6 @@ void NifSkope::openArchive( const QString & archive )
 		// Bring tab to front
 		dBrowser->raise();
 
-		// Filter
-		auto filterTimer = new QTimer( this );
-		filterTimer->setSingleShot( true );
-
-		connect( ui->bsaFilter, &QLineEdit::textChanged, [filterTimer]() { filterTimer->start( 300 ); } );
-		connect( filterTimer, &QTimer::timeout, [this]() {
-			auto text = ui->bsaFilter->text();
-
-			bsaProxyModel->setFilterRegExp( QRegExp( text, Qt::CaseInsensitive, QRegExp::Wildcard ) );
-			bsaView->expandAll();
-
-			if ( text.isEmpty() ) {
-				bsaView->collapseAll();
-				bsaProxyModel->resetFilter();
-			}
-				
-		} );
-
-		connect( ui->bsaFilenameOnly, &QCheckBox::toggled, bsaProxyModel, &BSAProxyModel::setFilterByNameOnly );
-
-		// Update filter when switching open archives
-		filterTimer->start( 0 );
 	}
 }
 
@@ -861,9 +837,9 @@ void NifSkope::openArchiveFileString( BSA * bsa, const QString & filepath )
 		if ( !saveConfirm() )
 			return;
 
-		// Read data from BSA
+		// Read data from BSA; re-opened files come from the cache
 		QByteArray data;
-		bsa->fileContents( filepath, data );
+		EntryCache::fileContents( bsa, filepath, data );
 
 		// Format like "BSANAME.BSA/path/to/file.nif"
 		QString path = bsa->name() + "/" + filepath;
@@ -880,16 +856,6 @@ void NifSkope::openArchiveFileString( BSA * bsa, const QString & filepath )
 
 			emit completeLoading( loaded, path );
 
-			//if ( loaded ) {
-			//	QCryptographicHash hash( QCryptographicHash::Md5 );
-			//	hash.addData( data );
-			//	filehash = hash.result();
-			//
-			//	QFileInfo f( path );
-			//	
-			//	checkFile( f, filehash );
-			//}
-
 			buf.close();
 		}
 	}
@@ -982,15 +948,22 @@ void NifSkope::load()
 		return;
 	}
 
-	bool loaded = nif->loadFromFile( fname );
+	if ( !cfg.roundTripCheck ) {
+		emit completeLoading( nif->loadFromFile( fname ), fname );
+		return;
+	}
+
+	// Read the file once, hashing it as it is read; the same bytes feed the model and the round-trip check
+	QByteArray data;
+	HashDevice hash;
+	hash.open( QIODevice::WriteOnly );
+
+	bool loaded = nif->loadFromFile( fname, &data, &hash );
 
 	emit completeLoading( loaded, fname );
 
-	//if ( loaded ) {
-	//	filehash = fileChecksum( fname, QCryptographicHash::Md5 );
-	//
-	//	checkFile( f, filehash );
-	//}
+	if ( loaded )
+		checkFile( data, hash.hash(), fname );
 }
 
 void NifSkope::save()
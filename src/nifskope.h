@@ -39,6 +39,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QLocale>
 #include <QModelIndex>
 #include <QSet>
+#include <QPointer>
 #include <QUndoCommand>
 
 #include <memory>
@@ -65,13 +66,13 @@ class KfmModel;
 class NifModel;
 class NifProxyModel;
 class NifTreeView;
+class RoundTripCheck;
 class ReferenceBrowser;
 class SettingsDialog;
 class SpellBook;
 class FSArchiveHandler;
 class BSA;
 class BSAModel;
-class BSAProxyModel;
 class QStandardItemModel;
 class QAction;
 class QActionGroup;
@@ -262,6 +263,9 @@ protected slots:
 	//! Called after window resizing has stopped
 	void resizeDone();
 
+	//! Report a failed round-trip check
+	void roundTripMismatch( const QString & path, const QString & details );
+
 protected:
 	void closeEvent( QCloseEvent * e ) override final;
 	//void resizeEvent( QResizeEvent * event ) override final;
@@ -276,7 +280,8 @@ private:
 
 	void loadFile( const QString & );
 	void saveFile( const QString & );
-	void checkFile( QFileInfo fInfo, QByteArray filehash );
+	//! Verify in the background that the NIF will be saved identically to its source bytes
+	void checkFile( const QByteArray & data, quint64 hash, const QString & path );
 
 	void openRecentFile();
 	void setCurrentFile( const QString & );
@@ -321,7 +326,8 @@ private:
 	QString currentFile;
 	BSA * currentArchive = nullptr;
 
-	QByteArray filehash;
+	//! The round-trip check for the current file, if one is running
+	QPointer<RoundTripCheck> roundTrip;
 
 	//! Stores the NIF file in memory.
 	NifModel * nif;
@@ -417,6 +423,7 @@ private:
 	{
 		QLocale locale;
 		bool suppressSaveConfirm;
+		bool roundTripCheck;
 	} cfg;
 
 	//! The currently selected index
@@ -427,7 +434,6 @@ private:
 	//QAction * idxBackAction;
 
 	BSAModel * bsaModel;
-	BSAProxyModel * bsaProxyModel;
 	QStandardItemModel * emptyModel;
 
 	QMenu * mRecentArchiveFiles;
@@ -127,7 +127,17 @@ NifSkope * NifSkope::createWindow( const QString & fname )
 	skope->raise();
 
 	if ( !fname.isEmpty() ) {
-		skope->loadFile( fname );
+		// Archive entries are addressed as "path/to/archive.bsa/path/to/file.nif"
+		QRegularExpression re( "^(.+\\.(bsa|ba2))[\\\\/](.+)$", QRegularExpression::CaseInsensitiveOption );
+		QRegularExpressionMatch match = re.match( fname );
+
+		if ( !QFileInfo( fname ).exists() && match.hasMatch() ) {
+			skope->openArchive( match.captured( 1 ) );
+			if ( skope->currentArchive )
+				skope->openArchiveFileString( skope->currentArchive, match.captured( 3 ) );
+		} else {
+			skope->loadFile( fname );
+		}
 	}
 
 	return skope;
@@ -9,6 +9,7 @@
 
 #include "nifskope.h"
 
+#include <fsengine/entrycache.h>
 #include <fsengine/fsengine.h>
 #include <fsengine/fsmanager.h>
 
@@ -534,6 +535,13 @@ SettingsResources::SettingsResources( QWidget * parent ) :
 
 	connect( ui->foldersList, &QListView::doubleClicked, this, &SettingsPane::modifyPane );
 	connect( ui->chkAlternateExt, &QCheckBox::clicked, this, &SettingsPane::modifyPane );
+	connect( ui->spnArchiveCache, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &SettingsPane::modifyPane );
+
+	// Archive cache statistics
+	auto statsTimer = new QTimer( this );
+	statsTimer->setInterval( 1000 );
+	connect( statsTimer, &QTimer::timeout, this, &SettingsResources::updateCacheStats );
+	statsTimer->start();
 
 	// Move Up / Move Down Behavior
 	connect( ui->foldersList->selectionModel(), &QItemSelectionModel::currentChanged,
@@ -576,6 +584,9 @@ void SettingsResources::read()
 	ui->archivesList->setCurrentIndex( archives->index( 0, 0 ) );
 
 	ui->chkAlternateExt->setChecked( settings.value( "Settings/Resources/Alternate Extensions", true ).toBool() );
+	ui->spnArchiveCache->setValue( settings.value( "Settings/Resources/Archive Cache Size", 256 ).toInt() );
+
+	updateCacheStats();
 
 	setModified( false );
 }
@@ -591,20 +602,29 @@ void SettingsResources::write()
 	settings.setValue( "Settings/Resources/Archives", archives->stringList() );
 
 	// Sync FSManager to Archives list
-	archiveMgr->archives.clear();
-	for ( const QString an : archives->stringList() ) {
-		if ( !archiveMgr->archives.contains( an ) )
-			if ( auto a = FSArchiveHandler::openArchive( an ) )
-				archiveMgr->archives.insert( an, a );
-	}
+	archiveMgr->setArchives( archives->stringList() );
 
 	settings.setValue( "Settings/Resources/Alternate Extensions", ui->chkAlternateExt->isChecked() );
 
+	settings.setValue( "Settings/Resources/Archive Cache Size", ui->spnArchiveCache->value() );
+	EntryCache::setBudget( qint64( ui->spnArchiveCache->value() ) * 1024 * 1024 );
+
 	setModified( false );
 
 	emit dlg->flush3D();
 }
 
+void SettingsResources::updateCacheStats()
+{
+	if ( !isVisible() )
+		return;
+
+	ui->lblCacheStats->setText( tr( "%1 MB used, %2 hits, %3 misses" )
+		.arg( EntryCache::size() / 1048576.0, 0, 'f', 1 )
+		.arg( EntryCache::hits() )
+		.arg( EntryCache::misses() ) );
+}
+
 void SettingsResources::setDefault()
 {
 	read();
@@ -105,6 +105,9 @@ public slots:
 	void on_btnArchiveUp_clicked();
 	void on_btnArchiveAutoDetect_clicked();
 
+	//! Show the hit and miss counts of the archive cache
+	void updateCacheStats();
+
 private:
 	std::unique_ptr<Ui::SettingsResources> ui;
 
@@ -1,14 +1,22 @@
 #include "xmlcheck.h"
 
 #include "message.h"
+#include "io/nifindex.h"
 #include "model/kfmmodel.h"
 #include "model/nifmodel.h"
 #include "ui/widgets/fileselect.h"
 
+#include <fsengine/bsa.h>
+#include <fsengine/fsengine.h>
+
 #include <QAction>
+#include <QBuffer>
 #include <QCheckBox>
 #include <QCloseEvent>
 #include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <QGroupBox>
 #include <QLabel>
 #include <QLayout>
@@ -20,10 +28,30 @@
 #include <QSettings>
 #include <QSpinBox>
 #include <QTextBrowser>
+#include <QTimer>
 #include <QToolButton>
 #include <QQueue>
 
-#define NUM_THREADS 2
+#include <algorithm>
+
+
+//! Number of files the scanner hands to the workers at once
+#define SCAN_BATCH 64
+//! Number of results a worker collects before sending them to the GUI
+#define RESULT_BATCH 50
+//! Maximum time in ms a worker holds on to results before sending them to the GUI
+#define RESULT_INTERVAL 250
+
+
+//! Converts name filters such as "*.nif" to suffixes such as ".nif"
+static QStringList filterSuffixes( const QStringList & extensions )
+{
+	QStringList suffixes;
+	for ( const QString & ext : extensions ) {
+		suffixes << ext.mid( 1 );
+	}
+	return suffixes;
+}
 
 
 TestShredder * TestShredder::create()
@@ -36,7 +64,7 @@ TestShredder * TestShredder::create()
 
 
 TestShredder::TestShredder()
-	: QWidget()
+	: QWidget(), index( new NifIndex )
 {
 	QSettings settings;
 	settings.beginGroup( "XML Checker" );
@@ -60,6 +88,10 @@ TestShredder::TestShredder()
 	chkKfm->setChecked( settings.value( "Check KFM", true ).toBool() );
 	chkKfm->setToolTip( tr( "Check .kfm files" ) );
 
+	chkArchives = new QCheckBox( tr( "*.bsa/ba2" ), this );
+	chkArchives->setChecked( settings.value( "Check Archives", false ).toBool() );
+	chkArchives->setToolTip( tr( "Check files inside .bsa and .ba2 archives" ) );
+
 	QAction * aChoose = new QAction( tr( "Block Match" ), this );
 	connect( aChoose, &QAction::triggered, this, &TestShredder::chooseBlock );
 	QToolButton * btChoose = new QToolButton( this );
@@ -70,14 +102,25 @@ TestShredder::TestShredder()
 	repErr = new QCheckBox( tr( "report errors only" ), this );
 	repErr->setChecked( settings.value( "Report Errors Only", true ).toBool() );
 
+	int idealThreads = std::max( QThread::idealThreadCount(), 1 );
+
 	count = new QSpinBox();
-	count->setRange( 1, 8 );
-	count->setValue( settings.value( "Threads", NUM_THREADS ).toInt() );
+	count->setRange( 1, std::max( idealThreads * 2, 8 ) );
+	count->setValue( settings.value( "Threads", idealThreads ).toInt() );
 	connect( count, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &TestShredder::renumberThreads );
 
 	//Version Check
 	verMatch = new QLineEdit( this );
 
+	chkIndex = new QCheckBox( tr( "use index" ), this );
+	chkIndex->setChecked( settings.value( "Use Index", false ).toBool() );
+	chkIndex->setToolTip( tr( "Keep an index of the files so later matches skip files that do not match" ) );
+
+	textureMatch = new QLineEdit( this );
+	textureMatch->setToolTip( tr( "Only report files using a texture or material path containing this text. Requires the index." ) );
+	textureMatch->setEnabled( chkIndex->isChecked() );
+	connect( chkIndex, &QCheckBox::toggled, textureMatch, &QLineEdit::setEnabled );
+
 	text = new QTextBrowser();
 	text->setHidden( false );
 	text->setReadOnly( true );
@@ -88,10 +131,18 @@ TestShredder::TestShredder()
 	label = new QLabel( this );
 	label->setHidden( true );
 
+	progressTimer = new QTimer( this );
+	progressTimer->setInterval( 250 );
+	connect( progressTimer, &QTimer::timeout, this, &TestShredder::updateProgress );
+
 	btRun = new QPushButton( tr( "run" ), this );
 	btRun->setCheckable( true );
 	connect( btRun, &QPushButton::clicked, this, &TestShredder::run );
 
+	QPushButton * btQuery = new QPushButton( tr( "Query Index" ), this );
+	btQuery->setToolTip( tr( "List the indexed files matching the block, version and texture without loading them" ) );
+	connect( btQuery, &QPushButton::clicked, this, &TestShredder::query );
+
 	QPushButton * btXML = new QPushButton( tr( "Reload XML" ), this );
 	connect( btXML, &QPushButton::clicked, this, &TestShredder::xml );
 
@@ -108,6 +159,7 @@ TestShredder::TestShredder()
 	hbox->addWidget( chkNif );
 	hbox->addWidget( chkKf );
 	hbox->addWidget( chkKfm );
+	hbox->addWidget( chkArchives );
 
 	lay->addLayout( hbox = new QHBoxLayout() );
 	hbox->addWidget( btChoose );
@@ -119,6 +171,9 @@ TestShredder::TestShredder()
 	lay->addLayout( hbox = new QHBoxLayout() );
 	hbox->addWidget( new QLabel( tr( "Version Match:" ) ) );
 	hbox->addWidget( verMatch );
+	hbox->addWidget( new QLabel( tr( "Texture Match:" ) ) );
+	hbox->addWidget( textureMatch );
+	hbox->addWidget( chkIndex );
 
 	lay->addWidget( text );
 
@@ -128,6 +183,7 @@ TestShredder::TestShredder()
 
 	lay->addLayout( hbox = new QHBoxLayout() );
 	hbox->addWidget( btRun );
+	hbox->addWidget( btQuery );
 	hbox->addWidget( btXML );
 	hbox->addWidget( btClose );
 
@@ -146,12 +202,17 @@ TestShredder::~TestShredder()
 	settings.setValue( "Check NIF", chkNif->isChecked() );
 	settings.setValue( "Check KF", chkKf->isChecked() );
 	settings.setValue( "Check KFM", chkKfm->isChecked() );
+	settings.setValue( "Check Archives", chkArchives->isChecked() );
+	settings.setValue( "Use Index", chkIndex->isChecked() );
 	settings.setValue( "Report Errors Only", repErr->isChecked() );
 	settings.setValue( "Threads", count->value() );
 
 	settings.endGroup();
 
 	queue.clear();
+	for ( TestThread * thread : threads ) {
+		thread->wait();
+	}
 }
 
 void TestShredder::xml()
@@ -166,20 +227,12 @@ void TestShredder::xml()
 
 void TestShredder::renumberThreads( int num )
 {
+	// The worker queues are sized at the start of a run, so the count is locked while running
 	while ( threads.count() < num ) {
-		TestThread * thread = new TestThread( this, &queue );
-		connect( thread, &TestThread::sigStart, this, &TestShredder::threadStarted );
-		connect( thread, &TestThread::sigReady, text, &QTextBrowser::append );
+		TestThread * thread = new TestThread( this, &queue, threads.count() );
+		connect( thread, &TestThread::sigReady, this, &TestShredder::threadResults );
 		connect( thread, &TestThread::finished, this, &TestShredder::threadFinished );
 		threads.append( thread );
-
-		thread->blockMatch = blockMatch->text();
-		thread->verMatch  = NifModel::version2number( verMatch->text() );
-		thread->reportAll = !repErr->isChecked();
-
-		if ( btRun->isChecked() ) {
-			thread->start();
-		}
 	}
 
 	while ( threads.count() > num ) {
@@ -190,7 +243,6 @@ void TestShredder::renumberThreads( int num )
 
 void TestShredder::run()
 {
-	progress->setMaximum( progress->maximum() - queue.count() );
 	queue.clear();
 
 	if ( !btRun->isChecked() )
@@ -201,7 +253,6 @@ void TestShredder::run()
 	}
 
 	text->clear();
-	label->setHidden( true );
 
 	QStringList extensions;
 
@@ -212,39 +263,122 @@ void TestShredder::run()
 	if ( chkKfm->isChecked() )
 		extensions << "*.kfm";
 
-	queue.init( directory->text(), extensions, recursive->isChecked() );
+	count->setEnabled( false );
+
+	NifIndex * idx = nullptr;
+	if ( chkIndex->isChecked() ) {
+		index->load( directory->text() );
+		index->setQuery( blockMatch->text(), NifModel::version2number( verMatch->text() ), textureMatch->text() );
+		index->beginScan();
+		idx = index.get();
+	}
+
+	scanExtensions = extensions;
+	scanRecursive = recursive->isChecked();
+	scanArchives = chkArchives->isChecked();
+
+	queue.init( directory->text(), extensions, scanRecursive, scanArchives, idx, threads.count() );
 
 	time = QDateTime::currentDateTime();
 
-	progress->setRange( 0, queue.count() );
+	progress->setRange( 0, 0 );
 	progress->setValue( 0 );
 
 	for ( TestThread * thread : threads ) {
 		thread->verMatch = NifModel::version2number( verMatch->text() );
 		thread->blockMatch = blockMatch->text();
 		thread->reportAll  = !repErr->isChecked();
+		thread->index = idx;
 		thread->start();
 	}
+
+	progressTimer->start();
+	updateProgress();
 }
 
-void TestShredder::threadStarted()
+void TestShredder::threadResults( const QStringList & results )
 {
-	progress->setValue( progress->maximum() - queue.count() );
+	for ( const QString & result : results ) {
+		text->append( result );
+	}
+}
+
+void TestShredder::updateProgress()
+{
+	int processed = 0;
+	for ( TestThread * thread : threads ) {
+		processed += thread->processed();
+	}
+
+	int found = queue.discovered();
+
+	// A zero range keeps the bar busy until the first files show up
+	progress->setRange( 0, found );
+	progress->setValue( processed );
+
+	qint64 msecs = time.msecsTo( QDateTime::currentDateTime() );
+	double rate = (msecs > 0) ? processed * 1000.0 / msecs : 0.0;
+
+	QString status = tr( "%1 / %2 files, %3 files/s" ).arg( processed ).arg( found ).arg( rate, 0, 'f', 1 );
+	if ( queue.isScanning() )
+		status += tr( " (scanning)" );
+
+	label->setText( status );
+	label->setVisible( true );
 }
 
 void TestShredder::threadFinished()
 {
-	if ( queue.isEmpty() ) {
-		for ( TestThread * thread : threads ) {
-			if ( thread->isRunning() )
-				return;
-		}
+	for ( TestThread * thread : threads ) {
+		if ( thread->isRunning() )
+			return;
+	}
 
-		btRun->setChecked( false );
+	progressTimer->stop();
+	updateProgress();
 
-		label->setText( tr( "%1 files in %2 seconds" ).arg( progress->maximum() ).arg( time.secsTo( QDateTime::currentDateTime() ) ) );
-		label->setVisible( true );
+	if ( chkIndex->isChecked() ) {
+		// Only a complete scan tells which files were removed
+		if ( !queue.isAborted() )
+			index->endScan( filterSuffixes( scanExtensions ), scanRecursive, scanArchives );
+		index->save();
 	}
+
+	btRun->setChecked( false );
+	count->setEnabled( true );
+
+	int processed = 0;
+	for ( TestThread * thread : threads ) {
+		processed += thread->processed();
+	}
+
+	qint64 msecs = time.msecsTo( QDateTime::currentDateTime() );
+	double rate = (msecs > 0) ? processed * 1000.0 / msecs : 0.0;
+
+	label->setText( tr( "%1 files in %2 seconds (%3 files/s)" ).arg( processed ).arg( msecs / 1000.0, 0, 'f', 1 ).arg( rate, 0, 'f', 1 ) );
+	label->setVisible( true );
+}
+
+void TestShredder::query()
+{
+	if ( btRun->isChecked() )
+		return;
+
+	index->load( directory->text() );
+	index->setQuery( blockMatch->text(), NifModel::version2number( verMatch->text() ), textureMatch->text() );
+
+	QStringList files = index->query();
+
+	QStringList links;
+	for ( const QString & file : files ) {
+		links << QString( "<a href=\"nif:%1\">%1</a>" ).arg( file );
+	}
+
+	text->clear();
+	text->append( links.join( "<br>" ) );
+
+	label->setText( tr( "%1 of %2 indexed files match" ).arg( files.count() ).arg( index->count() ) );
+	label->setVisible( true );
 }
 
 void TestShredder::chooseBlock()
@@ -295,66 +429,239 @@ void TestShredder::closeEvent( QCloseEvent * e )
  *  File Queue
  */
 
-QQueue<QString> FileQueue::make( const QString & dname, const QStringList & extensions, bool recursive )
+FileQueue::~FileQueue()
+{
+	clear();
+}
+
+void FileQueue::Scanner::run()
 {
-	QQueue<QString> paths;
+	// A single archive may be given instead of a directory
+	if ( QFileInfo( directory ).isFile() ) {
+		scanArchive( directory );
+		queue->finish();
+		return;
+	}
+
+	QDirIterator::IteratorFlags flags = QDirIterator::NoIteratorFlags;
+	if ( recursive )
+		flags = QDirIterator::Subdirectories;
+
+	QStringList filters = extensions;
+	if ( archives )
+		filters << "*.bsa" << "*.ba2";
+
+	QDirIterator it( directory, filters, QDir::Files, flags );
+
+	// Hand out files while the scan is still running so the workers never sit idle
+	QList<TestFile> batch;
+	while ( it.hasNext() && !queue->aborted.loadAcquire() ) {
+		QString path = it.next();
 
-	QDir dir( dname );
+		if ( archives && (path.endsWith( ".bsa", Qt::CaseInsensitive ) || path.endsWith( ".ba2", Qt::CaseInsensitive )) ) {
+			scanArchive( path );
+			continue;
+		}
+
+		TestFile file;
+		file.path = path;
+
+		if ( !accept( file, path, it.fileInfo() ) )
+			continue;
 
-	if ( recursive ) {
-		dir.setFilter( QDir::Dirs );
-		for ( const QString& d : dir.entryList() ) {
-			if ( d != "." && d != ".." )
-				paths += make( dir.filePath( d ), extensions, true );
+		batch << file;
+
+		if ( batch.count() >= SCAN_BATCH ) {
+			queue->enqueue( batch );
+			batch.clear();
 		}
 	}
 
-	dir.setFilter( QDir::Files );
-	dir.setNameFilters( extensions );
-	for ( const QString& f : dir.entryList() ) {
-		paths.enqueue( dir.filePath( f ) );
+	queue->enqueue( batch );
+	queue->finish();
+}
+
+void FileQueue::Scanner::scanArchive( const QString & path )
+{
+	if ( !BSA::canOpen( path ) )
+		return;
+
+	auto handler = FSArchiveHandler::openArchive( path );
+	if ( !handler )
+		return;
+
+	auto bsa = handler->getArchive<BSA *>();
+	if ( !bsa )
+		return;
+
+	// Extensions are name filters such as "*.nif"; match the entries by suffix
+	QStringList suffixes = filterSuffixes( extensions );
+
+	// Entries are indexed with the size and time of their archive
+	QFileInfo info( bsa->path() );
+
+	QList<TestFile> batch;
+	for ( const QString & entry : bsa->fileList() ) {
+		if ( queue->aborted.loadAcquire() )
+			break;
+
+		for ( const QString & suffix : suffixes ) {
+			if ( entry.endsWith( suffix, Qt::CaseInsensitive ) ) {
+				TestFile file;
+				file.path = entry;
+				file.archive = handler;
+
+				if ( accept( file, bsa->path() + "/" + entry, info ) )
+					batch << file;
+				break;
+			}
+		}
+
+		if ( batch.count() >= SCAN_BATCH ) {
+			queue->enqueue( batch );
+			batch.clear();
+		}
 	}
 
-	return paths;
+	queue->enqueue( batch );
 }
 
-void FileQueue::init( const QString & dname, const QStringList & extensions, bool recursive )
+bool FileQueue::Scanner::accept( TestFile & file, const QString & key, const QFileInfo & info )
 {
-	QQueue<QString> paths = make( dname, extensions, recursive );
+	NifIndex * index = queue->index;
 
-	mutex.lock();
-	this->queue = paths;
-	mutex.unlock();
+	// KFM files are not NIFs and are never indexed
+	if ( !index || key.endsWith( ".kfm", Qt::CaseInsensitive ) )
+		return true;
+
+	if ( index->isCurrent( key, info.size(), info.lastModified() ) )
+		return index->matches( key );
+
+	file.reindex = true;
+	file.size = info.size();
+	file.modified = info.lastModified();
+	return true;
 }
 
-QString FileQueue::dequeue()
+void FileQueue::init( const QString & dname, const QStringList & extensions, bool recursive, bool archives, NifIndex * idx, int workers )
 {
-	QMutexLocker lock( &mutex );
+	clear();
 
-	if ( queue.isEmpty() )
-		return QString();
+	index = idx;
 
-	return queue.dequeue();
+	queues.clear();
+	for ( int i = 0; i < std::max( workers, 1 ); i++ ) {
+		queues.emplace_back( new WorkerQueue );
+	}
+	nextQueue = 0;
+
+	pending.storeRelease( 0 );
+	total.storeRelease( 0 );
+	aborted.storeRelease( 0 );
+	scanning.storeRelease( 1 );
+
+	scanner = new Scanner( this );
+	scanner->directory = dname;
+	scanner->extensions = extensions;
+	scanner->recursive = recursive;
+	scanner->archives = archives;
+	scanner->start();
 }
 
-int FileQueue::count()
+void FileQueue::enqueue( const QList<TestFile> & paths )
 {
+	if ( paths.isEmpty() || queues.empty() )
+		return;
+
+	// Deal the batch out round-robin, locking each worker queue once
+	int n = int( queues.size() );
+	for ( int i = 0; i < n && i < paths.count(); i++ ) {
+		WorkerQueue * q = queues[(nextQueue + i) % n].get();
+
+		QMutexLocker lock( &q->mutex );
+		for ( int j = i; j < paths.count(); j += n ) {
+			q->paths.enqueue( paths.at( j ) );
+		}
+	}
+	nextQueue = (nextQueue + paths.count()) % n;
+
+	total.fetchAndAddOrdered( paths.count() );
+	pending.fetchAndAddOrdered( paths.count() );
+
 	QMutexLocker lock( &mutex );
-	return queue.count();
+	wait.wakeAll();
+}
+
+void FileQueue::finish()
+{
+	scanning.storeRelease( 0 );
+
+	QMutexLocker lock( &mutex );
+	wait.wakeAll();
+}
+
+TestFile FileQueue::dequeue( int worker )
+{
+	int n = int( queues.size() );
+	if ( n == 0 )
+		return TestFile();
+
+	forever {
+		if ( aborted.loadAcquire() )
+			return TestFile();
+
+		// Own queue first, then steal from the back of the others
+		for ( int i = 0; i < n; i++ ) {
+			WorkerQueue * q = queues[(worker + i) % n].get();
+
+			QMutexLocker lock( &q->mutex );
+			if ( !q->paths.isEmpty() ) {
+				pending.deref();
+				return (i == 0) ? q->paths.dequeue() : q->paths.takeLast();
+			}
+		}
+
+		// Scanning must be checked first; its final batch is counted before it finishes
+		if ( !isScanning() ) {
+			if ( count() == 0 )
+				return TestFile();
+			continue;
+		}
+
+		QMutexLocker lock( &mutex );
+		if ( isScanning() && count() == 0 && !aborted.loadAcquire() )
+			wait.wait( &mutex, 100 );
+	}
 }
 
 void FileQueue::clear()
 {
+	aborted.storeRelease( 1 );
+
+	if ( scanner ) {
+		scanner->wait();
+		delete scanner;
+		scanner = nullptr;
+	}
+
+	for ( auto & q : queues ) {
+		QMutexLocker lock( &q->mutex );
+		q->paths.clear();
+	}
+
+	pending.storeRelease( 0 );
+	scanning.storeRelease( 0 );
+
 	QMutexLocker lock( &mutex );
-	queue.clear();
+	wait.wakeAll();
 }
 
 /*
  *  Thread
  */
 
-TestThread::TestThread( QObject * o, FileQueue * q )
-	: QThread( o ), queue( q )
+TestThread::TestThread( QObject * o, FileQueue * q, int w )
+	: QThread( o ), queue( q ), worker( w )
 {
 	reportAll = true;
 }
@@ -370,13 +677,25 @@ TestThread::~TestThread()
 
 void TestThread::run()
 {
+	// The models live for the whole run so their allocations are reused between files
 	NifModel nif;
 	KfmModel kfm;
 
-	QString filepath = queue->dequeue();
+	QStringList results;
+	QElapsedTimer batchTime;
+	batchTime.start();
+
+	done.storeRelease( 0 );
 
-	while ( !filepath.isEmpty() ) {
-		emit sigStart( filepath );
+	TestFile file = queue->dequeue( worker );
+
+	while ( !file.path.isEmpty() ) {
+		const QString & filepath = file.path;
+
+		// Archive entries are linked as "path/to/archive.bsa/path/to/file.nif"
+		QString link = filepath;
+		if ( file.archive )
+			link = file.archive->getArchive()->path() + "/" + filepath;
 
 		BaseModel * model = &nif;
 		QReadWriteLock * lock = &nif.XMLlock;
@@ -392,10 +711,37 @@ void TestThread::run()
 			// lock the XML lock
 			QReadLocker lck( lock );
 
-			if ( model == &nif && nif.earlyRejection( filepath, blockMatch, verMatch ) ) {
-				bool loaded = model->loadFromFile( filepath );
+			bool accepted = false;
+			bool loaded = false;
+
+			if ( model == &nif ) {
+				// Files missing from the index are loaded in full so they can be indexed
+				bool reindex = index && file.reindex;
+
+				if ( file.archive ) {
+					// Parse the entry straight from memory
+					QByteArray data;
+					if ( file.archive->getArchive()->fileContents( filepath, data ) ) {
+						QBuffer buf( &data );
+						if ( buf.open( QIODevice::ReadOnly ) && (reindex || nif.earlyRejection( buf, blockMatch, verMatch )) ) {
+							accepted = true;
+							buf.seek( 0 );
+							loaded = nif.load( buf );
+						}
+					}
+				} else if ( reindex || nif.earlyRejection( filepath, blockMatch, verMatch ) ) {
+					accepted = true;
+					loaded = model->loadFromFile( filepath );
+				}
+
+				if ( reindex && loaded ) {
+					index->update( link, file.size, file.modified, &nif );
+					accepted = index->matches( link );
+				}
+			}
 
-				QString result = QString( "<a href=\"nif:%1\">%1</a> (%2)" ).arg( filepath, model->getVersion() );
+			if ( accepted ) {
+				QString result = QString( "<a href=\"nif:%1\">%1</a> (%2)" ).arg( link, model->getVersion() );
 				QList<TestMessage> messages = model->getMessages();
 
 				bool blk_match = false;
@@ -423,18 +769,29 @@ void TestThread::run()
 					}
 
 					if ( rep )
-						emit sigReady( result );
+						results << result;
 				}
 			}
 		}
 
+		done.ref();
+
+		if ( !results.isEmpty() && (results.count() >= RESULT_BATCH || batchTime.elapsed() > RESULT_INTERVAL) ) {
+			emit sigReady( results );
+			results.clear();
+			batchTime.restart();
+		}
+
 		if ( quit.tryLock() )
 			quit.unlock();
 		else
 			break;
 
-		filepath = queue->dequeue();
+		file = queue->dequeue( worker );
 	}
+
+	if ( !results.isEmpty() )
+		emit sigReady( results );
 }
 
 static QString linkId( const NifModel * nif, QModelIndex idx )
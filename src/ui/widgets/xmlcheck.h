@@ -4,41 +4,118 @@
 
 #include <QThread> // Inherited
 #include <QWidget> // Inherited
+#include <QAtomicInt>
 #include <QMutex>
 #include <QQueue>
 #include <QDateTime>
 #include <QWaitCondition>
 
+#include <memory>
+#include <vector>
+
 
 class QCheckBox;
+class QFileInfo;
 class QLabel;
 class QLineEdit;
 class QProgressBar;
 class QPushButton;
 class QSpinBox;
 class QTextBrowser;
+class QTimer;
 
 class TestMessage;
 class FileSelector;
+class FSArchiveHandler;
+class NifIndex;
 
+//! A file to check, either loose on disk or an entry inside an archive
+struct TestFile
+{
+	//! The file path, or the path of the entry inside the archive
+	QString path;
+	//! The archive holding the entry, if any
+	std::shared_ptr<FSArchiveHandler> archive;
+
+	//! Whether the file is missing from the index or out of date
+	bool reindex = false;
+	//! Size of the file, or of the archive holding it
+	qint64 size = 0;
+	//! Modification time of the file, or of the archive holding it
+	QDateTime modified;
+};
+
+//! A work-stealing queue of files to check, filled while the directory is being scanned
 class FileQueue final
 {
 public:
 	FileQueue() {}
+	~FileQueue();
 
-	QString dequeue();
+	//! Takes the next file for a worker, stealing from other workers if its own queue is empty
+	TestFile dequeue( int worker );
 
 	bool isEmpty() { return count() == 0; }
-	int count();
-
-	void init( const QString & directory, const QStringList & extensions, bool recursive );
+	//! Number of files discovered but not yet taken by a worker
+	int count() const { return pending.loadAcquire(); }
+	//! Number of files discovered so far
+	int discovered() const { return total.loadAcquire(); }
+	//! Whether the directory scan is still running
+	bool isScanning() const { return scanning.loadAcquire() != 0; }
+	//! Whether the last run was cleared before it finished
+	bool isAborted() const { return aborted.loadAcquire() != 0; }
+
+	//! Starts a directory scan; files become available to workers as they are found
+	//! If an index is given, files with a current entry are only queued when they match its query
+	void init( const QString & directory, const QStringList & extensions, bool recursive, bool archives, NifIndex * index, int workers );
 	void clear();
 
 protected:
-	QQueue<QString> make( const QString & directory, const QStringList & extensions, bool recursive );
+	//! Enumerates the directory on its own thread, feeding the worker queues in batches
+	class Scanner final : public QThread
+	{
+	public:
+		Scanner( FileQueue * q ) : queue( q ) {}
+
+		QString directory;
+		QStringList extensions;
+		bool recursive = true;
+		bool archives = false;
+
+	protected:
+		void run() override final;
+
+		//! Queues the entries of an archive matching the extensions
+		void scanArchive( const QString & path );
+		//! Checks a file against the index; returns false if it can be skipped
+		bool accept( TestFile & file, const QString & key, const QFileInfo & info );
+
+		FileQueue * queue;
+	};
+
+	//! A single worker's queue; owner takes from the front, thieves take from the back
+	struct WorkerQueue
+	{
+		QMutex mutex;
+		QQueue<TestFile> paths;
+	};
+
+	void enqueue( const QList<TestFile> & paths );
+	void finish();
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	int nextQueue = 0;
 
 	QMutex mutex;
-	QQueue<QString> queue;
+	QWaitCondition wait;
+
+	QAtomicInt pending;
+	QAtomicInt total;
+	QAtomicInt scanning;
+	QAtomicInt aborted;
+
+	Scanner * scanner = nullptr;
+	NifIndex * index = nullptr;
 };
 
 class TestThread final : public QThread
@@ -46,16 +123,19 @@ class TestThread final : public QThread
 	Q_OBJECT
 
 public:
-	TestThread( QObject * o, FileQueue * q );
+	TestThread( QObject * o, FileQueue * q, int worker );
 	~TestThread();
 
 	QString blockMatch;
 	quint32 verMatch = 0;
 	bool reportAll = false;
+	NifIndex * index = nullptr;
+
+	//! Number of files this worker has finished
+	int processed() const { return done.loadAcquire(); }
 
 signals:
-	void sigStart( const QString & file );
-	void sigReady( const QString & result );
+	void sigReady( const QStringList & results );
 
 protected:
 	void run() override final;
@@ -63,6 +143,9 @@ protected:
 	QList<TestMessage> checkLinks( const class NifModel * nif, const class QModelIndex & iParent, bool kf );
 
 	FileQueue * queue;
+	int worker;
+
+	QAtomicInt done;
 
 	QMutex quit;
 };
@@ -82,10 +165,13 @@ protected slots:
 	void chooseBlock();
 	void run();
 	void xml();
+	void query();
 
-	void threadStarted();
+	void threadResults( const QStringList & results );
 	void threadFinished();
 
+	void updateProgress();
+
 	void renumberThreads( int );
 
 protected:
@@ -95,18 +181,29 @@ protected:
 	QLineEdit * blockMatch;
 	QCheckBox * recursive;
 	QCheckBox * chkNif, * chkKf, * chkKfm;
+	QCheckBox * chkArchives;
+	QCheckBox * chkIndex;
 	QCheckBox * repErr;
 	QSpinBox * count;
 	QLineEdit * verMatch;
+	QLineEdit * textureMatch;
 	QTextBrowser * text;
 	QProgressBar * progress;
 	QLabel * label;
 	QPushButton * btRun;
 
 	FileQueue queue;
+	std::unique_ptr<NifIndex> index;
 
 	QList<TestThread *> threads;
 
+	QTimer * progressTimer;
+
+	//! The extensions and scope of the current run
+	QStringList scanExtensions;
+	bool scanRecursive = true;
+	bool scanArchives = false;
+
 	QDateTime time;
 };
 
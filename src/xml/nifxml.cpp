@@ -35,6 +35,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "model/nifmodel.h"
 
 #include <QtXml> // QXmlDefaultHandler Inherited
+#include <QApplication>
 #include <QCoreApplication>
 #include <QMessageBox>
 
@@ -617,7 +618,11 @@ bool NifModel::loadXML()
 	QString result = NifModel::parseXmlDescription( fname );
 
 	if ( !result.isEmpty() ) {
-		Message::append( tr( "<b>Error loading XML</b><br/>You will need to reinstall the XML and restart the application." ), result, QMessageBox::Critical );
+		// Command line runs have no windows to show the message in
+		if ( qobject_cast<QApplication *>( QCoreApplication::instance() ) )
+			Message::append( tr( "<b>Error loading XML</b><br/>You will need to reinstall the XML and restart the application." ), result, QMessageBox::Critical );
+		else
+			qCritical() << "Error loading XML:" << result;
 		return false;
 	}
 